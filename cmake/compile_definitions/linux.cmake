@@ -174,6 +174,23 @@ if(NOT ${CUDA_FOUND}
     message(FATAL_ERROR "Couldn't find either cuda, wayland, x11, (libdrm and libcap), or libva")
 endif()
 
+# pipewire
+if(${SUNSHINE_ENABLE_PIPEWIRE})
+    pkg_check_modules(PIPEWIRE libpipewire-0.3)
+else()
+    set(PIPEWIRE_FOUND OFF)
+endif()
+if(PIPEWIRE_FOUND)
+    add_compile_definitions(SUNSHINE_BUILD_PIPEWIRE)
+    include_directories(SYSTEM ${PIPEWIRE_INCLUDE_DIRS})
+    list(APPEND PLATFORM_LIBRARIES ${PIPEWIRE_LIBRARIES})
+    list(APPEND PLATFORM_TARGET_FILES
+            "${CMAKE_SOURCE_DIR}/src/platform/linux/pipewire.h"
+            "${CMAKE_SOURCE_DIR}/src/platform/linux/pipewire.cpp")
+else()
+    message(STATUS "PipeWire audio capture disabled")
+endif()
+
 # tray icon
 if(${SUNSHINE_ENABLE_TRAY})
     pkg_check_modules(APPINDICATOR ayatana-appindicator3-0.1)
@@ -66,4 +66,8 @@ elseif(UNIX)  # Linux
             "Enable building wayland specific code." ON)
     option(SUNSHINE_ENABLE_X11
             "Enable X11 grab if available." ON)
+
+    # Linux audio capture
+    option(SUNSHINE_ENABLE_PIPEWIRE
+            "Enable native PipeWire audio capture if available." ON)
 endif()
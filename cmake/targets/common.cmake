@@ -96,6 +96,11 @@ set_source_files_properties("${CMAKE_SOURCE_DIR}/src/rswrapper.c"
         DIRECTORY "${CMAKE_SOURCE_DIR}" "${TEST_DIR}"
         PROPERTIES COMPILE_FLAGS "-ftree-vectorize -funroll-loops")
 
+# src/bgra_convert
+set_source_files_properties("${CMAKE_SOURCE_DIR}/src/bgra_convert.c"
+        DIRECTORY "${CMAKE_SOURCE_DIR}" "${TEST_DIR}"
+        PROPERTIES COMPILE_FLAGS "-O3 -funroll-loops")
+
 # third-party/ViGEmClient
 set(VIGEM_COMPILE_FLAGS "")
 string(APPEND VIGEM_COMPILE_FLAGS "-Wno-unknown-pragmas ")
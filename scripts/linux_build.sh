@@ -104,6 +104,7 @@ function add_debain_based_deps() {
     "libnotify-dev"
     "libnuma-dev"
     "libopus-dev"
+    "libpipewire-0.3-dev"  # PipeWire
     "libpulse-dev"
     "libssl-dev"
     "libwayland-dev"  # Wayland
@@ -111,6 +112,7 @@ function add_debain_based_deps() {
     "libxcb-shm0-dev"  # X11
     "libxcb-xfixes0-dev"  # X11
     "libxcb1-dev"  # X11
+    "libxdamage-dev"  # X11
     "libxfixes-dev"  # X11
     "libxrandr-dev"  # X11
     "libxtst-dev"  # X11
@@ -164,6 +166,7 @@ function add_fedora_deps() {
     "libX11-devel"  # X11
     "libxcb-devel"  # X11
     "libXcursor-devel"  # X11
+    "libXdamage-devel"  # X11
     "libXfixes-devel"  # X11
     "libXi-devel"  # X11
     "libXinerama-devel"  # X11
@@ -176,6 +179,7 @@ function add_fedora_deps() {
     "numactl-devel"
     "openssl-devel"
     "opus-devel"
+    "pipewire-devel"  # PipeWire
     "pulseaudio-libs-devel"
     "rpm-build"  # if you want to build an RPM binary package
     "wget"  # necessary for cuda install with `run` file
@@ -0,0 +1,29 @@
+/**
+ * @file src/adaptive_fec.h
+ * @brief Declarations for adapting the FEC parity of video frames to client loss reports.
+ */
+#pragma once
+
+namespace stream::adaptive_fec {
+  /**
+   * @brief Update the P-frame parity of a session from a client loss report.
+   * @param percentage The current parity percentage.
+   * @param loss_count The number of packets lost since the last report.
+   * @param clean_reports The number of reports without loss since parity last changed, updated by this call.
+   * @param max_percentage The configured parity percentage, which parity never exceeds.
+   * @return The new parity percentage.
+   */
+  int
+  adapt_percentage(int percentage, int loss_count, int &clean_reports, int max_percentage);
+
+  /**
+   * @brief Compute the parity percentage of a frame.
+   * @details Losing part of an IDR or recovery frame costs another round trip to the client,
+   *          so those frames get twice the parity of P-frames.
+   * @param percentage The current P-frame parity percentage.
+   * @param key_frame Whether the frame is an IDR frame or follows a reference frame invalidation.
+   * @return The parity percentage of the frame.
+   */
+  int
+  frame_percentage(int percentage, bool key_frame);
+}  // namespace stream::adaptive_fec
@@ -3,13 +3,17 @@
  * @brief Definitions for audio capture and encoding.
  */
 // standard includes
+#include <algorithm>
+#include <mutex>
 #include <thread>
+#include <utility>
 
 // lib includes
 #include <opus/opus_multistream.h>
 
 // local includes
 #include "audio.h"
+#include "audio_drift.h"
 #include "config.h"
 #include "globals.h"
 #include "logging.h"
@@ -20,7 +24,6 @@
 namespace audio {
   using namespace std::literals;
   using opus_t = util::safe_ptr<OpusMSEncoder, opus_multistream_encoder_destroy>;
-  using sample_queue_t = std::shared_ptr<safe::queue_t<std::vector<float>>>;
 
   static int start_audio_control(audio_ctx_t &ctx);
   static void stop_audio_control(audio_ctx_t &);
@@ -99,7 +102,83 @@ namespace audio {
     },
   };
 
-  void encodeThread(sample_queue_t samples, config_t config, void *channel_data) {
+  /**
+   * @brief Check if two sessions would capture and encode the same audio stream.
+   */
+  static bool
+  same_stream(const config_t &a, const config_t &b) {
+    if (a.packetDuration != b.packetDuration || a.channels != b.channels || a.flags != b.flags) {
+      return false;
+    }
+
+    if (!a.flags[config_t::CUSTOM_SURROUND_PARAMS]) {
+      return true;
+    }
+
+    auto &a_params = a.customStreamParams;
+    auto &b_params = b.customStreamParams;
+    return a_params.channelCount == b_params.channelCount &&
+           a_params.streams == b_params.streams &&
+           a_params.coupledStreams == b_params.coupledStreams &&
+           std::equal(std::begin(a_params.mapping), std::end(a_params.mapping), std::begin(b_params.mapping));
+  }
+
+  buffer_pool_t::buffer_pool_t(std::size_t samples_per_frame):
+      samples_per_frame {samples_per_frame},
+      frames {std::make_shared<image_pool::pool_t<std::vector<float>>>(frame_capacity)},
+      packets {std::make_shared<image_pool::pool_t<packet_raw_t>>(packet_capacity)} {}
+
+  std::shared_ptr<std::vector<float>> buffer_pool_t::frame() {
+    auto alloc = [this]() {
+      return std::make_shared<std::vector<float>>(samples_per_frame);
+    };
+
+    auto frame = frames->acquire(alloc);
+    return frame ? frame : alloc();
+  }
+
+  std::shared_ptr<packet_raw_t> buffer_pool_t::packet() {
+    auto alloc = []() {
+      auto packet = std::make_shared<packet_raw_t>();
+      packet->data = buffer_t {max_packet_size};
+      return packet;
+    };
+
+    auto packet = packets->acquire(alloc);
+    if (!packet) {
+      return alloc();
+    }
+
+    // Undo the size of the last packet encoded into this buffer
+    packet->data.fake_resize(max_packet_size);
+    return packet;
+  }
+
+  image_pool::stats_t buffer_pool_t::frame_stats() const {
+    return frames->stats();
+  }
+
+  image_pool::stats_t buffer_pool_t::packet_stats() const {
+    return packets->stats();
+  }
+
+  bool latency_tracker_t::admit(const packet_raw_t &packet, std::chrono::steady_clock::time_point now, std::chrono::milliseconds budget) {
+    if (packet.dropped_before) {
+      late_packets.fetch_add(packet.dropped_before, std::memory_order_relaxed);
+    }
+
+    if (is_late(packet.captured, now, budget)) {
+      late_packets.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    auto age_ms = std::chrono::duration<double, std::milli>(now - packet.captured).count();
+    avg_ms += (age_ms - avg_ms) / 32;
+    avg_us.store((std::int64_t) (avg_ms * 1000), std::memory_order_relaxed);
+    return true;
+  }
+
+  void encodeThread(sample_queue_t samples, config_t config, std::shared_ptr<subscribers_t> subscribers, std::shared_ptr<buffer_pool_t> pool) {
     auto packets = mail::man->queue<packet_t>(mail::audio_packets);
     auto stream = stream_configs[map_stream(config.channels, config.flags[config_t::HIGH_QUALITY])];
     if (config.flags[config_t::CUSTOM_SURROUND_PARAMS]) {
@@ -139,10 +218,27 @@ namespace audio {
                     << stream.bitrate / 1000 << " kbps (total), LOWDELAY"sv;
 
     auto frame_size = config.packetDuration * stream.sampleRate / 1000;
-    while (auto sample = samples->pop()) {
-      buffer_t packet {1400};
+    std::chrono::milliseconds latency_budget {config::audio.latency_budget};
+
+    std::uint32_t dropped = 0;
+    std::uint64_t total_dropped = 0;
+    auto fg = util::fail_guard([&]() {
+      if (total_dropped) {
+        BOOST_LOG(info) << "Dropped "sv << total_dropped << " audio frame(s) that were late for encoding"sv;
+      }
+    });
+
+    while (auto frame = samples->pop()) {
+      // Catch up after a stall rather than encoding the whole backlog
+      if (is_late(frame->captured, std::chrono::steady_clock::now(), latency_budget)) {
+        ++dropped;
+        ++total_dropped;
+        continue;
+      }
 
-      int bytes = opus_multistream_encode_float(opus.get(), sample->data(), frame_size, std::begin(packet), packet.size());
+      auto packet = pool->packet();
+
+      int bytes = opus_multistream_encode_float(opus.get(), frame->samples->data(), frame_size, std::begin(packet->data), packet->data.size());
       if (bytes < 0) {
         BOOST_LOG(error) << "Couldn't encode audio: "sv << opus_strerror(bytes);
         packets->stop();
@@ -150,18 +246,30 @@ namespace audio {
         return;
       }
 
-      packet.fake_resize(bytes);
-      packets->raise(channel_data, std::move(packet));
+      packet->data.fake_resize(bytes);
+      packet->captured = frame->captured;
+      packet->dropped_before = std::exchange(dropped, 0);
+
+      // Sessions share the packet, sequence numbers and encryption are added per session
+      std::lock_guard lg {subscribers->mutex};
+      auto &sessions = subscribers->sessions;
+      for (std::size_t x = 1; x < sessions.size(); ++x) {
+        packets->raise(sessions[x].channel_data, packet);
+      }
+      if (!sessions.empty()) {
+        packets->raise(sessions.front().channel_data, std::move(packet));
+      }
     }
   }
 
-  void capture(safe::mail_t mail, config_t config, void *channel_data) {
+  /**
+   * @brief Capture and encode audio until shutdown is raised on the mail.
+   * @param mail The mail of the session, or of the shared capture.
+   * @param config The audio configuration.
+   * @param subscribers The sessions receiving the encoded packets.
+   */
+  static void capture_run(safe::mail_t mail, config_t config, std::shared_ptr<subscribers_t> subscribers) {
     auto shutdown_event = mail->event<bool>(mail::shutdown);
-    if (!config::audio.stream) {
-      BOOST_LOG(info) << "Audio streaming is disabled in configuration";
-      shutdown_event->view();
-      return;
-    }
     auto stream = stream_configs[map_stream(config.channels, config.flags[config_t::HIGH_QUALITY])];
     if (config.flags[config_t::CUSTOM_SURROUND_PARAMS]) {
       apply_surround_params(stream, config.customStreamParams);
@@ -244,23 +352,53 @@ namespace audio {
     // Capture takes place on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::critical);
 
-    auto samples = std::make_shared<sample_queue_t::element_type>(30);
-    std::thread thread {encodeThread, samples, config, channel_data};
+    int samples_per_frame = frame_size * stream.channelCount;
+    auto pool = std::make_shared<buffer_pool_t>(samples_per_frame);
+
+    auto samples = std::make_shared<sample_queue_t::element_type>(buffer_pool_t::frame_capacity - 2);
+    std::thread thread {encodeThread, samples, config, std::move(subscribers), pool};
+
+    // Resample to the steady clock that video timestamps follow, so the sound card's drift
+    // doesn't build up in the client's jitter buffer over long sessions
+    std::optional<drift_estimator_t> drift;
+    std::optional<resampler_t> resampler;
+    std::vector<float> capture_buffer;
+    if (config::audio.drift_compensation) {
+      drift.emplace(stream.sampleRate);
+      resampler.emplace(stream.channelCount, frame_size);
+      capture_buffer.resize(samples_per_frame);
+    }
 
     auto fg = util::fail_guard([&]() {
       samples->stop();
       thread.join();
 
+      if (drift) {
+        BOOST_LOG(info) << "Audio clock drift compensation: "sv << (1.0 - drift->ratio()) * 1e6 << " ppm, offset "sv
+                        << drift->offset() * 1000.0 << " ms"sv;
+      }
+
+      auto frame_stats = pool->frame_stats();
+      auto packet_stats = pool->packet_stats();
+      if (frame_stats.exhausted || packet_stats.exhausted) {
+        BOOST_LOG(info) << "Audio buffer pools ran out "sv << frame_stats.exhausted << " frame(s) and "sv
+                        << packet_stats.exhausted << " packet(s) short"sv;
+      }
+
       shutdown_event->view();
     });
 
-    int samples_per_frame = frame_size * stream.channelCount;
-
     while (!shutdown_event->peek()) {
-      std::vector<float> sample_buffer;
-      sample_buffer.resize(samples_per_frame);
+      auto sample_buffer = resampler ? nullptr : pool->frame();
+
+      auto status = mic->sample(resampler ? capture_buffer : *sample_buffer);
+      auto now = std::chrono::steady_clock::now();
+      if (status != platf::capture_e::ok && drift) {
+        // The clock relation doesn't survive a gap in capture
+        drift->reset();
+        resampler->reset();
+      }
 
-      auto status = mic->sample(sample_buffer);
       switch (status) {
         case platf::capture_e::ok:
           break;
@@ -280,12 +418,126 @@ namespace audio {
           return;
       }
 
-      samples->raise(std::move(sample_buffer));
+      if (!resampler) {
+        samples->raise(frame_t {std::move(sample_buffer), now});
+        continue;
+      }
+
+      // Depending on the drift, this leaves no frame, one or occasionally two frames to encode
+      auto produced = resampler->process(capture_buffer.data(), frame_size, drift->ratio());
+      drift->update(now, produced);
+      for (auto frame = pool->frame(); resampler->pop(frame->data(), frame_size); frame = pool->frame()) {
+        samples->raise(frame_t {std::move(frame), now});
+      }
     }
     
     BOOST_LOG(info) << "Audio capture sampling loop ended (shutdown requested)";
   }
 
+  /**
+   * @brief One audio capture and encoder feeding every session that requested the same audio stream.
+   * @details The capture runs on its own mail, so it stops when the last session leaves rather
+   *          than when the session that started it ends.
+   */
+  struct shared_capture_t {
+    explicit shared_capture_t(const config_t &config):
+        config {config},
+        mail {std::make_shared<safe::mail_raw_t>()},
+        shutdown_event {mail->event<bool>(mail::shutdown)},
+        subscribers {std::make_shared<subscribers_t>()} {}
+
+    const config_t config;
+
+    safe::mail_t mail;
+    safe::mail_raw_t::event_t<bool> shutdown_event;
+    std::shared_ptr<subscribers_t> subscribers;
+
+    std::thread thread;
+  };
+
+  static std::mutex shared_captures_mutex;
+  static std::vector<std::shared_ptr<shared_capture_t>> shared_captures;
+
+  /**
+   * @brief Stream a session from an audio capture shared with all sessions of the same audio stream.
+   * @details The capture is started by the first session and stopped when the last one ends.
+   */
+  static void capture_shared(safe::mail_t mail, const config_t &config, void *channel_data) {
+    subscribers_t::subscriber_t subscriber {channel_data, mail->event<bool>(mail::shutdown)};
+
+    std::shared_ptr<shared_capture_t> shared;
+    {
+      std::lock_guard lg {shared_captures_mutex};
+
+      auto it = std::find_if(std::begin(shared_captures), std::end(shared_captures), [&config](const auto &shared) {
+        return same_stream(shared->config, config) && !shared->shutdown_event->peek();
+      });
+
+      if (it != std::end(shared_captures)) {
+        shared = *it;
+      } else {
+        shared = std::make_shared<shared_capture_t>(config);
+        shared->thread = std::thread {[shared = shared.get()]() {
+          capture_run(shared->mail, shared->config, shared->subscribers);
+
+          // If capture failed, end the sessions as a dedicated capture would
+          std::lock_guard lg {shared->subscribers->mutex};
+          shared->shutdown_event->raise(true);
+          for (auto &subscriber : shared->subscribers->sessions) {
+            subscriber.shutdown_event->raise(true);
+          }
+        }};
+
+        shared_captures.emplace_back(shared);
+      }
+
+      std::lock_guard lg_subscribers {shared->subscribers->mutex};
+      shared->subscribers->sessions.emplace_back(subscriber);
+
+      BOOST_LOG(info) << "Shared audio capture "sv << config.channels << " channels, "sv << config.packetDuration
+                      << " ms now has "sv << shared->subscribers->sessions.size() << " session(s)"sv;
+    }
+
+    // Stream until this session ends, or until the capture fails
+    subscriber.shutdown_event->view();
+
+    {
+      std::lock_guard lg {shared_captures_mutex};
+      std::lock_guard lg_subscribers {shared->subscribers->mutex};
+
+      std::erase_if(shared->subscribers->sessions, [channel_data](const auto &subscriber) {
+        return subscriber.channel_data == channel_data;
+      });
+      if (!shared->subscribers->sessions.empty()) {
+        return;
+      }
+
+      std::erase(shared_captures, shared);
+    }
+
+    // The last session stops the capture
+    BOOST_LOG(info) << "Stopping shared audio capture"sv;
+    shared->shutdown_event->raise(true);
+    shared->thread.join();
+  }
+
+  void capture(safe::mail_t mail, config_t config, void *channel_data) {
+    if (!config::audio.stream) {
+      BOOST_LOG(info) << "Audio streaming is disabled in configuration";
+      mail->event<bool>(mail::shutdown)->view();
+      return;
+    }
+
+    if (config::audio.shared_capture) {
+      capture_shared(std::move(mail), config, channel_data);
+      return;
+    }
+
+    auto subscribers = std::make_shared<subscribers_t>();
+    subscribers->sessions.emplace_back(subscribers_t::subscriber_t {channel_data, mail->event<bool>(mail::shutdown)});
+    capture_run(std::move(mail), config, std::move(subscribers));
+  }
+
   // 确保唯一实例
   namespace {
     auto control_shared = safe::make_shared<audio_ctx_t>(start_audio_control, stop_audio_control);
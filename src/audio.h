@@ -5,11 +5,17 @@
 #pragma once
 
 // local includes
+#include "image_pool.h"
 #include "platform/common.h"
 #include "thread_safe.h"
 #include "utility.h"
 
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace audio {
   enum stream_config_e : int {
@@ -70,9 +76,136 @@ namespace audio {
   };
 
   using buffer_t = util::buffer_t<std::uint8_t>;
-  using packet_t = std::pair<void *, buffer_t>;
+
+  /**
+   * @brief An encoded Opus packet.
+   */
+  struct packet_raw_t {
+    buffer_t data;
+    std::chrono::steady_clock::time_point captured;  ///< When the audio in the packet was captured
+    std::uint32_t dropped_before;  ///< Late frames the encoder dropped since the previous packet
+  };
+
+  using packet_t = std::pair<void *, std::shared_ptr<packet_raw_t>>;
   using audio_ctx_ref_t = safe::shared_t<audio_ctx_t>::ptr_t;
 
+  /**
+   * @brief Preallocated PCM frames and Opus packets passed from capture to encode to broadcast.
+   * @details Buffers go back to their pool when the last thread holding them drops them, so the
+   *          steady-state audio path doesn't touch the allocator. If every buffer is in flight,
+   *          a one-off buffer is allocated rather than dropping audio.
+   *
+   *          frame() must only be called from the capture thread, and packet() from the encode thread.
+   */
+  class buffer_pool_t {
+  public:
+    /**
+     * @brief Frames waiting in the sample queue, plus the ones being captured and encoded.
+     */
+    static constexpr std::size_t frame_capacity = 32;
+
+    /**
+     * @brief Packets waiting in the audio packets queue, plus the ones being encoded and sent.
+     */
+    static constexpr std::size_t packet_capacity = 34;
+
+    /**
+     * @brief Largest Opus packet, which fits the payload of one RTP packet.
+     */
+    static constexpr std::size_t max_packet_size = 1400;
+
+    explicit buffer_pool_t(std::size_t samples_per_frame);
+
+    /**
+     * @brief Get a PCM frame of `samples_per_frame` interleaved samples.
+     */
+    std::shared_ptr<std::vector<float>>
+    frame();
+
+    /**
+     * @brief Get a packet buffer of `max_packet_size` bytes.
+     */
+    std::shared_ptr<packet_raw_t>
+    packet();
+
+    image_pool::stats_t
+    frame_stats() const;
+
+    image_pool::stats_t
+    packet_stats() const;
+
+  private:
+    std::size_t samples_per_frame;
+    std::shared_ptr<image_pool::pool_t<std::vector<float>>> frames;
+    std::shared_ptr<image_pool::pool_t<packet_raw_t>> packets;
+  };
+
+  /**
+   * @brief Check if audio has waited too long to be worth encoding or sending.
+   * @details Dropping late audio lets latency fall back to its minimum after a stall, instead of
+   *          the backlog that built up during the stall delaying every packet after it.
+   * @param captured When the audio was captured.
+   * @param now The current time.
+   * @param budget The longest audio may wait after capture, or 0 for no limit.
+   */
+  inline bool
+  is_late(std::chrono::steady_clock::time_point captured, std::chrono::steady_clock::time_point now, std::chrono::milliseconds budget) {
+    return budget.count() > 0 && now - captured > budget;
+  }
+
+  /**
+   * @brief A captured PCM frame.
+   */
+  struct frame_t {
+    std::shared_ptr<std::vector<float>> samples;
+    std::chrono::steady_clock::time_point captured;  ///< When the frame was captured
+  };
+
+  using sample_queue_t = std::shared_ptr<safe::queue_t<frame_t>>;
+
+  /**
+   * @brief The sessions receiving the packets of one audio capture.
+   * @details A dedicated capture has a single subscriber, a shared capture has one per session.
+   */
+  struct subscribers_t {
+    struct subscriber_t {
+      void *channel_data;
+      safe::mail_raw_t::event_t<bool> shutdown_event;
+    };
+
+    std::mutex mutex;
+    std::vector<subscriber_t> sessions;
+  };
+
+  /**
+   * @brief Latency of the audio sent to one session, kept by the broadcast thread.
+   */
+  struct latency_tracker_t {
+    double avg_ms = 0;  ///< Smoothed age of the audio sent, only accessed by the broadcast thread
+    std::atomic<std::int64_t> avg_us { 0 };  ///< avg_ms for other threads
+    std::atomic<std::uint64_t> late_packets { 0 };  ///< Audio dropped for exceeding the latency budget
+
+    /**
+     * @brief Account for a packet about to be sent to the session.
+     * @details Late packets are skipped without using a sequence number or timestamp, so the
+     *          client plays the next packet right away instead of concealing a loss.
+     * @param packet The packet, whose late frames dropped by the encoder are counted too.
+     * @param now The current time.
+     * @param budget The longest audio may wait after capture, or 0 for no limit.
+     * @return `false` if the packet is late and must not be sent.
+     */
+    bool
+    admit(const packet_raw_t &packet, std::chrono::steady_clock::time_point now, std::chrono::milliseconds budget);
+  };
+
+  /**
+   * @brief Encode captured frames and hand the packets to every subscriber until `samples` is stopped.
+   * @details Frames older than `config::audio.latency_budget` are dropped, and counted in the
+   *          `dropped_before` of the next packet. Packets are raised on the audio packets queue of `mail::man`.
+   */
+  void
+  encodeThread(sample_queue_t samples, config_t config, std::shared_ptr<subscribers_t> subscribers, std::shared_ptr<buffer_pool_t> pool);
+
   void
   capture(safe::mail_t mail, config_t config, void *channel_data);
 
@@ -0,0 +1,206 @@
+/**
+ * @file src/audio_drift.cpp
+ * @brief Definitions for audio clock drift compensation.
+ */
+// standard includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+// local includes
+#include "audio_drift.h"
+
+namespace audio {
+  using namespace std::literals;
+
+  namespace {
+    /**
+     * @brief Time after the first update before the offset is tracked, so startup buffering settles.
+     */
+    constexpr auto warmup = 1s;
+
+    /**
+     * @brief Time constant of the low-pass filter on the offset, which averages out capture jitter.
+     */
+    constexpr double filter_time = 2.0;
+
+    /**
+     * @brief Natural period of the loop, in seconds. Critically damped.
+     */
+    constexpr double loop_period = 300.0;
+    constexpr double loop_omega = 2.0 * std::numbers::pi / loop_period;
+
+    /**
+     * @brief An offset this large is a gap in capture rather than drift, so tracking restarts.
+     */
+    constexpr double max_offset = 0.1;
+
+    /**
+     * @brief Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+     */
+    double
+    bessel_i0(double x) {
+      double sum = 1.0;
+      double term = 1.0;
+      for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+          break;
+        }
+      }
+
+      return sum;
+    }
+  }  // namespace
+
+  drift_estimator_t::drift_estimator_t(double sample_rate):
+      _sample_rate { sample_rate }, _samples { 0 }, _offset { 0 }, _integral { 0 }, _ratio { 1.0 } {}
+
+  void
+  drift_estimator_t::reset() {
+    // The rate of the sound card is still valid, only the offset is lost
+    _start.reset();
+    _offset = 0;
+  }
+
+  double
+  drift_estimator_t::update(std::chrono::steady_clock::time_point now, std::size_t samples) {
+    if (!_start) {
+      _start = now;
+    }
+
+    // Keep the reference at the latest update until startup buffering has settled
+    if (now - *_start < warmup) {
+      _reference = now;
+      _last = now;
+      _samples = 0;
+      return _ratio;
+    }
+
+    auto dt = std::chrono::duration<double>(now - _last).count();
+    _last = now;
+    _samples += samples;
+
+    // How far the output is ahead of the steady clock since the reference
+    auto offset = _samples / _sample_rate - std::chrono::duration<double>(now - _reference).count();
+    if (std::abs(offset) > max_offset) {
+      reset();
+      return _ratio;
+    }
+
+    _offset += (offset - _offset) * std::min(1.0, dt / filter_time);
+
+    // The integral settles at the rate difference of the sound card, the offset goes back to 0
+    auto max_integral = resampler_t::max_deviation / (loop_omega * loop_omega);
+    _integral = std::clamp(_integral + _offset * dt, -max_integral, max_integral);
+
+    auto correction = 2.0 * loop_omega * _offset + loop_omega * loop_omega * _integral;
+    _ratio = 1.0 - std::clamp(correction, -resampler_t::max_deviation, resampler_t::max_deviation);
+    return _ratio;
+  }
+
+  resampler_t::resampler_t(int channels, std::size_t max_frame_size):
+      _channels { channels },
+      _coefficients((phases + 1) * taps),
+      _history((taps + max_frame_size) * channels),
+      _output((3 * max_frame_size + 4) * channels) {
+    // Cut off just below half the sample rate, a ratio this close to 1 aliases next to nothing
+    constexpr double cutoff = 0.454;
+    constexpr double beta = 8.6;
+
+    for (int phase = 0; phase <= phases; ++phase) {
+      auto row = &_coefficients[phase * taps];
+
+      double sum = 0;
+      for (int tap = 0; tap < taps; ++tap) {
+        double x = (tap - (taps / 2 - 1)) - (double) phase / phases;
+        double t = x / (taps / 2);
+        double window = std::abs(t) < 1.0 ? bessel_i0(beta * std::sqrt(1.0 - t * t)) / bessel_i0(beta) : 0.0;
+        double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * std::numbers::pi * cutoff * x) / (2.0 * std::numbers::pi * cutoff * x);
+
+        row[tap] = (float) (2.0 * cutoff * sinc * window);
+        sum += row[tap];
+      }
+
+      // Unity gain at DC for every phase
+      for (int tap = 0; tap < taps; ++tap) {
+        row[tap] = (float) (row[tap] / sum);
+      }
+    }
+
+    reset();
+  }
+
+  std::size_t
+  resampler_t::process(const float *in, std::size_t frames, double ratio) {
+    frames = std::min(frames, _history.size() / _channels - _history_frames);
+    std::copy_n(in, frames * _channels, &_history[_history_frames * _channels]);
+    _history_frames += frames;
+
+    auto step = 1.0 / std::clamp(ratio, 1.0 - max_deviation, 1.0 + max_deviation);
+    auto max_output_frames = _output.size() / _channels;
+
+    std::size_t produced = 0;
+    while (_output_frames < max_output_frames) {
+      auto index = (std::size_t) _position;
+      if (index + taps / 2 >= _history_frames) {
+        break;
+      }
+
+      auto phase = (_position - index) * phases;
+      auto row = (int) phase;
+      auto blend = (float) (phase - row);
+      auto row0 = &_coefficients[row * taps];
+      auto row1 = row0 + taps;
+
+      auto base = &_history[(index - (taps / 2 - 1)) * _channels];
+      auto out = &_output[_output_frames * _channels];
+      for (int channel = 0; channel < _channels; ++channel) {
+        float sum0 = 0;
+        float sum1 = 0;
+        for (int tap = 0; tap < taps; ++tap) {
+          auto sample = base[tap * _channels + channel];
+          sum0 += sample * row0[tap];
+          sum1 += sample * row1[tap];
+        }
+
+        out[channel] = sum0 + (sum1 - sum0) * blend;
+      }
+
+      ++_output_frames;
+      ++produced;
+      _position += step;
+    }
+
+    // Drop the input no future output reaches back to
+    auto drop = (std::size_t) _position - (taps / 2 - 1);
+    std::memmove(_history.data(), &_history[drop * _channels], (_history_frames - drop) * _channels * sizeof(float));
+    _history_frames -= drop;
+    _position -= drop;
+
+    return produced;
+  }
+
+  bool
+  resampler_t::pop(float *out, std::size_t frames) {
+    if (_output_frames < frames) {
+      return false;
+    }
+
+    std::copy_n(_output.data(), frames * _channels, out);
+    std::memmove(_output.data(), &_output[frames * _channels], (_output_frames - frames) * _channels * sizeof(float));
+    _output_frames -= frames;
+
+    return true;
+  }
+
+  void
+  resampler_t::reset() {
+    _history_frames = taps / 2 - 1;
+    std::fill_n(_history.begin(), _history_frames * _channels, 0.0f);
+    _position = taps / 2 - 1;
+    _output_frames = 0;
+  }
+}  // namespace audio
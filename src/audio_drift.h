@@ -0,0 +1,132 @@
+/**
+ * @file src/audio_drift.h
+ * @brief Declarations for audio clock drift compensation.
+ */
+#pragma once
+
+// standard includes
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace audio {
+  /**
+   * @brief Estimates the resampling ratio that keeps captured audio in step with the steady clock.
+   * @details The sound card runs on its own clock, so it delivers slightly more or fewer samples
+   *          than its nominal rate per second of the steady clock that video timestamps use.
+   *          The estimator compares the samples leaving the resampler with the samples the steady
+   *          clock expects, and steers the ratio with a second-order loop of a few minutes period.
+   *          This removes the rate difference and the offset that built up before the loop locked.
+   */
+  class drift_estimator_t {
+  public:
+    explicit drift_estimator_t(double sample_rate);
+
+    /**
+     * @brief Restart tracking the offset after a gap in capture. The rate estimate is kept.
+     */
+    void
+    reset();
+
+    /**
+     * @brief Update the estimate.
+     * @param now When the samples were captured.
+     * @param samples The samples per channel that left the resampler since the last update.
+     * @return The ratio of output samples per input sample to resample with.
+     */
+    double
+    update(std::chrono::steady_clock::time_point now, std::size_t samples);
+
+    /**
+     * @brief The current ratio of output samples per input sample.
+     */
+    double
+    ratio() const {
+      return _ratio;
+    }
+
+    /**
+     * @brief How far the output is ahead of the steady clock, in seconds, after filtering.
+     */
+    double
+    offset() const {
+      return _offset;
+    }
+
+  private:
+    double _sample_rate;
+
+    std::optional<std::chrono::steady_clock::time_point> _start;
+    std::chrono::steady_clock::time_point _reference;
+    std::chrono::steady_clock::time_point _last;
+    double _samples;
+
+    double _offset;
+    double _integral;
+    double _ratio;
+  };
+
+  /**
+   * @brief A windowed sinc resampler with a continuously variable ratio close to 1.
+   * @details Interpolates between the phases of a polyphase Kaiser-windowed sinc filter. Output
+   *          samples accumulate until a whole frame can be popped. Buffers are sized up front for
+   *          frames of up to `max_frame_size` samples per channel, so processing doesn't allocate.
+   */
+  class resampler_t {
+  public:
+    /**
+     * @brief Filter taps per output sample.
+     */
+    static constexpr int taps = 64;
+
+    /**
+     * @brief Filter phases per input sample.
+     */
+    static constexpr int phases = 512;
+
+    /**
+     * @brief The furthest the ratio may stray from 1.
+     */
+    static constexpr double max_deviation = 0.002;
+
+    resampler_t(int channels, std::size_t max_frame_size);
+
+    /**
+     * @brief Resample a frame of interleaved samples.
+     * @param in The input samples.
+     * @param frames The samples per channel.
+     * @param ratio The ratio of output samples per input sample.
+     * @return The samples per channel produced.
+     */
+    std::size_t
+    process(const float *in, std::size_t frames, double ratio);
+
+    /**
+     * @brief Pop a frame of interleaved output samples.
+     * @return False if fewer than `frames` samples per channel are ready.
+     */
+    bool
+    pop(float *out, std::size_t frames);
+
+    /**
+     * @brief Drop buffered samples, after a gap in capture.
+     */
+    void
+    reset();
+
+  private:
+    int _channels;
+
+    // Rows of `taps` coefficients, for phases 0 through `phases` inclusive
+    std::vector<float> _coefficients;
+
+    // Input samples, starting `taps / 2 - 1` samples before the next output position
+    std::vector<float> _history;
+    std::size_t _history_frames;
+    double _position;
+
+    std::vector<float> _output;
+    std::size_t _output_frames;
+  };
+}  // namespace audio
@@ -0,0 +1,329 @@
+/**
+ * @file src/bgra_convert.c
+ * @brief Vectorized BGRA to YUV 4:2:0 conversion with different ISA options
+ */
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "bgra_convert.h"
+
+#define DECORATE_FUNC_I(a, b) a##b
+#define DECORATE_FUNC(a, b) DECORATE_FUNC_I(a, b)
+
+// Append an ISA suffix to the kernels
+#define clamp_sample DECORATE_FUNC(clamp_sample, ISA_SUFFIX)
+#define convert_luma_row DECORATE_FUNC(convert_luma_row, ISA_SUFFIX)
+#define convert_chroma_row DECORATE_FUNC(convert_chroma_row, ISA_SUFFIX)
+#define convert_frame DECORATE_FUNC(convert_frame, ISA_SUFFIX)
+#define bgra_to_nv12 DECORATE_FUNC(bgra_to_nv12, ISA_SUFFIX)
+#define bgra_to_p010 DECORATE_FUNC(bgra_to_p010, ISA_SUFFIX)
+#define bgra_to_yuv420p DECORATE_FUNC(bgra_to_yuv420p, ISA_SUFFIX)
+#define bgra_to_yuv420p10 DECORATE_FUNC(bgra_to_yuv420p10, ISA_SUFFIX)
+
+#if defined(__x86_64) || defined(__x86_64__) || defined(__amd64) || defined(__amd64__) || defined(_M_AMD64)
+
+  // Compile a variant for AVX2
+  #if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+  #else
+    #pragma GCC push_options
+    #pragma GCC target("avx2")
+  #endif
+  #define ISA_SUFFIX _avx2
+  #include "bgra_convert_kernels.h"
+  #undef ISA_SUFFIX
+  #if defined(__clang__)
+    #pragma clang attribute pop
+  #else
+    #pragma GCC pop_options
+  #endif
+
+  // Compile a variant for AVX512BW
+  #if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("avx512f,avx512bw"))), apply_to = function)
+  #else
+    #pragma GCC push_options
+    #pragma GCC target("avx512f,avx512bw")
+  #endif
+  #define ISA_SUFFIX _avx512
+  #include "bgra_convert_kernels.h"
+  #undef ISA_SUFFIX
+  #if defined(__clang__)
+    #pragma clang attribute pop
+  #else
+    #pragma GCC pop_options
+  #endif
+
+#endif
+
+// Compile a default variant, which uses SSE2 on x86_64 and NEON on ARM64
+#define ISA_SUFFIX _def
+#include "bgra_convert_kernels.h"
+#undef ISA_SUFFIX
+
+#undef bgra_to_nv12
+#undef bgra_to_p010
+#undef bgra_to_yuv420p
+#undef bgra_to_yuv420p10
+
+// NV12 is what the software encoders take from most hosts, so it also gets hand-written kernels.
+// They match the compiler-vectorized kernels bit for bit, and fall back to them for the last
+// pixels of rows that aren't a multiple of 16 pixels wide.
+#if defined(__x86_64) || defined(__x86_64__) || defined(__amd64) || defined(__amd64__) || defined(_M_AMD64)
+  #include <immintrin.h>
+
+/**
+ * @brief Extract one 8-bit channel of 8 BGRA pixels as 32-bit integers.
+ */
+__attribute__((target("avx2"))) static inline __m256i
+channel_avx2(__m256i pixels, int shift) {
+  return _mm256_and_si256(_mm256_srl_epi32(pixels, _mm_cvtsi32_si128(shift)), _mm256_set1_epi32(0xFF));
+}
+
+/**
+ * @brief Apply one row of the matrix to 8 pixels, without clamping.
+ */
+__attribute__((target("avx2"))) static inline __m256i
+dot_avx2(__m256i r, __m256i g, __m256i b, const int32_t coefficients[4], int32_t offset, int shift) {
+  __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(coefficients[0])), _mm256_set1_epi32(offset));
+  sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(g, _mm256_set1_epi32(coefficients[1])));
+  sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(b, _mm256_set1_epi32(coefficients[2])));
+  return _mm256_sra_epi32(sum, _mm_cvtsi32_si128(shift));
+}
+
+/**
+ * @brief Pack two vectors of 8 samples into 16 bytes, saturating to 0-255.
+ * @details Packing works within 128-bit lanes, so the 32-bit groups are put back in order afterwards.
+ */
+__attribute__((target("avx2"))) static inline __m128i
+pack_avx2(__m256i a, __m256i b) {
+  __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_setzero_si256());
+  return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+}
+
+__attribute__((target("avx2"))) static void
+bgra_to_nv12_avx2_intrin(const uint8_t *src, int src_stride, int width, int height, uint8_t *const dst[3], const int dst_stride[3], const bgra_convert_matrix_t *matrix) {
+  const int32_t u_offset = matrix->u[3] * 4, v_offset = matrix->v[3] * 4;
+  const int vector_width = width & ~15;
+
+  for (int y = 0; y < height; y += 2) {
+    const uint8_t *src0 = src + (ptrdiff_t) y * src_stride;
+    const uint8_t *src1 = src0 + src_stride;
+    uint8_t *dst_y0 = dst[0] + (ptrdiff_t) y * dst_stride[0];
+    uint8_t *dst_y1 = dst_y0 + dst_stride[0];
+    uint8_t *dst_uv = dst[1] + (ptrdiff_t) (y / 2) * dst_stride[1];
+
+    for (int x = 0; x < vector_width; x += 16) {
+      __m256i a0 = _mm256_loadu_si256((const __m256i *) (src0 + x * 4));
+      __m256i b0 = _mm256_loadu_si256((const __m256i *) (src0 + x * 4 + 32));
+      __m256i a1 = _mm256_loadu_si256((const __m256i *) (src1 + x * 4));
+      __m256i b1 = _mm256_loadu_si256((const __m256i *) (src1 + x * 4 + 32));
+
+      __m256i r[4], g[4], b[4];
+      const __m256i *rows[4] = { &a0, &b0, &a1, &b1 };
+      for (int i = 0; i < 4; ++i) {
+        b[i] = channel_avx2(*rows[i], 0);
+        g[i] = channel_avx2(*rows[i], 8);
+        r[i] = channel_avx2(*rows[i], 16);
+      }
+
+      _mm_storeu_si128((__m128i *) (dst_y0 + x), pack_avx2(dot_avx2(r[0], g[0], b[0], matrix->y, matrix->y[3], 16), dot_avx2(r[1], g[1], b[1], matrix->y, matrix->y[3], 16)));
+      _mm_storeu_si128((__m128i *) (dst_y1 + x), pack_avx2(dot_avx2(r[2], g[2], b[2], matrix->y, matrix->y[3], 16), dot_avx2(r[3], g[3], b[3], matrix->y, matrix->y[3], 16)));
+
+      // Sums of each 2x2 block, for chroma samples in the order 0 1 4 5 | 2 3 6 7
+      __m256i r_sum = _mm256_hadd_epi32(_mm256_add_epi32(r[0], r[2]), _mm256_add_epi32(r[1], r[3]));
+      __m256i g_sum = _mm256_hadd_epi32(_mm256_add_epi32(g[0], g[2]), _mm256_add_epi32(g[1], g[3]));
+      __m256i b_sum = _mm256_hadd_epi32(_mm256_add_epi32(b[0], b[2]), _mm256_add_epi32(b[1], b[3]));
+
+      // The extra 2 bits of the shift divide the sums by 4
+      __m256i u = dot_avx2(r_sum, g_sum, b_sum, matrix->u, u_offset, 18);
+      __m256i v = dot_avx2(r_sum, g_sum, b_sum, matrix->v, v_offset, 18);
+
+      // Interleave U and V, pack_avx2() puts the pairs back in order across the lanes
+      _mm_storeu_si128((__m128i *) (dst_uv + x), pack_avx2(_mm256_unpacklo_epi32(u, v), _mm256_unpackhi_epi32(u, v)));
+    }
+
+    if (vector_width < width) {
+      convert_luma_row_def(src0 + vector_width * 4, dst_y0 + vector_width, width - vector_width, matrix, 0, 0);
+      convert_luma_row_def(src1 + vector_width * 4, dst_y1 + vector_width, width - vector_width, matrix, 0, 0);
+      convert_chroma_row_def(src0 + vector_width * 4, src1 + vector_width * 4, dst_uv + vector_width, NULL, width - vector_width, matrix, 0, 1, 0);
+    }
+  }
+}
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+
+/**
+ * @brief Apply one row of the matrix to 4 pixels, without clamping.
+ */
+static inline int32x4_t
+dot_neon(uint16x4_t r, uint16x4_t g, uint16x4_t b, const int32_t coefficients[4], int32_t offset) {
+  int32x4_t sum = vdupq_n_s32(offset);
+  sum = vmlaq_n_s32(sum, vreinterpretq_s32_u32(vmovl_u16(r)), coefficients[0]);
+  sum = vmlaq_n_s32(sum, vreinterpretq_s32_u32(vmovl_u16(g)), coefficients[1]);
+  sum = vmlaq_n_s32(sum, vreinterpretq_s32_u32(vmovl_u16(b)), coefficients[2]);
+  return sum;
+}
+
+/**
+ * @brief Narrow two vectors of 4 shifted samples to 8 bytes, saturating to 0-255.
+ */
+static inline uint8x8_t
+narrow_neon(int32x4_t low, int32x4_t high) {
+  return vqmovn_u16(vcombine_u16(vqmovun_s32(low), vqmovun_s32(high)));
+}
+
+/**
+ * @brief Convert 16 pixels of deinterleaved channels to luma.
+ */
+static inline uint8x16_t
+luma_neon(uint8x16x4_t pixels, const bgra_convert_matrix_t *matrix) {
+  uint16x8_t b = vmovl_u8(vget_low_u8(pixels.val[0])), b_high = vmovl_u8(vget_high_u8(pixels.val[0]));
+  uint16x8_t g = vmovl_u8(vget_low_u8(pixels.val[1])), g_high = vmovl_u8(vget_high_u8(pixels.val[1]));
+  uint16x8_t r = vmovl_u8(vget_low_u8(pixels.val[2])), r_high = vmovl_u8(vget_high_u8(pixels.val[2]));
+
+  uint8x8_t low = narrow_neon(
+    vshrq_n_s32(dot_neon(vget_low_u16(r), vget_low_u16(g), vget_low_u16(b), matrix->y, matrix->y[3]), 16),
+    vshrq_n_s32(dot_neon(vget_high_u16(r), vget_high_u16(g), vget_high_u16(b), matrix->y, matrix->y[3]), 16));
+  uint8x8_t high = narrow_neon(
+    vshrq_n_s32(dot_neon(vget_low_u16(r_high), vget_low_u16(g_high), vget_low_u16(b_high), matrix->y, matrix->y[3]), 16),
+    vshrq_n_s32(dot_neon(vget_high_u16(r_high), vget_high_u16(g_high), vget_high_u16(b_high), matrix->y, matrix->y[3]), 16));
+  return vcombine_u8(low, high);
+}
+
+static void
+bgra_to_nv12_neon(const uint8_t *src, int src_stride, int width, int height, uint8_t *const dst[3], const int dst_stride[3], const bgra_convert_matrix_t *matrix) {
+  const int32_t u_offset = matrix->u[3] * 4, v_offset = matrix->v[3] * 4;
+  const int vector_width = width & ~15;
+
+  for (int y = 0; y < height; y += 2) {
+    const uint8_t *src0 = src + (ptrdiff_t) y * src_stride;
+    const uint8_t *src1 = src0 + src_stride;
+    uint8_t *dst_y0 = dst[0] + (ptrdiff_t) y * dst_stride[0];
+    uint8_t *dst_y1 = dst_y0 + dst_stride[0];
+    uint8_t *dst_uv = dst[1] + (ptrdiff_t) (y / 2) * dst_stride[1];
+
+    for (int x = 0; x < vector_width; x += 16) {
+      // Loading deinterleaves the B, G, R and X channels
+      uint8x16x4_t pixels0 = vld4q_u8(src0 + x * 4);
+      uint8x16x4_t pixels1 = vld4q_u8(src1 + x * 4);
+
+      vst1q_u8(dst_y0 + x, luma_neon(pixels0, matrix));
+      vst1q_u8(dst_y1 + x, luma_neon(pixels1, matrix));
+
+      // Sums of each 2x2 block, the extra 2 bits of the shift divide them by 4
+      uint16x8_t b = vpadalq_u8(vpaddlq_u8(pixels0.val[0]), pixels1.val[0]);
+      uint16x8_t g = vpadalq_u8(vpaddlq_u8(pixels0.val[1]), pixels1.val[1]);
+      uint16x8_t r = vpadalq_u8(vpaddlq_u8(pixels0.val[2]), pixels1.val[2]);
+
+      uint8x8x2_t uv;
+      uv.val[0] = narrow_neon(
+        vshrq_n_s32(dot_neon(vget_low_u16(r), vget_low_u16(g), vget_low_u16(b), matrix->u, u_offset), 18),
+        vshrq_n_s32(dot_neon(vget_high_u16(r), vget_high_u16(g), vget_high_u16(b), matrix->u, u_offset), 18));
+      uv.val[1] = narrow_neon(
+        vshrq_n_s32(dot_neon(vget_low_u16(r), vget_low_u16(g), vget_low_u16(b), matrix->v, v_offset), 18),
+        vshrq_n_s32(dot_neon(vget_high_u16(r), vget_high_u16(g), vget_high_u16(b), matrix->v, v_offset), 18));
+
+      // Storing interleaves U and V
+      vst2_u8(dst_uv + x, uv);
+    }
+
+    if (vector_width < width) {
+      convert_luma_row_def(src0 + vector_width * 4, dst_y0 + vector_width, width - vector_width, matrix, 0, 0);
+      convert_luma_row_def(src1 + vector_width * 4, dst_y1 + vector_width, width - vector_width, matrix, 0, 0);
+      convert_chroma_row_def(src0 + vector_width * 4, src1 + vector_width * 4, dst_uv + vector_width, NULL, width - vector_width, matrix, 0, 1, 0);
+    }
+  }
+}
+#endif
+
+bgra_convert_t bgra_to_nv12_fn;
+bgra_convert_t bgra_to_p010_fn;
+bgra_convert_t bgra_to_yuv420p_fn;
+bgra_convert_t bgra_to_yuv420p10_fn;
+
+const char *bgra_convert_isa;
+
+void
+bgra_convert_matrix_init(bgra_convert_matrix_t *matrix, const float color_vec_y[4], const float color_vec_u[4], const float color_vec_v[4], int bit_depth) {
+  // RGB coefficients are scaled for 8-bit input instead of the 0.0 to 1.0 range
+  for (int x = 0; x < 3; ++x) {
+    matrix->y[x] = (int32_t) lround(color_vec_y[x] / 255.0 * 65536.0);
+    matrix->u[x] = (int32_t) lround(color_vec_u[x] / 255.0 * 65536.0);
+    matrix->v[x] = (int32_t) lround(color_vec_v[x] / 255.0 * 65536.0);
+  }
+  matrix->y[3] = (int32_t) lround(color_vec_y[3] * 65536.0);
+  matrix->u[3] = (int32_t) lround(color_vec_u[3] * 65536.0);
+  matrix->v[3] = (int32_t) lround(color_vec_v[3] * 65536.0);
+  matrix->max = (1 << bit_depth) - 1;
+}
+
+int
+bgra_convert_init_isa(const char *isa) {
+#if defined(__x86_64) || defined(__x86_64__) || defined(__amd64) || defined(__amd64__) || defined(_M_AMD64)
+  if (!strcmp(isa, "avx512")) {
+    if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw")) {
+      return -1;
+    }
+
+    // The hand-written AVX2 kernel beats the compiler-vectorized AVX-512 one
+    bgra_to_nv12_fn = bgra_to_nv12_avx2_intrin;
+    bgra_to_p010_fn = bgra_to_p010_avx512;
+    bgra_to_yuv420p_fn = bgra_to_yuv420p_avx512;
+    bgra_to_yuv420p10_fn = bgra_to_yuv420p10_avx512;
+    bgra_convert_isa = "avx512";
+    return 0;
+  }
+  if (!strcmp(isa, "avx2")) {
+    if (!__builtin_cpu_supports("avx2")) {
+      return -1;
+    }
+
+    bgra_to_nv12_fn = bgra_to_nv12_avx2_intrin;
+    bgra_to_p010_fn = bgra_to_p010_avx2;
+    bgra_to_yuv420p_fn = bgra_to_yuv420p_avx2;
+    bgra_to_yuv420p10_fn = bgra_to_yuv420p10_avx2;
+    bgra_convert_isa = "avx2";
+    return 0;
+  }
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+  if (!strcmp(isa, "neon")) {
+    // NEON is always available on ARM64, the default kernels cover the other formats
+    bgra_to_nv12_fn = bgra_to_nv12_neon;
+    bgra_to_p010_fn = bgra_to_p010_def;
+    bgra_to_yuv420p_fn = bgra_to_yuv420p_def;
+    bgra_to_yuv420p10_fn = bgra_to_yuv420p10_def;
+    bgra_convert_isa = "neon";
+    return 0;
+  }
+#endif
+  if (!strcmp(isa, "default")) {
+    bgra_to_nv12_fn = bgra_to_nv12_def;
+    bgra_to_p010_fn = bgra_to_p010_def;
+    bgra_to_yuv420p_fn = bgra_to_yuv420p_def;
+    bgra_to_yuv420p10_fn = bgra_to_yuv420p10_def;
+    bgra_convert_isa = "default";
+    return 0;
+  }
+
+  return -1;
+}
+
+/**
+ * @brief This initializes the conversion function pointers to the best vectorized version available.
+ * @details The software encode path will directly invoke these function pointers for each frame.
+ */
+void
+bgra_convert_init(void) {
+  // "neon" is left out until BgraConvertIsaTest has passed on ARM64 hardware
+  const char *isas[] = { "avx512", "avx2", "default" };
+  for (size_t x = 0; x < sizeof(isas) / sizeof(isas[0]); ++x) {
+    if (!bgra_convert_init_isa(isas[x])) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * @file src/bgra_convert.h
+ * @brief Vectorized BGRA to YUV 4:2:0 conversion for the software encode path
+ * @details The conversion functions are picked at runtime for the best instruction set available.
+ */
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Fixed point RGB to YUV matrix for 8-bit BGRA input.
+ * @details Each row holds the R, G and B coefficients followed by the offset, scaled by 2^16.
+ *          The offset includes rounding, so results are truncated after the shift.
+ */
+typedef struct {
+  int32_t y[4];
+  int32_t u[4];
+  int32_t v[4];
+  int32_t max;  ///< Largest value of the output bit depth
+} bgra_convert_matrix_t;
+
+/**
+ * @brief Convert a BGRA/BGR0 image to a YUV 4:2:0 frame.
+ * @param src First row of the source image.
+ * @param src_stride Bytes between source rows.
+ * @param width Width of the image, must be even.
+ * @param height Height of the image, must be even.
+ * @param dst Luma and chroma planes. Semi-planar formats only use the first two.
+ * @param dst_stride Bytes between rows of each plane.
+ * @param matrix Conversion matrix.
+ */
+typedef void (*bgra_convert_t)(const uint8_t *src, int src_stride, int width, int height, uint8_t *const dst[3], const int dst_stride[3], const bgra_convert_matrix_t *matrix);
+
+extern bgra_convert_t bgra_to_nv12_fn;
+extern bgra_convert_t bgra_to_p010_fn;
+extern bgra_convert_t bgra_to_yuv420p_fn;
+extern bgra_convert_t bgra_to_yuv420p10_fn;
+
+/**
+ * @brief Name of the instruction set the conversion functions were picked for.
+ */
+extern const char *bgra_convert_isa;
+
+/**
+ * @brief Build the fixed point matrix from floating point color vectors.
+ * @param matrix The matrix to fill.
+ * @param color_vec_y RGB coefficients and offset of luma, for RGB in the 0.0 to 1.0 range.
+ * @param color_vec_u RGB coefficients and offset of the blue difference.
+ * @param color_vec_v RGB coefficients and offset of the red difference.
+ * @param bit_depth Bit depth of the output, 8 or 10.
+ */
+void
+bgra_convert_matrix_init(bgra_convert_matrix_t *matrix, const float color_vec_y[4], const float color_vec_u[4], const float color_vec_v[4], int bit_depth);
+
+/**
+ * @brief Point the conversion functions at the kernels for an instruction set.
+ * @details NV12 has hand-written AVX2 and NEON kernels, the other formats and instruction sets use
+ *          compiler-vectorized ones. Every variant gives the same output as "default".
+ *          bgra_convert_init() doesn't pick "neon" yet, it has to be selected here.
+ * @param isa "avx512", "avx2", "neon" or "default".
+ * @return 0 on success, -1 if this CPU or build doesn't support the instruction set.
+ */
+int
+bgra_convert_init_isa(const char *isa);
+
+/**
+ * @brief This initializes the conversion function pointers to the best vectorized version available.
+ */
+void
+bgra_convert_init(void);
@@ -0,0 +1,111 @@
+/**
+ * @file src/bgra_convert_kernels.h
+ * @brief BGRA to YUV 4:2:0 conversion kernels
+ * @details This file is included once per instruction set by src/bgra_convert.c, with ISA_SUFFIX
+ *          appended to every function name. The loops are written so the compiler can vectorize
+ *          them for the instruction set of each pass.
+ */
+
+static inline __attribute__((always_inline)) int32_t
+clamp_sample(int32_t value, int32_t max) {
+  return value < 0 ? 0 : value > max ? max : value;
+}
+
+/**
+ * @brief Convert one row of BGRA pixels to luma.
+ * @param wide Write 16-bit samples instead of 8-bit ones.
+ * @param shift Left shift of 16-bit samples, for MSB aligned formats like P010.
+ */
+static inline __attribute__((always_inline)) void
+convert_luma_row(const uint8_t *restrict src, uint8_t *restrict dst, int width, const bgra_convert_matrix_t *restrict matrix, int wide, int shift) {
+  const int32_t cr = matrix->y[0], cg = matrix->y[1], cb = matrix->y[2], offset = matrix->y[3], max = matrix->max;
+
+  if (wide) {
+    uint16_t *restrict out = (uint16_t *) dst;
+    for (int x = 0; x < width; ++x) {
+      int32_t b = src[x * 4 + 0], g = src[x * 4 + 1], r = src[x * 4 + 2];
+      out[x] = (uint16_t) (clamp_sample((r * cr + g * cg + b * cb + offset) >> 16, max) << shift);
+    }
+  }
+  else {
+    for (int x = 0; x < width; ++x) {
+      int32_t b = src[x * 4 + 0], g = src[x * 4 + 1], r = src[x * 4 + 2];
+      dst[x] = (uint8_t) clamp_sample((r * cr + g * cg + b * cb + offset) >> 16, max);
+    }
+  }
+}
+
+/**
+ * @brief Convert two rows of BGRA pixels to one row of chroma, averaging each 2x2 block.
+ * @param dst_u Blue difference plane, or the interleaved chroma plane.
+ * @param dst_v Red difference plane, unused when interleaved.
+ * @param interleaved Write UV pairs into a single plane, as in NV12 and P010.
+ */
+static inline __attribute__((always_inline)) void
+convert_chroma_row(const uint8_t *restrict src0, const uint8_t *restrict src1, uint8_t *restrict dst_u, uint8_t *restrict dst_v, int width, const bgra_convert_matrix_t *restrict matrix, int wide, int interleaved, int shift) {
+  const int32_t ur = matrix->u[0], ug = matrix->u[1], ub = matrix->u[2], u_offset = matrix->u[3] * 4;
+  const int32_t vr = matrix->v[0], vg = matrix->v[1], vb = matrix->v[2], v_offset = matrix->v[3] * 4;
+  const int32_t max = matrix->max;
+
+  for (int x = 0; x < width / 2; ++x) {
+    // Sums of the 2x2 block, the extra 2 bits of the shift divide them by 4
+    int32_t b = src0[x * 8 + 0] + src0[x * 8 + 4] + src1[x * 8 + 0] + src1[x * 8 + 4];
+    int32_t g = src0[x * 8 + 1] + src0[x * 8 + 5] + src1[x * 8 + 1] + src1[x * 8 + 5];
+    int32_t r = src0[x * 8 + 2] + src0[x * 8 + 6] + src1[x * 8 + 2] + src1[x * 8 + 6];
+
+    int32_t u = clamp_sample((r * ur + g * ug + b * ub + u_offset) >> 18, max);
+    int32_t v = clamp_sample((r * vr + g * vg + b * vb + v_offset) >> 18, max);
+
+    if (wide && interleaved) {
+      ((uint16_t *) dst_u)[x * 2 + 0] = (uint16_t) (u << shift);
+      ((uint16_t *) dst_u)[x * 2 + 1] = (uint16_t) (v << shift);
+    }
+    else if (wide) {
+      ((uint16_t *) dst_u)[x] = (uint16_t) (u << shift);
+      ((uint16_t *) dst_v)[x] = (uint16_t) (v << shift);
+    }
+    else if (interleaved) {
+      dst_u[x * 2 + 0] = (uint8_t) u;
+      dst_u[x * 2 + 1] = (uint8_t) v;
+    }
+    else {
+      dst_u[x] = (uint8_t) u;
+      dst_v[x] = (uint8_t) v;
+    }
+  }
+}
+
+static inline __attribute__((always_inline)) void
+convert_frame(const uint8_t *src, int src_stride, int width, int height, uint8_t *const dst[3], const int dst_stride[3], const bgra_convert_matrix_t *matrix, int wide, int interleaved, int shift) {
+  for (int y = 0; y < height; y += 2) {
+    const uint8_t *src0 = src + (ptrdiff_t) y * src_stride;
+    const uint8_t *src1 = src0 + src_stride;
+
+    convert_luma_row(src0, dst[0] + (ptrdiff_t) y * dst_stride[0], width, matrix, wide, shift);
+    convert_luma_row(src1, dst[0] + (ptrdiff_t) (y + 1) * dst_stride[0], width, matrix, wide, shift);
+
+    uint8_t *dst_u = dst[1] + (ptrdiff_t) (y / 2) * dst_stride[1];
+    uint8_t *dst_v = interleaved ? NULL : dst[2] + (ptrdiff_t) (y / 2) * dst_stride[2];
+    convert_chroma_row(src0, src1, dst_u, dst_v, width, matrix, wide, interleaved, shift);
+  }
+}
+
+void
+bgra_to_nv12(const uint8_t *src, int src_stride, int width, int height, uint8_t *const dst[3], const int dst_stride[3], const bgra_convert_matrix_t *matrix) {
+  convert_frame(src, src_stride, width, height, dst, dst_stride, matrix, 0, 1, 0);
+}
+
+void
+bgra_to_p010(const uint8_t *src, int src_stride, int width, int height, uint8_t *const dst[3], const int dst_stride[3], const bgra_convert_matrix_t *matrix) {
+  convert_frame(src, src_stride, width, height, dst, dst_stride, matrix, 1, 1, 6);
+}
+
+void
+bgra_to_yuv420p(const uint8_t *src, int src_stride, int width, int height, uint8_t *const dst[3], const int dst_stride[3], const bgra_convert_matrix_t *matrix) {
+  convert_frame(src, src_stride, width, height, dst, dst_stride, matrix, 0, 0, 0);
+}
+
+void
+bgra_to_yuv420p10(const uint8_t *src, int src_stride, int width, int height, uint8_t *const dst[3], const int dst_stride[3], const bgra_convert_matrix_t *matrix) {
+  convert_frame(src, src_stride, width, height, dst, dst_stride, matrix, 1, 0, 0);
+}
@@ -462,6 +462,10 @@ namespace config {
     "balanced"s,  // downscaling_quality (default: bicubic for best quality/performance balance)
     false,  // hdr_luminance_analysis (disabled by default to avoid GPU overhead)
     false,  // wgc_disable_secure_desktop (disabled by default for security)
+    false,  // shared_encoding
+    0,  // encoder_pool_size
+    true,  // encoder_probe_cache
+    false,  // frame_pacing
   };
 
   audio_t audio {
@@ -470,6 +474,11 @@ namespace config {
     true,  // stream audio
     true,  // stream_mic (enable microphone streaming from client)
     true,  // install_steam_drivers
+    false,  // shared_capture
+    true,  // pipewire_capture
+    0,  // pipewire_quantum
+    false,  // drift_compensation
+    100,  // latency_budget
   };
 
   stream_t stream {
@@ -478,6 +487,13 @@ namespace config {
     APPS_JSON_PATH,
 
     20,  // fecPercentage
+    0,  // fec_threads
+    0,  // video_send_threads
+    0,  // pacing_rate
+    true,  // adaptive_pacing
+    false,  // kernel_pacing
+    false,  // zerocopy_send
+    false,  // adaptive_fec
 
     ENCRYPTION_MODE_NEVER,  // lan_encryption_mode
     ENCRYPTION_MODE_OPPORTUNISTIC,  // wan_encryption_mode
@@ -1239,6 +1255,10 @@ namespace config {
     int_between_f(vars, "minimum_fps_target", video.minimum_fps_target, { 0, 1000 });
     bool_f(vars, "hdr_luminance_analysis", video.hdr_luminance_analysis);
     bool_f(vars, "wgc_disable_secure_desktop", video.wgc_disable_secure_desktop);
+    bool_f(vars, "shared_encoding", video.shared_encoding);
+    int_between_f(vars, "encoder_pool_size", video.encoder_pool_size, { 0, 4 });
+    bool_f(vars, "encoder_probe_cache", video.encoder_probe_cache);
+    bool_f(vars, "frame_pacing", video.frame_pacing);
     bool_f(vars, "vdd_keep_enabled", video.vdd_keep_enabled);
     bool_f(vars, "vdd_headless_create", video.vdd_headless_create_enabled);
     bool_f(vars, "vdd_reuse", video.vdd_reuse);
@@ -1279,6 +1299,11 @@ namespace config {
     bool_f(vars, "stream_audio", audio.stream);
     bool_f(vars, "stream_mic", audio.stream_mic);
     bool_f(vars, "install_steam_audio_drivers", audio.install_steam_drivers);
+    bool_f(vars, "shared_audio_capture", audio.shared_capture);
+    bool_f(vars, "pipewire_capture", audio.pipewire_capture);
+    int_between_f(vars, "pipewire_quantum", audio.pipewire_quantum, { 0, 8192 });
+    bool_f(vars, "audio_drift_compensation", audio.drift_compensation);
+    int_between_f(vars, "audio_latency_budget", audio.latency_budget, { 0, 1000 });
 
     string_restricted_f(vars, "origin_web_ui_allowed", nvhttp.origin_web_ui_allowed, { "pc"sv, "lan"sv, "wan"sv });
 
@@ -1305,6 +1330,13 @@ namespace config {
 #endif
 
     int_between_f(vars, "fec_percentage", stream.fec_percentage, {1, 255});
+    int_between_f(vars, "fec_threads", stream.fec_threads, { 0, 4 });
+    int_between_f(vars, "video_send_threads", stream.video_send_threads, { 0, 16 });
+    int_between_f(vars, "pacing_rate", stream.pacing_rate, { 0, 100000 });
+    bool_f(vars, "adaptive_pacing", stream.adaptive_pacing);
+    bool_f(vars, "kernel_pacing", stream.kernel_pacing);
+    bool_f(vars, "zerocopy_send", stream.zerocopy_send);
+    bool_f(vars, "adaptive_fec", stream.adaptive_fec);
 
     map_int_int_f(vars, "keybindings"s, input.keybindings);
 
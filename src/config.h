@@ -114,6 +114,10 @@ namespace config {
     std::string downscaling_quality;  // Downscaling quality: "fast" (bilinear+8pt), "balanced" (bicubic), "high_quality" (future: lanczos)
     bool hdr_luminance_analysis;  // Enable per-frame HDR luminance analysis for dynamic metadata
     bool wgc_disable_secure_desktop;  // Auto-disable UAC secure desktop when using WGC capture
+    bool shared_encoding;  // Share one encoder between sessions requesting identical video settings
+    int encoder_pool_size;  // Number of encoders kept built ahead of time for new sessions (0 = disabled)
+    bool encoder_probe_cache;  // Reuse the encoder probe results of the last run at startup
+    bool frame_pacing;  // Encode captured frames at a steady cadence matching the stream framerate
   };
 
   struct audio_t {
@@ -122,6 +126,11 @@ namespace config {
     bool stream;
     bool stream_mic;
     bool install_steam_drivers;
+    bool shared_capture;  // Capture and encode audio once for sessions requesting the same audio stream
+    bool pipewire_capture;  // Linux only: capture through a native PipeWire stream when available
+    int pipewire_quantum;  // Samples per channel requested for each PipeWire graph cycle, 0 = one audio packet
+    bool drift_compensation;  // Resample captured audio to follow the steady clock instead of the sound card clock
+    int latency_budget;  // Milliseconds audio may wait after capture before it's dropped, 0 to never drop
   };
 
   constexpr int ENCRYPTION_MODE_NEVER = 0;  // Never use video encryption, even if the client supports it
@@ -135,6 +144,30 @@ namespace config {
 
     int fec_percentage;
 
+    // Number of worker threads used to encode the FEC blocks of a frame in parallel
+    // 0 = encode FEC blocks inline on the video broadcast thread
+    int fec_threads;
+
+    // Number of threads sending video, with each session assigned to one of them
+    // 0 = all sessions are sent from the video broadcast thread
+    int video_send_threads;
+
+    // Rate at which video packets are paced in Mbps
+    // 0 = derive it from the link speed and the session bitrate
+    int pacing_rate;
+
+    // Lower the pacing rate while the client reports packet loss
+    bool adaptive_pacing;
+
+    // Let the kernel pace video packets by their departure times (Linux SO_TXTIME with the fq qdisc)
+    bool kernel_pacing;
+
+    // Send video packets straight from the frame buffers with MSG_ZEROCOPY (Linux)
+    bool zerocopy_send;
+
+    // Lower FEC below fec_percentage on clean links and give key frames more parity
+    bool adaptive_fec;
+
     // Video encryption settings for LAN and WAN streams
     int lan_encryption_mode;
     int wan_encryption_mode;
@@ -1659,6 +1659,14 @@ namespace confighttp {
         session_obj["height"] = session_info.height;
         session_obj["fps"] = session_info.fps;
         session_obj["bitrate"] = session_info.bitrate;
+        session_obj["pacing_rate"] = session_info.pacing_rate;
+        session_obj["frame_drain_time"] = session_info.frame_drain_time;
+        session_obj["fec_percentage"] = session_info.fec_percentage;
+        session_obj["time_to_first_idr"] = session_info.time_to_first_idr;
+        session_obj["frame_interval"] = session_info.frame_interval;
+        session_obj["frame_interval_stddev"] = session_info.frame_interval_stddev;
+        session_obj["audio_latency"] = session_info.audio_latency;
+        session_obj["audio_late_packets"] = session_info.audio_late_packets;
         session_obj["host_audio"] = session_info.host_audio;
         session_obj["enable_hdr"] = session_info.enable_hdr;
         session_obj["enable_mic"] = session_info.enable_mic;
@@ -274,6 +274,46 @@ namespace crypto {
       return encrypt(plaintext, tagged_cipher, tagged_cipher + tag_size, iv);
     }
 
+    std::size_t
+    gcm_t::encrypt(std::span<const gcm_buffer_t> buffers) {
+      constexpr std::size_t iv_size = 12;
+
+      if (!encrypt_ctx) {
+        aes_t iv(iv_size);
+        if (init_encrypt_gcm(encrypt_ctx, &key, &iv, padding)) {
+          return 0;
+        }
+      }
+
+      // The context may have been used with another IV length by the single buffer overloads
+      if (EVP_CIPHER_CTX_ctrl(encrypt_ctx.get(), EVP_CTRL_GCM_SET_IVLEN, iv_size, nullptr) != 1) {
+        return 0;
+      }
+
+      for (std::size_t x = 0; x < buffers.size(); ++x) {
+        auto &buffer = buffers[x];
+
+        if (EVP_EncryptInit_ex(encrypt_ctx.get(), nullptr, nullptr, nullptr, buffer.iv) != 1) {
+          return x;
+        }
+
+        int update_outlen, final_outlen;
+        if (EVP_EncryptUpdate(encrypt_ctx.get(), buffer.ciphertext, &update_outlen, (const std::uint8_t *) buffer.plaintext.data(), buffer.plaintext.size()) != 1) {
+          return x;
+        }
+
+        if (EVP_EncryptFinal_ex(encrypt_ctx.get(), buffer.ciphertext + update_outlen, &final_outlen) != 1) {
+          return x;
+        }
+
+        if (EVP_CIPHER_CTX_ctrl(encrypt_ctx.get(), EVP_CTRL_GCM_GET_TAG, tag_size, buffer.tag) != 1) {
+          return x;
+        }
+      }
+
+      return buffers.size();
+    }
+
     int
     ecb_t::decrypt(const std::string_view &cipher, std::vector<std::uint8_t> &plaintext) {
       auto fg = util::fail_guard([this]() {
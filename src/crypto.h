@@ -5,6 +5,7 @@
 #pragma once
 
 #include <array>
+#include <span>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
@@ -124,6 +125,20 @@ namespace crypto {
       decrypt(const std::string_view &cipher, std::vector<std::uint8_t> &plaintext);
     };
 
+    /**
+     * @brief One buffer of a batched AES GCM encryption.
+     */
+    struct gcm_buffer_t {
+      std::string_view plaintext;
+
+      // Where the GCM tag and the ciphertext are written. The ciphertext may overwrite the plaintext.
+      std::uint8_t *tag;
+      std::uint8_t *ciphertext;
+
+      // The 12-byte initialization vector of this buffer
+      const std::uint8_t *iv;
+    };
+
     class gcm_t: public cipher_t {
     public:
       gcm_t() = default;
@@ -155,6 +170,16 @@ namespace crypto {
       int
       encrypt(const std::string_view &plaintext, std::uint8_t *tagged_cipher, aes_t *iv);
 
+      /**
+       * @brief Encrypts several buffers using AES GCM mode, each with its own 12-byte IV.
+       * @details The cipher context and key schedule are set up once for the whole batch,
+       *          so only the IV changes between buffers.
+       * @param buffers The buffers to encrypt.
+       * @return The number of buffers encrypted, which is less than `buffers.size()` in case of an error.
+       */
+      std::size_t
+      encrypt(std::span<const gcm_buffer_t> buffers);
+
       int
       decrypt(const std::string_view &cipher, std::vector<std::uint8_t> &plaintext, aes_t *iv);
     };
@@ -0,0 +1,80 @@
+/**
+ * @file src/fec.h
+ * @brief Declarations for the FEC block layout of video frames.
+ */
+#pragma once
+
+// standard includes
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+extern "C" {
+#include "rswrapper.h"
+}
+
+namespace stream::fec {
+  /**
+   * @brief Shard layout of a single FEC block.
+   */
+  struct geometry_t {
+    size_t data_shards;
+    size_t parity_shards;
+    size_t percentage;
+
+    size_t
+    nr_shards() const {
+      return data_shards + parity_shards;
+    }
+  };
+
+  /**
+   * @brief Compute the shard layout of a FEC block without encoding it.
+   * @param payload_size The size of the block payload in bytes.
+   * @param blocksize The size of each shard.
+   * @param fecpercentage The requested FEC percentage.
+   * @param minparityshards The minimum number of parity shards requested by the client.
+   * @return The number of data and parity shards and the effective FEC percentage.
+   */
+  geometry_t
+  compute_geometry(size_t payload_size, size_t blocksize, size_t fecpercentage, size_t minparityshards);
+
+  /**
+   * @brief Get a shared codec for the given shard geometry, creating it on first use.
+   * @param data_shards The number of data shards.
+   * @param parity_shards The number of parity shards.
+   * @return The codec, or `nullptr` if it couldn't be created.
+   */
+  reed_solomon *
+  get_rs(size_t data_shards, size_t parity_shards);
+
+  /**
+   * @brief Build the codecs for every FEC block geometry possible at a given FEC percentage.
+   * @details Frames of any size are split into blocks of at most `(255 * 100) / (100 + F)` data
+   *          shards, so this covers all blocks a session will encode unless the client asks
+   *          for a different FEC percentage later.
+   * @param fecpercentage The FEC percentage of the session.
+   * @param minparityshards The minimum number of parity shards requested by the client.
+   * @return The number of codecs in the cache.
+   */
+  size_t
+  warm_rs_cache(size_t fecpercentage, size_t minparityshards);
+
+  /**
+   * @brief Point the data shards of a FEC block into the frame without copying it.
+   * @details The frame is @p frame_header followed by @p payload, cut into shards of @p blocksize
+   *          bytes. Shards that lie entirely within the payload point straight into it. The shard
+   *          straddling the frame header and a trailing partial shard are assembled in @p scratch
+   *          instead, with the partial shard zero-padded.
+   * @param frame_header The bytes sent in front of the payload, if any.
+   * @param payload The frame payload.
+   * @param first_shard The index of the first shard of the block within the frame.
+   * @param data_shards The number of data shards in the block.
+   * @param blocksize The size of each shard.
+   * @param scratch Space for at least 2 shards.
+   * @param shards_p Receives a pointer to each data shard.
+   * @return The number of shards assembled in @p scratch.
+   */
+  size_t
+  gather_shards(const std::string_view &frame_header, const std::string_view &payload, size_t first_shard, size_t data_shards, size_t blocksize, char *scratch, uint8_t **shards_p);
+}  // namespace stream::fec
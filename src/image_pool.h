@@ -0,0 +1,264 @@
+/**
+ * @file src/image_pool.h
+ * @brief Declarations for a fixed-capacity pool of reusable capture images and buffers.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace image_pool {
+  /**
+   * @brief Counters of a pool, which may be read from any thread.
+   */
+  struct stats_t {
+    std::size_t capacity;  ///< Maximum number of buffers.
+    std::size_t allocated;  ///< Buffers currently allocated.
+    std::size_t in_use;  ///< Buffers currently handed out.
+    std::uint64_t trimmed;  ///< Buffers freed by trim() so far.
+    std::uint64_t exhausted;  ///< Calls to acquire() that found every buffer in use.
+  };
+
+  /**
+   * @brief A fixed-capacity pool of buffers that are handed out as `std::shared_ptr`.
+   * @details Buffers are allocated on demand and recycled through a lock-free free list. The
+   *          reference count of a handed out buffer lives in storage preallocated with its slot,
+   *          so acquiring and releasing a buffer doesn't allocate memory. The last reference to
+   *          a buffer returns it to the pool from whichever thread drops it, and keeps the pool
+   *          alive until then.
+   *
+   *          acquire() and trim() must be called from a single thread, the capture thread.
+   * @tparam T The buffer type.
+   */
+  template <class T>
+  class pool_t: public std::enable_shared_from_this<pool_t<T>> {
+    /**
+     * @brief Size of the storage for the `std::shared_ptr` control block of a handed out buffer.
+     */
+    static constexpr std::size_t lease_storage_size = 128;
+
+    struct slot_t {
+      alignas(std::max_align_t) std::byte lease_storage[lease_storage_size];
+      std::shared_ptr<T> value;
+
+      /**
+       * @brief Index + 1 of the next free slot, or 0 for the end of the free list.
+       */
+      std::atomic<std::uint32_t> next;
+    };
+
+    /**
+     * @brief Allocates the control block of a handed out buffer in its slot.
+     * @details Deallocation is the very last access to the control block, so this is where the
+     *          slot goes back to the free list.
+     */
+    template <class U>
+    struct lease_allocator_t {
+      using value_type = U;
+
+      lease_allocator_t(std::shared_ptr<pool_t> pool, slot_t *slot):
+          pool { std::move(pool) }, slot { slot } {}
+
+      template <class V>
+      lease_allocator_t(const lease_allocator_t<V> &other):
+          pool { other.pool }, slot { other.slot } {}
+
+      U *
+      allocate(std::size_t n) {
+        static_assert(sizeof(U) <= lease_storage_size && alignof(U) <= alignof(std::max_align_t), "lease_storage_size is too small");
+        return reinterpret_cast<U *>(slot->lease_storage);
+      }
+
+      void
+      deallocate(U *, std::size_t) {
+        pool->release(slot);
+      }
+
+      template <class V>
+      bool
+      operator==(const lease_allocator_t<V> &other) const {
+        return slot == other.slot;
+      }
+
+      std::shared_ptr<pool_t> pool;
+      slot_t *slot;
+    };
+
+  public:
+    explicit pool_t(std::size_t capacity):
+        slots(capacity), used_timestamps(capacity + 1) {
+      unallocated.reserve(capacity);
+      free_scratch.reserve(capacity);
+      for (auto it = slots.rbegin(); it != slots.rend(); ++it) {
+        unallocated.emplace_back(&*it);
+      }
+    }
+
+    pool_t(const pool_t &) = delete;
+    pool_t &
+    operator=(const pool_t &) = delete;
+
+    /**
+     * @brief Hand out a buffer, preferring the most recently released one.
+     * @param alloc Allocates a new buffer, it's called when no free buffer is left.
+     * @return The buffer, or `nullptr` if every buffer is in use or the allocation failed.
+     */
+    template <class F>
+    std::shared_ptr<T>
+    acquire(F &&alloc) {
+      auto slot = pop_free();
+      if (!slot && !unallocated.empty()) {
+        auto value = alloc();
+        if (!value) {
+          return nullptr;
+        }
+
+        slot = unallocated.back();
+        unallocated.pop_back();
+        slot->value = std::move(value);
+        allocated_count.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      if (!slot) {
+        exhausted_count.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+
+      in_use_count.fetch_add(1, std::memory_order_relaxed);
+
+      auto lease = std::allocate_shared<char>(lease_allocator_t<char> { this->shared_from_this(), slot });
+      return std::shared_ptr<T> { std::move(lease), slot->value.get() };
+    }
+
+    /**
+     * @brief Free buffers that haven't been needed for a while.
+     * @details Buffers above the most buffers in use at once during the last `timeout` are freed,
+     *          least recently used first.
+     * @return The number of buffers freed.
+     */
+    std::size_t
+    trim(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::duration timeout) {
+      auto in_use = in_use_count.load(std::memory_order_relaxed);
+      auto allocated = allocated_count.load(std::memory_order_relaxed);
+
+      used_timestamps[in_use] = now;
+
+      // Keep enough buffers for the most used at once within the timeout
+      auto trim_target = in_use;
+      for (auto x = in_use; x < used_timestamps.size(); ++x) {
+        if (used_timestamps[x] && now - *used_timestamps[x] < timeout) {
+          trim_target = x;
+        }
+      }
+
+      if (allocated <= trim_target) {
+        return 0;
+      }
+
+      // Take every free buffer, the most recently released come first
+      while (auto slot = pop_free()) {
+        free_scratch.emplace_back(slot);
+      }
+
+      auto to_trim = std::min(allocated - trim_target, free_scratch.size());
+      for (std::size_t x = 0; x < to_trim; ++x) {
+        auto slot = free_scratch.back();
+        free_scratch.pop_back();
+
+        slot->value.reset();
+        unallocated.emplace_back(slot);
+      }
+
+      // Put the others back in the same order
+      for (auto it = free_scratch.rbegin(); it != free_scratch.rend(); ++it) {
+        push_free(*it);
+      }
+      free_scratch.clear();
+
+      // Forget timestamps that are no longer relevant
+      for (auto x = trim_target + 1; x < used_timestamps.size(); ++x) {
+        used_timestamps[x].reset();
+      }
+
+      allocated_count.fetch_sub(to_trim, std::memory_order_relaxed);
+      trimmed_count.fetch_add(to_trim, std::memory_order_relaxed);
+      return to_trim;
+    }
+
+    stats_t
+    stats() const {
+      return {
+        slots.size(),
+        allocated_count.load(std::memory_order_relaxed),
+        in_use_count.load(std::memory_order_relaxed),
+        trimmed_count.load(std::memory_order_relaxed),
+        exhausted_count.load(std::memory_order_relaxed),
+      };
+    }
+
+  private:
+    void
+    release(slot_t *slot) {
+      in_use_count.fetch_sub(1, std::memory_order_relaxed);
+      push_free(slot);
+    }
+
+    /**
+     * @brief Push a slot on the free list. This is safe from any thread.
+     */
+    void
+    push_free(slot_t *slot) {
+      std::uint64_t index = slot - slots.data() + 1;
+
+      auto head = free_head.load(std::memory_order_relaxed);
+      std::uint64_t new_head;
+      do {
+        slot->next.store((std::uint32_t) head, std::memory_order_relaxed);
+        new_head = ((head >> 32) + 1) << 32 | index;
+      } while (!free_head.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief Pop a slot from the free list.
+     * @details The upper half of the head is a tag incremented on every change, so a head that
+     *          was popped and pushed again in the meantime doesn't match.
+     */
+    slot_t *
+    pop_free() {
+      auto head = free_head.load(std::memory_order_acquire);
+      while ((std::uint32_t) head) {
+        auto slot = &slots[(std::uint32_t) head - 1];
+
+        std::uint64_t new_head = ((head >> 32) + 1) << 32 | slot->next.load(std::memory_order_relaxed);
+        if (free_head.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire)) {
+          return slot;
+        }
+      }
+
+      return nullptr;
+    }
+
+    std::vector<slot_t> slots;
+
+    /**
+     * @brief Tag in the upper half and index + 1 of the first free slot in the lower half.
+     */
+    std::atomic<std::uint64_t> free_head { 0 };
+
+    // Only accessed by acquire() and trim()
+    std::vector<slot_t *> unallocated;
+    std::vector<slot_t *> free_scratch;
+    std::vector<std::optional<std::chrono::steady_clock::time_point>> used_timestamps;
+
+    std::atomic<std::size_t> allocated_count { 0 };
+    std::atomic<std::size_t> in_use_count { 0 };
+    std::atomic<std::uint64_t> trimmed_count { 0 };
+    std::atomic<std::uint64_t> exhausted_count { 0 };
+  };
+}  // namespace image_pool
@@ -29,6 +29,7 @@
 #endif
 
 extern "C" {
+#include "bgra_convert.h"
 #include "rswrapper.h"
 }
 
@@ -353,6 +354,7 @@ main(int argc, char *argv[]) {
   }
 
   reed_solomon_init();
+  bgra_convert_init();
   auto input_deinit_guard = input::init();
 
   if (input::probe_gamepads()) {
@@ -434,6 +436,7 @@ main(int argc, char *argv[]) {
   httpThread.join();
   configThread.join();
   rtspThread.join();
+  video::join_probe_revalidation();
 
   task_pool.stop();
   task_pool.join();
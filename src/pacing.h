@@ -0,0 +1,48 @@
+/**
+ * @file src/pacing.h
+ * @brief Declarations for pacing the packets of video frames.
+ */
+#pragma once
+
+// standard includes
+#include <chrono>
+#include <cstddef>
+
+namespace stream::pacing {
+  /**
+   * @brief Compute the default pacing rate of a session.
+   * @param link_speed The speed of the host interface in Mbps, or 0 if unknown.
+   * @param bitrate The total bitrate of the session (including FEC) in Kbps.
+   * @return The pacing rate in Mbps.
+   */
+  int
+  auto_rate(int link_speed, int bitrate);
+
+  /**
+   * @brief Update the loss scale of a session from a client loss report.
+   * @param scale The current scale in percent.
+   * @param loss_count The number of packets lost since the last report.
+   * @return The new scale in percent.
+   */
+  int
+  adapt_scale(int scale, int loss_count);
+
+  /**
+   * @brief Convert a pacing rate into the number of packets to send per millisecond.
+   * @param rate The pacing rate in Mbps.
+   * @param blocksize The size of each packet.
+   * @return The number of packets per millisecond, at least 1.
+   */
+  size_t
+  packets_in_1ms(int rate, size_t blocksize);
+
+  /**
+   * @brief Compute when a packet of a frame is due to be sent.
+   * @param frame_start The time the first packet of the frame is due.
+   * @param packets_sent The number of packets of the frame sent before this one.
+   * @param packets_in_1ms The number of packets to send per millisecond.
+   * @return The departure time of the packet.
+   */
+  std::chrono::steady_clock::time_point
+  departure_time(std::chrono::steady_clock::time_point frame_start, size_t packets_sent, size_t packets_in_1ms);
+}  // namespace stream::pacing
@@ -6,9 +6,11 @@
 
 // standard includes
 #include <bitset>
+#include <chrono>
 #include <filesystem>
 #include <functional>
 #include <mutex>
+#include <optional>
 #include <string>
 
 // lib includes
@@ -399,6 +401,13 @@ namespace platf {
 
     std::optional<std::chrono::steady_clock::time_point> frame_timestamp;
 
+    /**
+     * @brief Identifies the screen contents held by this image, 0 if the capture backend can't tell.
+     * @details Backends that track damage only advance the serial when the screen changed, so two
+     *          images with the same non-zero serial hold identical pixels.
+     */
+    std::uint64_t content_serial {};
+
     virtual ~img_t() = default;
   };
 
@@ -689,6 +698,14 @@ namespace platf {
   std::string
   get_mac_address(const std::string_view &address);
 
+  /**
+   * @brief Get the speed of the network interface that owns a local address.
+   * @param address The local IP address of the interface.
+   * @return The link speed in Mbps, or 0 if it can't be determined.
+   */
+  int
+  get_link_speed(const std::string_view &address);
+
   std::string
   from_sockaddr(const sockaddr *const);
   std::pair<std::uint16_t, std::string>
@@ -715,6 +732,15 @@ namespace platf {
   std::vector<std::string>
   adapter_names();
 
+  /**
+   * @brief Describe the installed GPUs and their driver versions.
+   * @details The result is only meant to be compared with a previous one, to detect
+   *          hardware or driver changes that invalidate cached encoder probe results.
+   * @return An opaque string, which is empty if the GPUs couldn't be enumerated.
+   */
+  std::string
+  gpu_fingerprint();
+
   /**
    * @brief Check if GPUs/drivers have changed since the last call to this function.
    * @return `true` if a change has occurred or if it is unknown whether a change occurred.
@@ -807,6 +833,39 @@ namespace platf {
     }
   };
 
+  /**
+   * @brief Tracks the zero-copy sends made on a socket.
+   * @details The buffers of a zero-copy send must stay untouched until the kernel reports that it
+   *          no longer needs them. Sends are numbered in the order they are issued, starting at 0.
+   */
+  class zerocopy_t {
+  public:
+    virtual ~zerocopy_t() = default;
+
+    /**
+     * @brief Get the number of zero-copy sends issued so far.
+     * @return The number of sends, which is also the number the next send will get.
+     */
+    virtual std::uint32_t
+    sends() = 0;
+
+    /**
+     * @brief Wait for the kernel to release the buffers of every send before the given one.
+     * @param sends The number of sends that must be complete.
+     * @param timeout How long to wait, or zero to only check.
+     * @return `true` if those sends are complete.
+     */
+    virtual bool
+    wait(std::uint32_t sends, std::chrono::milliseconds timeout) = 0;
+
+    /**
+     * @brief Get the number of completed sends for which the kernel copied the data after all.
+     * @details This happens when the route or the NIC can't transmit straight from user memory.
+     */
+    virtual std::uint64_t
+    copied() = 0;
+  };
+
   struct batched_send_info_t {
     // Optional headers to be prepended to each packet
     const char *headers;
@@ -830,6 +889,28 @@ namespace platf {
     uint16_t target_port;
     boost::asio::ip::address &source_address;
 
+    // Optional departure time of the first message, with each following message departing
+    // send_interval after the previous one. Only honored on sockets with enable_socket_txtime().
+    std::optional<std::chrono::steady_clock::time_point> send_time;
+    std::chrono::nanoseconds send_interval {};
+
+    // Optional tracker from enable_socket_zerocopy(). When set, the buffers are sent without being
+    // copied, and the caller must keep them untouched until the tracker reports the sends complete.
+    zerocopy_t *zerocopy = nullptr;
+
+    // Incremented for every system call made by send_batch()
+    size_t syscalls = 0;
+
+    /**
+     * @brief Returns the departure time of a message in the batch.
+     * @param index The index of the message, relative to block_offset.
+     * @return The departure time of the message.
+     */
+    std::chrono::steady_clock::time_point
+    send_time_for_block(size_t index) const {
+      return *send_time + send_interval * index;
+    }
+
     /**
      * @brief Returns a payload buffer descriptor for the given payload offset.
      * @param offset The offset in the total payload data (bytes).
@@ -870,6 +951,34 @@ namespace platf {
   bool
   send(send_info_t &send_info);
 
+  struct received_datagram_t {
+    size_t size;
+    boost::asio::ip::address address;
+    uint16_t port;
+  };
+
+  struct recv_batch_info_t {
+    std::uintptr_t native_socket;
+
+    // Storage for max_datagrams datagrams of up to buffer_size bytes each, back to back
+    char *buffers;
+    size_t buffer_size;
+
+    // Filled in for each received datagram
+    received_datagram_t *datagrams;
+    size_t max_datagrams;
+  };
+
+  /**
+   * @brief Receive the datagrams already queued on a socket with as few system calls as possible.
+   * @details Never blocks, so it's meant to drain a socket once it's reported readable.
+   * @param recv_info The buffers to receive into.
+   * @return The number of datagrams received, 0 if none were queued,
+   *         or -1 if batched receive isn't supported or failed. Callers then fall back to receiving one datagram at a time.
+   */
+  int
+  recv_batch(recv_batch_info_t &recv_info);
+
   enum class qos_data_type_e : int {
     audio,  ///< Audio
     video  ///< Video
@@ -886,6 +995,25 @@ namespace platf {
   std::unique_ptr<deinit_t>
   enable_socket_qos(uintptr_t native_socket, boost::asio::ip::address &address, uint16_t port, qos_data_type_e data_type, bool dscp_tagging);
 
+  /**
+   * @brief Let the kernel pace packets sent on the given socket.
+   * @details Once enabled, send_batch() attaches the departure times in batched_send_info_t to the
+   *          packets, and the fq queueing discipline holds each packet until then.
+   * @param native_socket The native socket handle.
+   * @return `true` if departure times will be honored, `false` if kernel pacing isn't supported
+   *         or an active interface doesn't use fq.
+   */
+  bool
+  enable_socket_txtime(uintptr_t native_socket);
+
+  /**
+   * @brief Enable zero-copy sends on the given socket.
+   * @param native_socket The native socket handle.
+   * @return A tracker to pass to send_batch(), or `nullptr` if zero-copy sends aren't supported.
+   */
+  std::unique_ptr<zerocopy_t>
+  enable_socket_zerocopy(uintptr_t native_socket);
+
   /**
    * @brief Open a url in the default web browser.
    * @param url The url to open.
@@ -19,6 +19,10 @@
 #include "src/platform/common.h"
 #include "src/thread_safe.h"
 
+#ifdef SUNSHINE_BUILD_PIPEWIRE
+  #include "pipewire.h"
+#endif
+
 namespace platf {
   using namespace std::literals;
 
@@ -501,6 +505,18 @@ namespace platf {
           sink_name = get_default_sink_name();
         }
 
+#ifdef SUNSHINE_BUILD_PIPEWIRE
+        // Capture natively on PipeWire hosts, which skips the PulseAudio compatibility layer
+        if (config::audio.pipewire_capture) {
+          auto quantum = config::audio.pipewire_quantum ? (std::uint32_t) config::audio.pipewire_quantum : frame_size;
+          if (auto mic = pipewire::microphone(mapping, channels, sample_rate, frame_size, quantum, sink_name)) {
+            return mic;
+          }
+
+          BOOST_LOG(info) << "Falling back to PulseAudio capture"sv;
+        }
+#endif
+
         return ::platf::microphone(mapping, channels, sample_rate, frame_size, get_monitor_name(sink_name));
       }
 
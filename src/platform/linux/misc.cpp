@@ -9,8 +9,12 @@
 #endif
 
 // standard includes
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
 
 // lib includes
 #include <arpa/inet.h>
@@ -20,8 +24,13 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
 #include <netinet/udp.h>
 #include <pwd.h>
+#include <sys/utsname.h>
 #include <unistd.h>
 
 // local includes
@@ -241,6 +250,26 @@ namespace platf {
     return "00:00:00:00:00:00"s;
   }
 
+  int
+  get_link_speed(const std::string_view &address) {
+    auto ifaddrs = get_ifaddrs();
+    for (auto pos = ifaddrs.get(); pos != nullptr; pos = pos->ifa_next) {
+      if (pos->ifa_addr && address == from_sockaddr(pos->ifa_addr)) {
+        // Wireless and virtual interfaces report -1 or fail to read
+        std::ifstream speed_file("/sys/class/net/"s + pos->ifa_name + "/speed");
+        int speed = 0;
+        if (speed_file >> speed && speed > 0) {
+          return speed;
+        }
+
+        BOOST_LOG(debug) << "Unable to find link speed of "sv << pos->ifa_name;
+        return 0;
+      }
+    }
+
+    return 0;
+  }
+
   bp::child
   run_command(bool elevated, bool interactive, const std::string &cmd, boost::filesystem::path &working_dir, const bp::environment &env, FILE *file, std::error_code &ec, bp::group *group) {
     // clang-format off
@@ -432,11 +461,146 @@ namespace platf {
     return saddr_v6;
   }
 
+  class zerocopy_impl_t: public zerocopy_t {
+  public:
+    explicit zerocopy_impl_t(int sockfd):
+        _sockfd { sockfd } {}
+
+    std::uint32_t
+    sends() override {
+      return _sends;
+    }
+
+    bool
+    wait(std::uint32_t sends, std::chrono::milliseconds timeout) override {
+      auto deadline = std::chrono::steady_clock::now() + timeout;
+
+      while (true) {
+        reap();
+
+        // Serial number arithmetic, so the comparison survives the send counter wrapping around
+        if ((std::int32_t) (_completed - sends) >= 0) {
+          return true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+          return false;
+        }
+
+        // Completions are queued on the error queue, which poll() always reports as POLLERR
+        struct pollfd pfd = {};
+        pfd.fd = _sockfd;
+        poll(&pfd, 1, std::max<int>(1, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()));
+      }
+    }
+
+    std::uint64_t
+    copied() override {
+      return _copied;
+    }
+
+    /**
+     * @brief Record sends made with MSG_ZEROCOPY.
+     * @param count The number of messages sent.
+     */
+    void
+    sent(std::uint32_t count) {
+      _sends += count;
+    }
+
+    /**
+     * @brief Collect all pending completion notifications without blocking.
+     */
+    void
+    reap() {
+      while (true) {
+        union {
+          char buf[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+          struct cmsghdr alignment;
+        } cmbuf;
+
+        struct msghdr msg = {};
+        msg.msg_control = cmbuf.buf;
+        msg.msg_controllen = sizeof(cmbuf.buf);
+
+        if (recvmsg(_sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+          return;
+        }
+
+        for (auto cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+          if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+              !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+            continue;
+          }
+
+          auto err = (struct sock_extended_err *) CMSG_DATA(cm);
+          if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+            continue;
+          }
+
+          // Each notification covers the inclusive range of sends [ee_info, ee_data]
+          if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+            _copied += err->ee_data - err->ee_info + 1;
+          }
+          _ranges[err->ee_info] = err->ee_data;
+        }
+
+        // Advance past every range that continues the completed sends
+        for (auto it = _ranges.find(_completed); it != std::end(_ranges); it = _ranges.find(_completed)) {
+          _completed = it->second + 1;
+          _ranges.erase(it);
+        }
+      }
+    }
+
+  private:
+    int _sockfd;
+
+    std::uint32_t _sends = 0;
+    std::uint32_t _completed = 0;
+    std::uint64_t _copied = 0;
+
+    // Completed ranges that arrived ahead of an earlier send, keyed by their first send
+    std::map<std::uint32_t, std::uint32_t> _ranges;
+  };
+
+#ifdef SO_TXTIME
+  /**
+   * @brief Append an SCM_TXTIME control message with the given departure time.
+   * @param control The control message buffer.
+   * @param controllen The length of the control messages already in the buffer.
+   * @param send_time The departure time of the message.
+   * @return The length of the control messages including the new one.
+   */
+  static socklen_t
+  append_txtime(char *control, socklen_t controllen, std::chrono::steady_clock::time_point send_time) {
+    // steady_clock is CLOCK_MONOTONIC, which is the clock fq expects departure times in
+    std::uint64_t txtime = std::chrono::duration_cast<std::chrono::nanoseconds>(send_time.time_since_epoch()).count();
+
+    auto cm = (struct cmsghdr *) (control + controllen);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(txtime));
+    memcpy(CMSG_DATA(cm), &txtime, sizeof(txtime));
+
+    return controllen + CMSG_SPACE(sizeof(txtime));
+  }
+#endif
+
   bool
   send_batch(batched_send_info_t &send_info) {
     auto sockfd = (int) send_info.native_socket;
     struct msghdr msg = {};
 
+    auto zerocopy = (zerocopy_impl_t *) send_info.zerocopy;
+    int send_flags = 0;
+#ifdef MSG_ZEROCOPY
+    if (zerocopy) {
+      send_flags |= MSG_ZEROCOPY;
+    }
+#endif
+
     // Convert the target address into a sockaddr
     struct sockaddr_in taddr_v4 = {};
     struct sockaddr_in6 taddr_v6 = {};
@@ -454,7 +618,7 @@ namespace platf {
     }
 
     union {
-      char buf[CMSG_SPACE(sizeof(uint16_t)) +
+      char buf[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(uint64_t)) +
                std::max(CMSG_SPACE(sizeof(struct in_pktinfo)), CMSG_SPACE(sizeof(struct in6_pktinfo)))];
       struct cmsghdr alignment;
     } cmbuf = {};  // Must be zeroed for CMSG_NXTHDR()
@@ -464,7 +628,7 @@ namespace platf {
     msg.msg_controllen = sizeof(cmbuf.buf);
 
     // The PKTINFO option will always be first, then we will conditionally
-    // append the UDP_SEGMENT option next if applicable.
+    // append the UDP_SEGMENT and SCM_TXTIME options next if applicable.
     auto pktinfo_cm = CMSG_FIRSTHDR(&msg);
     if (send_info.source_address.is_v6()) {
       struct in6_pktinfo pktInfo;
@@ -498,7 +662,8 @@ namespace platf {
     auto const max_iovs_per_msg = send_info.payload_buffers.size() + (send_info.headers ? 1 : 0);
 
 #ifdef UDP_SEGMENT
-    {
+    // Segments of a GSO send leave together, so paced batches use sendmmsg() with a departure time per packet
+    if (!send_info.send_time) {
       // UDP GSO on Linux currently only supports sending 64K or 64 segments at a time
       size_t seg_index = 0;
       const size_t seg_max = 65536 / 1500;
@@ -553,15 +718,22 @@ namespace platf {
         // This will fail if GSO is not available, so we will fall back to non-GSO if
         // it's the first sendmsg() call. On subsequent calls, we will treat errors as
         // actual failures and return to the caller.
-        auto bytes_sent = sendmsg(sockfd, &msg, 0);
+        auto bytes_sent = sendmsg(sockfd, &msg, send_flags);
+        send_info.syscalls++;
         if (bytes_sent < 0) {
           // If there's no send buffer space, wait for some to be available
           if (errno == EAGAIN) {
+            // Buffers of zero-copy sends are only released once their completions are collected
+            if (zerocopy) {
+              zerocopy->reap();
+            }
+
             struct pollfd pfd;
 
             pfd.fd = sockfd;
             pfd.events = POLLOUT;
 
+            send_info.syscalls++;
             if (poll(&pfd, 1, -1) != 1) {
               BOOST_LOG(warning) << "poll() failed: "sv << errno;
               break;
@@ -571,10 +743,21 @@ namespace platf {
             continue;
           }
 
+          // The kernel ran out of memory to pin our buffers, so copy them this time
+          if (errno == ENOBUFS && send_flags) {
+            BOOST_LOG(verbose) << "Zero-copy send not possible, falling back to copying"sv;
+            send_flags = 0;
+            continue;
+          }
+
           BOOST_LOG(verbose) << "sendmsg() failed: "sv << errno;
           break;
         }
 
+        if (send_flags) {
+          zerocopy->sent(1);
+        }
+
         seg_index += bytes_sent / msg_size;
       }
 
@@ -589,6 +772,12 @@ namespace platf {
       // If GSO is not supported, use sendmmsg() instead.
       struct mmsghdr msgs[send_info.block_count] = {};
       struct iovec iovs[send_info.block_count * (send_info.headers ? 2 : 1)] = {};
+
+      // With kernel pacing, every message carries its own departure time
+      struct txtime_cmbuf_t {
+        alignas(struct cmsghdr) char buf[sizeof(cmbuf.buf)];
+      };
+      txtime_cmbuf_t txtime_cmbufs[send_info.send_time ? send_info.block_count : 1];
       int iov_idx = 0;
       for (size_t i = 0; i < send_info.block_count; i++) {
         msgs[i].msg_hdr.msg_iov = &iovs[iov_idx];
@@ -608,20 +797,34 @@ namespace platf {
         msgs[i].msg_hdr.msg_namelen = msg.msg_namelen;
         msgs[i].msg_hdr.msg_control = cmbuf.buf;
         msgs[i].msg_hdr.msg_controllen = cmbuflen;
+
+#ifdef SO_TXTIME
+        if (send_info.send_time) {
+          memcpy(txtime_cmbufs[i].buf, cmbuf.buf, cmbuflen);
+          msgs[i].msg_hdr.msg_control = txtime_cmbufs[i].buf;
+          msgs[i].msg_hdr.msg_controllen = append_txtime(txtime_cmbufs[i].buf, cmbuflen, send_info.send_time_for_block(i));
+        }
+#endif
       }
 
       // Call sendmmsg() until all messages are sent
       size_t blocks_sent = 0;
       while (blocks_sent < send_info.block_count) {
-        int msgs_sent = sendmmsg(sockfd, &msgs[blocks_sent], send_info.block_count - blocks_sent, 0);
+        int msgs_sent = sendmmsg(sockfd, &msgs[blocks_sent], send_info.block_count - blocks_sent, send_flags);
+        send_info.syscalls++;
         if (msgs_sent < 0) {
           // If there's no send buffer space, wait for some to be available
           if (errno == EAGAIN) {
+            if (zerocopy) {
+              zerocopy->reap();
+            }
+
             struct pollfd pfd;
 
             pfd.fd = sockfd;
             pfd.events = POLLOUT;
 
+            send_info.syscalls++;
             if (poll(&pfd, 1, -1) != 1) {
               BOOST_LOG(warning) << "poll() failed: "sv << errno;
               break;
@@ -631,10 +834,20 @@ namespace platf {
             continue;
           }
 
+          if (errno == ENOBUFS && send_flags) {
+            BOOST_LOG(verbose) << "Zero-copy send not possible, falling back to copying"sv;
+            send_flags = 0;
+            continue;
+          }
+
           BOOST_LOG(warning) << "sendmmsg() failed: "sv << errno;
           return false;
         }
 
+        if (send_flags) {
+          zerocopy->sent(msgs_sent);
+        }
+
         blocks_sent += msgs_sent;
       }
 
@@ -642,6 +855,65 @@ namespace platf {
     }
   }
 
+  int
+  recv_batch(recv_batch_info_t &recv_info) {
+    auto sockfd = (int) recv_info.native_socket;
+
+    constexpr size_t max_batch_size = 64;
+    auto batch_size = std::min(recv_info.max_datagrams, max_batch_size);
+
+    struct mmsghdr msgs[max_batch_size];
+    struct iovec iovs[max_batch_size];
+    struct sockaddr_storage addrs[max_batch_size];
+    for (size_t i = 0; i < batch_size; i++) {
+      iovs[i].iov_base = recv_info.buffers + i * recv_info.buffer_size;
+      iovs[i].iov_len = recv_info.buffer_size;
+
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int msgs_received;
+    while ((msgs_received = recvmmsg(sockfd, msgs, batch_size, MSG_DONTWAIT, nullptr)) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      }
+
+      // An ICMP error for an earlier send is only reported once, the socket keeps working
+      if (errno == ECONNREFUSED || errno == EINTR) {
+        continue;
+      }
+
+      BOOST_LOG(verbose) << "recvmmsg() failed: "sv << errno;
+      return -1;
+    }
+
+    for (int i = 0; i < msgs_received; i++) {
+      auto &datagram = recv_info.datagrams[i];
+      datagram.size = msgs[i].msg_len;
+
+      if (addrs[i].ss_family == AF_INET6) {
+        auto saddr_v6 = (struct sockaddr_in6 *) &addrs[i];
+
+        boost::asio::ip::address_v6::bytes_type addr_bytes;
+        memcpy(addr_bytes.data(), &saddr_v6->sin6_addr, addr_bytes.size());
+        datagram.address = boost::asio::ip::address_v6 { addr_bytes, saddr_v6->sin6_scope_id };
+        datagram.port = ntohs(saddr_v6->sin6_port);
+      }
+      else {
+        auto saddr_v4 = (struct sockaddr_in *) &addrs[i];
+
+        datagram.address = boost::asio::ip::address_v4 { ntohl(saddr_v4->sin_addr.s_addr) };
+        datagram.port = ntohs(saddr_v4->sin_port);
+      }
+    }
+
+    return msgs_received;
+  }
+
   bool
   send(send_info_t &send_info) {
     auto sockfd = (int) send_info.native_socket;
@@ -847,6 +1119,139 @@ namespace platf {
     return std::make_unique<qos_t>(sockfd, reset_options);
   }
 
+  /**
+   * @brief List the queueing disciplines attached to each network interface.
+   * @return The qdisc kinds by interface index, or `std::nullopt` if rtnetlink can't be queried.
+   */
+  static std::optional<std::map<int, std::set<std::string>>>
+  qdisc_kinds() {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    auto close_fd = util::fail_guard([fd]() {
+      close(fd);
+    });
+
+    struct {
+      struct nlmsghdr nlh;
+      struct tcmsg tcm;
+    } request = {};
+    request.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(request.tcm));
+    request.nlh.nlmsg_type = RTM_GETQDISC;
+    request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.nlh.nlmsg_seq = 1;
+    request.tcm.tcm_family = AF_UNSPEC;
+
+    if (::send(fd, &request, request.nlh.nlmsg_len, 0) < 0) {
+      return std::nullopt;
+    }
+
+    std::map<int, std::set<std::string>> kinds;
+    std::vector<std::uint32_t> buffer(8192);
+    while (true) {
+      int len = recv(fd, buffer.data(), buffer.size() * sizeof(std::uint32_t), 0);
+      if (len < 0) {
+        return std::nullopt;
+      }
+
+      for (auto nlh = (struct nlmsghdr *) buffer.data(); NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+        if (nlh->nlmsg_type == NLMSG_DONE) {
+          return kinds;
+        }
+        if (nlh->nlmsg_type == NLMSG_ERROR) {
+          return std::nullopt;
+        }
+        if (nlh->nlmsg_type != RTM_NEWQDISC) {
+          continue;
+        }
+
+        auto tcm = (struct tcmsg *) NLMSG_DATA(nlh);
+        int attr_len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*tcm));
+        for (auto rta = (struct rtattr *) ((char *) tcm + NLMSG_ALIGN(sizeof(*tcm))); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+          if (rta->rta_type == TCA_KIND) {
+            kinds[tcm->tcm_ifindex].emplace((const char *) RTA_DATA(rta));
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Check if packets leaving through interfaces with these qdiscs are held until their departure time.
+   * @details Only fq paces by CLOCK_MONOTONIC departure times. mq just fans out to per-queue children,
+   *          so the interface qualifies if those children are fq too. Anything else, including the
+   *          default fq_codel and pfifo_fast, sends packets as soon as they are queued.
+   */
+  static bool
+  qdiscs_honor_txtime(const std::set<std::string> &kinds) {
+    bool fq = false;
+    for (auto &kind : kinds) {
+      if (kind == "fq"sv) {
+        fq = true;
+      }
+      else if (kind != "mq"sv && kind != "ingress"sv && kind != "clsact"sv) {
+        return false;
+      }
+    }
+
+    return fq;
+  }
+
+  bool
+  enable_socket_txtime(uintptr_t native_socket) {
+#ifdef SO_TXTIME
+    // Any qdisc accepts SO_TXTIME, but only fq acts on it, so check every interface that can carry the stream
+    auto kinds = qdisc_kinds();
+    if (!kinds) {
+      BOOST_LOG(warning) << "Couldn't list the qdiscs of the network interfaces: "sv << errno;
+      return false;
+    }
+
+    auto ifaddrs = get_ifaddrs();
+    for (auto pos = ifaddrs.get(); pos != nullptr; pos = pos->ifa_next) {
+      constexpr auto running = IFF_UP | IFF_RUNNING;
+      if (!pos->ifa_addr || (pos->ifa_flags & running) != running || (pos->ifa_flags & IFF_LOOPBACK)) {
+        continue;
+      }
+
+      auto index = (int) if_nametoindex(pos->ifa_name);
+      if (auto it = kinds->find(index); it == std::end(*kinds) || !qdiscs_honor_txtime(it->second)) {
+        BOOST_LOG(warning) << "The qdisc of "sv << pos->ifa_name << " ignores departure times, kernel pacing needs fq"sv;
+        return false;
+      }
+    }
+
+    // fq paces by CLOCK_MONOTONIC departure times, and holds packets until then rather than dropping late ones
+    struct sock_txtime txtime_config = {};
+    txtime_config.clockid = CLOCK_MONOTONIC;
+    txtime_config.flags = 0;
+
+    if (setsockopt((int) native_socket, SOL_SOCKET, SO_TXTIME, &txtime_config, sizeof(txtime_config)) == 0) {
+      return true;
+    }
+
+    BOOST_LOG(warning) << "Failed to enable SO_TXTIME: "sv << errno;
+#endif
+
+    return false;
+  }
+
+  std::unique_ptr<zerocopy_t>
+  enable_socket_zerocopy(uintptr_t native_socket) {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    int enable = 1;
+    if (setsockopt((int) native_socket, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0) {
+      return std::make_unique<zerocopy_impl_t>((int) native_socket);
+    }
+
+    // Kernels before 4.14 don't support zero-copy sends, and UDP needs at least 5.0
+    BOOST_LOG(warning) << "Failed to enable SO_ZEROCOPY: "sv << errno;
+#endif
+
+    return nullptr;
+  }
+
   std::string
   get_host_name() {
     try {
@@ -954,6 +1359,53 @@ namespace platf {
     return true;
   }
 
+  std::string
+  gpu_fingerprint() {
+    namespace fs = std::filesystem;
+
+    auto read_line = [](const fs::path &path) {
+      std::ifstream in { path };
+      std::string line;
+      std::getline(in, line);
+      return line;
+    };
+
+    // In-tree drivers are versioned with the kernel
+    std::string fingerprint;
+    utsname uts;
+    if (!uname(&uts)) {
+      fingerprint = uts.release;
+      fingerprint += ';';
+    }
+
+    std::error_code ec;
+    std::vector<std::string> cards;
+    for (auto &entry : fs::directory_iterator { "/sys/class/drm", ec }) {
+      auto name = entry.path().filename().string();
+      if (!name.starts_with("card") || name.find('-') != std::string::npos) {
+        continue;
+      }
+
+      auto device = entry.path() / "device";
+      auto driver = fs::read_symlink(device / "driver", ec).filename().string();
+
+      auto card = read_line(device / "vendor") + ':' + read_line(device / "device") + ':' + driver;
+
+      // Out-of-tree drivers like nvidia have their own version
+      if (auto version = read_line(fs::path { "/sys/module" } / driver / "version"); !version.empty()) {
+        card += ':' + version;
+      }
+      cards.emplace_back(std::move(card));
+    }
+
+    std::sort(std::begin(cards), std::end(cards));
+    for (auto &card : cards) {
+      fingerprint += card + ';';
+    }
+
+    return fingerprint;
+  }
+
   std::shared_ptr<display_t>
   display(mem_type_e hwdevice_type, const std::string &display_name, const video::config_t &config) {
 #ifdef SUNSHINE_BUILD_CUDA
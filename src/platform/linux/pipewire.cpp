@@ -0,0 +1,298 @@
+/**
+ * @file src/platform/linux/pipewire.cpp
+ * @brief Definitions for native PipeWire audio capture.
+ */
+// standard includes
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <semaphore>
+#include <vector>
+
+// lib includes
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+
+// local includes
+#include "pipewire.h"
+#include "src/logging.h"
+#include "src/utility.h"
+
+namespace platf::pipewire {
+  using namespace std::literals;
+
+  constexpr spa_audio_channel position_mapping[] {
+    SPA_AUDIO_CHANNEL_FL,
+    SPA_AUDIO_CHANNEL_FR,
+    SPA_AUDIO_CHANNEL_FC,
+    SPA_AUDIO_CHANNEL_LFE,
+    SPA_AUDIO_CHANNEL_RL,
+    SPA_AUDIO_CHANNEL_RR,
+    SPA_AUDIO_CHANNEL_SL,
+    SPA_AUDIO_CHANNEL_SR,
+    SPA_AUDIO_CHANNEL_TFL,
+    SPA_AUDIO_CHANNEL_TFR,
+    SPA_AUDIO_CHANNEL_TRL,
+    SPA_AUDIO_CHANNEL_TRR,
+  };
+
+  /**
+   * @brief How long to wait for the stream to connect before falling back to PulseAudio.
+   */
+  constexpr auto connect_timeout = 2s;
+
+  /**
+   * @brief Graph cycles of audio buffered between the PipeWire thread and the capture thread.
+   */
+  constexpr std::uint32_t ring_cycles = 8;
+
+  using loop_t = util::safe_ptr<pw_thread_loop, pw_thread_loop_destroy>;
+  using stream_t = util::safe_ptr<pw_stream, pw_stream_destroy>;
+
+  /**
+   * @brief A capture stream on its own PipeWire thread.
+   * @details The realtime process callback copies each buffer into a single-producer,
+   *          single-consumer ring of interleaved samples, which sample() drains a packet at a time.
+   *          The realtime thread never takes a lock, it only posts a semaphore to wake the capture thread.
+   *          The quantum and the packet size don't need to match, though latency is lowest when they do.
+   */
+  class mic_pw_t: public mic_t {
+  public:
+    mic_pw_t(std::uint32_t channels, std::size_t ring_size):
+        channels { channels }, ring(ring_size) {}
+
+    ~mic_pw_t() override {
+      if (loop) {
+        pw_thread_loop_stop(loop.get());
+      }
+
+      stream.reset();
+      loop.reset();
+
+      if (overruns) {
+        BOOST_LOG(info) << "PipeWire capture dropped "sv << overruns << " sample(s) while the ring was full"sv;
+      }
+    }
+
+    capture_e
+    sample(std::vector<float> &sample_buf) override {
+      auto deadline = std::chrono::steady_clock::now() + 500ms;
+      while (!state_error && available() < sample_buf.size() && wakeup.try_acquire_until(deadline)) {}
+
+      if (state_error) {
+        return capture_e::reinit;
+      }
+      if (available() < sample_buf.size()) {
+        return capture_e::timeout;
+      }
+
+      auto read = read_pos.load(std::memory_order_relaxed);
+      auto offset = read % ring.size();
+      auto first = std::min(sample_buf.size(), ring.size() - offset);
+      std::copy_n(ring.begin() + offset, first, sample_buf.begin());
+      std::copy_n(ring.begin(), sample_buf.size() - first, sample_buf.begin() + first);
+
+      read_pos.store(read + sample_buf.size(), std::memory_order_release);
+      return capture_e::ok;
+    }
+
+    /**
+     * @brief Connect the stream and wait for it to be linked.
+     */
+    int
+    connect(const std::uint8_t *mapping, std::uint32_t sample_rate, std::uint32_t quantum, const std::string &sink_name) {
+      loop.reset(pw_thread_loop_new("sunshine-audio", nullptr));
+      if (!loop) {
+        BOOST_LOG(error) << "Couldn't create PipeWire thread loop"sv;
+        return -1;
+      }
+
+      auto props = pw_properties_new(
+        PW_KEY_MEDIA_TYPE, "Audio",
+        PW_KEY_MEDIA_CATEGORY, "Capture",
+        PW_KEY_APP_NAME, "sunshine",
+        PW_KEY_NODE_NAME, "sunshine-record",
+        PW_KEY_STREAM_CAPTURE_SINK, "true",
+        nullptr);
+      pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", quantum, sample_rate);
+      pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%u", sample_rate);
+      if (!sink_name.empty()) {
+#ifdef PW_KEY_TARGET_OBJECT
+        pw_properties_set(props, PW_KEY_TARGET_OBJECT, sink_name.c_str());
+#else
+        pw_properties_set(props, PW_KEY_NODE_TARGET, sink_name.c_str());
+#endif
+      }
+
+      std::uint8_t pod_buffer[1024];
+      spa_pod_builder builder = SPA_POD_BUILDER_INIT(pod_buffer, sizeof(pod_buffer));
+
+      spa_audio_info_raw info {};
+      info.format = SPA_AUDIO_FORMAT_F32;
+      info.rate = sample_rate;
+      info.channels = channels;
+      for (std::uint32_t x = 0; x < channels; ++x) {
+        info.position[x] = position_mapping[mapping[x]];
+      }
+      const spa_pod *params[] { spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &info) };
+
+      pw_thread_loop_lock(loop.get());
+      stream.reset(pw_stream_new_simple(pw_thread_loop_get_loop(loop.get()), "sunshine-record", props, &stream_events, this));
+
+      int status = -1;
+      if (stream) {
+        status = pw_stream_connect(
+          stream.get(),
+          PW_DIRECTION_INPUT,
+          PW_ID_ANY,
+          (pw_stream_flags) (PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS | PW_STREAM_FLAG_RT_PROCESS),
+          params,
+          1);
+      }
+      pw_thread_loop_unlock(loop.get());
+
+      if (status < 0) {
+        BOOST_LOG(warning) << "Couldn't connect PipeWire capture stream: "sv << spa_strerror(status);
+        return -1;
+      }
+
+      if (pw_thread_loop_start(loop.get()) < 0) {
+        BOOST_LOG(error) << "Couldn't start PipeWire thread loop"sv;
+        return -1;
+      }
+
+      auto deadline = std::chrono::steady_clock::now() + connect_timeout;
+      while (!state_error && !state_connected && wakeup.try_acquire_until(deadline)) {}
+
+      if (state_error || !state_connected) {
+        BOOST_LOG(warning) << "PipeWire capture stream didn't connect"sv;
+        return -1;
+      }
+
+      return 0;
+    }
+
+  private:
+    /**
+     * @brief Samples ready for the capture thread.
+     */
+    std::size_t
+    available() const {
+      return write_pos.load(std::memory_order_acquire) - read_pos.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Append samples to the ring. Called on the realtime PipeWire thread.
+     * @details If the capture thread falls behind, the newest samples are dropped rather than
+     *          blocking the graph.
+     */
+    void
+    write(const float *samples, std::size_t count) {
+      auto write = write_pos.load(std::memory_order_relaxed);
+      auto free = ring.size() - (write - read_pos.load(std::memory_order_acquire));
+
+      count -= count % channels;
+      if (count > free) {
+        overruns += count - free;
+        count = free;
+      }
+
+      auto offset = write % ring.size();
+      auto first = std::min(count, ring.size() - offset);
+      std::copy_n(samples, first, ring.begin() + offset);
+      std::copy_n(samples + first, count - first, ring.begin());
+
+      write_pos.store(write + count, std::memory_order_release);
+
+      // Posting doesn't block, unlike taking a lock the capture thread may be holding
+      wakeup.release();
+    }
+
+    static void
+    on_process(void *userdata) {
+      auto mic = (mic_pw_t *) userdata;
+
+      auto buffer = pw_stream_dequeue_buffer(mic->stream.get());
+      if (!buffer) {
+        return;
+      }
+
+      auto &data = buffer->buffer->datas[0];
+      if (data.data && data.chunk) {
+        auto offset = std::min(data.chunk->offset, data.maxsize);
+        auto size = std::min(data.chunk->size, data.maxsize - offset);
+        mic->write((const float *) ((const std::uint8_t *) data.data + offset), size / sizeof(float));
+      }
+
+      pw_stream_queue_buffer(mic->stream.get(), buffer);
+    }
+
+    static void
+    on_state_changed(void *userdata, pw_stream_state old, pw_stream_state state, const char *message) {
+      auto mic = (mic_pw_t *) userdata;
+
+      BOOST_LOG(debug) << "PipeWire capture stream: "sv << pw_stream_state_as_string(old) << " -> "sv << pw_stream_state_as_string(state);
+
+      switch (state) {
+        case PW_STREAM_STATE_ERROR:
+          BOOST_LOG(error) << "PipeWire capture stream failed: "sv << (message ? message : "unknown error");
+          mic->state_error = true;
+          break;
+        case PW_STREAM_STATE_UNCONNECTED:
+          // The sink went away after the stream was linked
+          mic->state_error = mic->state_connected.load();
+          break;
+        case PW_STREAM_STATE_PAUSED:
+        case PW_STREAM_STATE_STREAMING:
+          mic->state_connected = true;
+          break;
+        case PW_STREAM_STATE_CONNECTING:
+          break;
+      }
+      mic->wakeup.release();
+    }
+
+    static constexpr pw_stream_events stream_events = []() {
+      pw_stream_events events {};
+      events.version = PW_VERSION_STREAM_EVENTS;
+      events.state_changed = on_state_changed;
+      events.process = on_process;
+      return events;
+    }();
+
+    std::uint32_t channels;
+
+    std::vector<float> ring;
+    std::atomic<std::uint64_t> write_pos { 0 };
+    std::atomic<std::uint64_t> read_pos { 0 };
+    std::uint64_t overruns = 0;
+
+    // Posted for every write to the ring and every state change
+    std::counting_semaphore<> wakeup { 0 };
+    std::atomic<bool> state_connected = false;
+    std::atomic<bool> state_error = false;
+
+    loop_t loop;
+    stream_t stream;
+  };
+
+  std::unique_ptr<mic_t>
+  microphone(const std::uint8_t *mapping, int channels, std::uint32_t sample_rate, std::uint32_t frame_size, std::uint32_t quantum, const std::string &sink_name) {
+    static std::once_flag init_flag;
+    std::call_once(init_flag, []() {
+      pw_init(nullptr, nullptr);
+      BOOST_LOG(info) << "PipeWire library "sv << pw_get_library_version();
+    });
+
+    // Room for a few graph cycles or packets, whichever is larger, in whole frames
+    auto ring_size = std::max(quantum, frame_size) * ring_cycles * channels;
+    auto mic = std::make_unique<mic_pw_t>(channels, ring_size);
+    if (mic->connect(mapping, sample_rate, quantum, sink_name)) {
+      return nullptr;
+    }
+
+    BOOST_LOG(info) << "Capturing audio through PipeWire, quantum "sv << quantum << '/' << sample_rate
+                    << " for "sv << (sink_name.empty() ? "the default sink"s : sink_name);
+    return mic;
+  }
+}  // namespace platf::pipewire
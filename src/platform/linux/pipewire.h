@@ -0,0 +1,28 @@
+/**
+ * @file src/platform/linux/pipewire.h
+ * @brief Declarations for native PipeWire audio capture.
+ */
+#pragma once
+
+// standard includes
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// local includes
+#include "src/platform/common.h"
+
+namespace platf::pipewire {
+  /**
+   * @brief Capture the monitor of a sink through a native PipeWire stream.
+   * @param mapping The speaker of each captured channel.
+   * @param channels The number of channels.
+   * @param sample_rate The sample rate.
+   * @param frame_size The samples per channel returned by each call to mic_t::sample().
+   * @param quantum The samples per channel requested for each PipeWire graph cycle.
+   * @param sink_name The node name of the sink, or empty for the default sink.
+   * @return The microphone, or `nullptr` if PipeWire isn't available or the stream can't connect.
+   */
+  std::unique_ptr<mic_t>
+  microphone(const std::uint8_t *mapping, int channels, std::uint32_t sample_rate, std::uint32_t frame_size, std::uint32_t quantum, const std::string &sink_name);
+}  // namespace platf::pipewire
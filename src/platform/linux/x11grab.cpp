@@ -10,6 +10,7 @@
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/Xdamage.h>
 #include <X11/extensions/Xfixes.h>
 #include <X11/extensions/Xrandr.h>
 #include <sys/ipc.h>
@@ -61,6 +62,9 @@ namespace platf {
     _FN(CloseDisplay, int, (Display * display));
     _FN(Free, int, (void *data));
     _FN(InitThreads, Status, (void) );
+    _FN(Pending, int, (Display * display));
+    _FN(NextEvent, int, (Display * display, XEvent *event_return));
+    _FN(Sync, int, (Display * display, Bool discard));
 
     namespace rr {
       _FN(GetScreenResources, XRRScreenResources *, (Display * dpy, Window window));
@@ -132,6 +136,42 @@ namespace platf {
       }
     }  // namespace fix
 
+    namespace damage {
+      _FN(QueryExtension, Bool, (Display * dpy, int *event_base_return, int *error_base_return));
+      _FN(Create, Damage, (Display * dpy, Drawable drawable, int level));
+      _FN(Subtract, void, (Display * dpy, Damage damage, XserverRegion repair, XserverRegion parts));
+      _FN(Destroy, void, (Display * dpy, Damage damage));
+
+      static int
+      init() {
+        static void *handle { nullptr };
+        static bool funcs_loaded = false;
+
+        if (funcs_loaded) return 0;
+
+        if (!handle) {
+          handle = dyn::handle({ "libXdamage.so.1", "libXdamage.so" });
+          if (!handle) {
+            return -1;
+          }
+        }
+
+        std::vector<std::tuple<dyn::apiproc *, const char *>> funcs {
+          { (dyn::apiproc *) &QueryExtension, "XDamageQueryExtension" },
+          { (dyn::apiproc *) &Create, "XDamageCreate" },
+          { (dyn::apiproc *) &Subtract, "XDamageSubtract" },
+          { (dyn::apiproc *) &Destroy, "XDamageDestroy" },
+        };
+
+        if (dyn::load(handle, funcs)) {
+          return -1;
+        }
+
+        funcs_loaded = true;
+        return 0;
+      }
+    }  // namespace damage
+
     static int
     init() {
       static void *handle { nullptr };
@@ -153,6 +193,9 @@ namespace platf {
         { (dyn::apiproc *) &Free, "XFree" },
         { (dyn::apiproc *) &CloseDisplay, "XCloseDisplay" },
         { (dyn::apiproc *) &InitThreads, "XInitThreads" },
+        { (dyn::apiproc *) &Pending, "XPending" },
+        { (dyn::apiproc *) &NextEvent, "XNextEvent" },
+        { (dyn::apiproc *) &Sync, "XSync" },
       };
 
       if (dyn::load(handle, funcs)) {
@@ -331,15 +374,28 @@ namespace platf {
     }
   };
 
-  static void
+  /**
+   * @brief Position and shape of a blended cursor, compared between frames to detect cursor changes.
+   */
+  struct cursor_state_t {
+    short x, y;
+    unsigned long serial;
+
+    bool
+    operator==(const cursor_state_t &) const = default;
+  };
+
+  static std::optional<cursor_state_t>
   blend_cursor(Display *display, img_t &img, int offsetX, int offsetY) {
     xcursor_t overlay { x11::fix::GetCursorImage(display) };
 
     if (!overlay) {
       BOOST_LOG(error) << "Couldn't get cursor from XFixesGetCursorImage"sv;
-      return;
+      return std::nullopt;
     }
 
+    cursor_state_t state { overlay->x, overlay->y, overlay->cursor_serial };
+
     overlay->x -= overlay->xhot;
     overlay->y -= overlay->yhot;
 
@@ -380,6 +436,8 @@ namespace platf {
         ++pixels_begin;
       });
     }
+
+    return state;
   }
 
   struct x11_attr_t: public display_t {
@@ -605,6 +663,12 @@ namespace platf {
 
     task_pool_util::TaskPool::task_id_t refresh_task_id;
 
+    // Damage tracking of the root window, if the XDamage extension is available
+    Damage damage {};
+    int damage_event_base {};
+    std::uint64_t content_serial {};
+    std::optional<cursor_state_t> cursor_state;
+
     void
     delayed_refresh() {
       refresh();
@@ -620,6 +684,34 @@ namespace platf {
     ~shm_attr_t() override {
       while (!task_pool.cancel(refresh_task_id))
         ;
+
+      if (damage) {
+        x11::damage::Destroy(shm_xdisplay.get(), damage);
+      }
+    }
+
+    /**
+     * @brief Consume the damage reported since the last call.
+     * @return `true` if any part of the screen was drawn to.
+     */
+    bool
+    take_damage() {
+      bool damaged = false;
+      while (x11::Pending(shm_xdisplay.get())) {
+        XEvent event;
+        x11::NextEvent(shm_xdisplay.get(), &event);
+        damaged |= event.type == damage_event_base + XDamageNotify;
+      }
+
+      // The server reports damage again once the region is cleared. The image is grabbed on the
+      // xcb connection, so wait for the server to clear it first, or drawing between the grab
+      // and the clear would be lost without a new notify.
+      if (damaged) {
+        x11::damage::Subtract(shm_xdisplay.get(), damage, None, None);
+        x11::Sync(shm_xdisplay.get(), False);
+      }
+
+      return damaged;
     }
 
     capture_e
@@ -676,6 +768,9 @@ namespace platf {
         return capture_e::reinit;
       }
       else {
+        // Take the damage before grabbing the image, so drawing that races with the grab is seen next frame
+        bool damaged = damage && take_damage();
+
         auto img_cookie = xcb::shm_get_image_unchecked(xcb.get(), display->root, offset_x, offset_y, width, height, ~0, XCB_IMAGE_FORMAT_Z_PIXMAP, seg, 0);
         auto frame_timestamp = std::chrono::steady_clock::now();
 
@@ -692,8 +787,17 @@ namespace platf {
         std::copy_n((std::uint8_t *) data.data, frame_size(), img_out->data);
         img_out->frame_timestamp = frame_timestamp;
 
+        std::optional<cursor_state_t> blended_cursor;
         if (cursor) {
-          blend_cursor(shm_xdisplay.get(), *img_out, offset_x, offset_y);
+          blended_cursor = blend_cursor(shm_xdisplay.get(), *img_out, offset_x, offset_y);
+        }
+
+        if (damage) {
+          if (damaged || !content_serial || blended_cursor != cursor_state) {
+            ++content_serial;
+            cursor_state = blended_cursor;
+          }
+          img_out->content_serial = content_serial;
         }
 
         return capture_e::ok;
@@ -754,6 +858,15 @@ namespace platf {
         return -1;
       }
 
+      // Without damage tracking every frame is treated as changed
+      int damage_error_base;
+      if (!x11::damage::init() && x11::damage::QueryExtension(shm_xdisplay.get(), &damage_event_base, &damage_error_base)) {
+        damage = x11::damage::Create(shm_xdisplay.get(), DefaultRootWindow(shm_xdisplay.get()), XDamageReportNonEmpty);
+      }
+      else {
+        BOOST_LOG(info) << "XDamage is unavailable, unchanged frames will be converted again"sv;
+      }
+
       return 0;
     }
 
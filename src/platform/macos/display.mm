@@ -2,6 +2,8 @@
  * @file src/platform/macos/display.mm
  * @brief Definitions for display capture on macOS.
  */
+#include <sys/sysctl.h>
+
 #include "src/platform/common.h"
 #include "src/platform/macos/av_img_t.h"
 #include "src/platform/macos/av_video.h"
@@ -216,4 +218,16 @@ namespace platf {
     // We don't track GPU state, so we will always reenumerate. Fortunately, it is fast on macOS.
     return true;
   }
+
+  std::string
+  gpu_fingerprint() {
+    // VideoToolbox and the GPU drivers are updated with the OS
+    char build[64] {};
+    size_t size = sizeof(build);
+    if (sysctlbyname("kern.osversion", build, &size, nullptr, 0)) {
+      return {};
+    }
+
+    return build;
+  }
 }  // namespace platf
@@ -14,6 +14,7 @@
 #include <fcntl.h>
 #include <ifaddrs.h>
 #include <mach-o/dyld.h>
+#include <net/if.h>
 #include <net/if_dl.h>
 #include <pwd.h>
 
@@ -170,6 +171,26 @@ namespace platf {
     return "00:00:00:00:00:00"s;
   }
 
+  int
+  get_link_speed(const std::string_view &address) {
+    auto ifaddrs = get_ifaddrs();
+
+    for (auto pos = ifaddrs.get(); pos != nullptr; pos = pos->ifa_next) {
+      if (pos->ifa_addr && address == from_sockaddr(pos->ifa_addr)) {
+        // The link statistics hang off the AF_LINK entry of the same interface
+        for (auto link = ifaddrs.get(); link != nullptr; link = link->ifa_next) {
+          if (link->ifa_addr && link->ifa_data && link->ifa_addr->sa_family == AF_LINK && !strcmp(link->ifa_name, pos->ifa_name)) {
+            return (int) (((struct if_data *) link->ifa_data)->ifi_baudrate / 1000000);
+          }
+        }
+
+        return 0;
+      }
+    }
+
+    return 0;
+  }
+
   bp::child
   run_command(bool elevated, bool interactive, const std::string &cmd, boost::filesystem::path &working_dir, const bp::environment &env, FILE *file, std::error_code &ec, bp::group *group) {
     // clang-format off
@@ -358,6 +379,12 @@ namespace platf {
     return false;
   }
 
+  int
+  recv_batch(recv_batch_info_t &recv_info) {
+    // Fall back to unbatched receive calls
+    return -1;
+  }
+
   bool
   send(send_info_t &send_info) {
     auto sockfd = (int) send_info.native_socket;
@@ -569,6 +596,18 @@ namespace platf {
     return std::make_unique<qos_t>(sockfd, reset_options);
   }
 
+  bool
+  enable_socket_txtime(uintptr_t native_socket) {
+    // Not supported on macOS
+    return false;
+  }
+
+  std::unique_ptr<zerocopy_t>
+  enable_socket_zerocopy(uintptr_t native_socket) {
+    // Not supported on macOS
+    return nullptr;
+  }
+
   std::string
   get_host_name() {
     try {
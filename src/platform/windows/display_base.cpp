@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cmath>
 #include <initguid.h>
+#include <sstream>
 #include <thread>
 
 #include <boost/algorithm/string/join.hpp>
@@ -1266,6 +1267,34 @@ namespace platf {
     return adapter_names;
   }
 
+  std::string
+  gpu_fingerprint() {
+    dxgi::factory1_t factory;
+    auto status = CreateDXGIFactory1(IID_IDXGIFactory1, (void **) &factory);
+    if (FAILED(status)) {
+      BOOST_LOG(error) << "Failed to create DXGIFactory1 [0x"sv << util::hex(status).to_string_view() << ']';
+      return {};
+    }
+
+    std::ostringstream fingerprint;
+    fingerprint << std::hex;
+
+    dxgi::adapter_t adapter;
+    for (int x = 0; factory->EnumAdapters1(x, &adapter) != DXGI_ERROR_NOT_FOUND; ++x) {
+      DXGI_ADAPTER_DESC1 adapter_desc;
+      adapter->GetDesc1(&adapter_desc);
+
+      // The user mode driver version changes with every driver update
+      LARGE_INTEGER umd_version {};
+      adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umd_version);
+
+      fingerprint << adapter_desc.VendorId << ':' << adapter_desc.DeviceId << ':' << adapter_desc.SubSysId << ':'
+                  << adapter_desc.Revision << ':' << umd_version.QuadPart << ';';
+    }
+
+    return fingerprint.str();
+  }
+
   /**
    * @brief Returns if GPUs/drivers have changed since the last call to this function.
    * @return `true` if a change has occurred or if it is unknown whether a change occurred.
@@ -2115,23 +2115,12 @@ namespace platf::dxgi {
           return capture_e::error;
         }
 
-        // Optimization: Check if we have an image (from direct copy) or surface (from previous frame)
+        // The image or surface in last_frame_variant must stay free of the cursor, so it can be
+        // blended again at the next position and forwarded as is after the cursor hides.
         auto p_img = std::get_if<std::shared_ptr<platf::img_t>>(&last_frame_variant);
         auto p_surface = std::get_if<texture2d_t>(&last_frame_variant);
-        
-        if (p_img && p_img->use_count() == 1) {
-          // Optimization: We have a direct image copy that's not yet used by encoder,
-          // blend cursor directly onto it to avoid an extra texture copy.
-          img_out = *p_img;
-          auto d3d_img = std::static_pointer_cast<img_d3d_t>(img_out);
-          texture_lock_helper lock_helper(d3d_img->capture_mutex.get());
-          if (!lock_helper.lock()) {
-            BOOST_LOG(error) << "Failed to lock capture texture for cursor blend";
-            return capture_e::error;
-          }
-          blend_cursor(*d3d_img);
-        }
-        else if (p_surface) {
+
+        if (p_surface) {
           // We have an intermediate surface, copy it first then blend
           if (!pull_free_image_cb(img_out)) return capture_e::interrupted;
 
@@ -2142,16 +2131,12 @@ namespace platf::dxgi {
           blend_cursor(*d3d_img);
         }
         else if (p_img) {
-          // Image is already in use by encoder, we need to get a new one
-          // This case is rare and indicates the image was consumed before cursor blend
-          // Fall back to creating a surface and copying (original behavior)
+          // We have a direct image copy, blend the cursor onto a copy of it in a new image
           if (!pull_free_image_cb(img_out)) return capture_e::interrupted;
 
           auto [d3d_img, lock] = get_locked_d3d_img(img_out);
           if (!d3d_img) return capture_e::error;
 
-          // Copy from the image that's in use (it should still be valid for reading)
-          // Note: This creates an extra copy, but it's a rare edge case
           auto d3d_img_src = std::static_pointer_cast<img_d3d_t>(*p_img);
           texture_lock_helper src_lock_helper(d3d_img_src->capture_mutex.get());
           if (src_lock_helper.lock()) {
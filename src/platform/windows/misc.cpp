@@ -196,6 +196,22 @@ namespace platf {
     return "00:00:00:00:00:00"s;
   }
 
+  int
+  get_link_speed(const std::string_view &address) {
+    adapteraddrs_t info = get_adapteraddrs();
+    for (auto adapter_pos = info.get(); adapter_pos != nullptr; adapter_pos = adapter_pos->Next) {
+      for (auto addr_pos = adapter_pos->FirstUnicastAddress; addr_pos != nullptr; addr_pos = addr_pos->Next) {
+        if (address == from_sockaddr(addr_pos->Address.lpSockaddr)) {
+          // TransmitLinkSpeed is in bits per second, or ULONG64_MAX if unknown
+          auto speed = adapter_pos->TransmitLinkSpeed;
+          return speed == ULONG64_MAX ? 0 : (int) (speed / 1000000);
+        }
+      }
+    }
+
+    return 0;
+  }
+
   HDESK
   syncThreadDesktop() {
     auto hDesk = OpenInputDesktop(DF_ALLOWOTHERACCOUNTHOOK, FALSE, GENERIC_ALL);
@@ -1762,9 +1778,16 @@ namespace platf {
 
     // If USO is not supported, this will fail and the caller will fall back to unbatched sends.
     DWORD bytes_sent;
+    send_info.syscalls++;
     return WSASendMsg((SOCKET) send_info.native_socket, &msg, 0, &bytes_sent, nullptr, nullptr) != SOCKET_ERROR;
   }
 
+  int
+  recv_batch(recv_batch_info_t &recv_info) {
+    // Winsock has no batched receive for UDP, fall back to unbatched receive calls
+    return -1;
+  }
+
   bool
   send(send_info_t &send_info) {
     WSAMSG msg;
@@ -1983,6 +2006,19 @@ namespace platf {
 
     return std::make_unique<qos_t>(flow_id);
   }
+
+  bool
+  enable_socket_txtime(uintptr_t native_socket) {
+    // Windows has no per-packet departure times for UDP sockets
+    return false;
+  }
+
+  std::unique_ptr<zerocopy_t>
+  enable_socket_zerocopy(uintptr_t native_socket) {
+    // Winsock copies datagrams on send
+    return nullptr;
+  }
+
   int64_t
   qpc_counter() {
     LARGE_INTEGER performance_counter;
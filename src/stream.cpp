@@ -4,9 +4,12 @@
  */
 #include "process.h"
 
+#include <cmath>
+#include <deque>
 #include <future>
 #include <iomanip>
 #include <queue>
+#include <shared_mutex>
 #include <unordered_map>
 
 #include <fstream>
@@ -33,16 +36,20 @@ extern "C" {
   #define DATA_SHARDS_MAX 255
 #endif
 
+#include "adaptive_fec.h"
 #include "config.h"
 #include "display_device/session.h"
+#include "fec.h"
 #include "globals.h"
 #include "rtsp.h"
 #include "input.h"
 #include "logging.h"
 #include "network.h"
+#include "pacing.h"
 #include "stream.h"
 #include "sync.h"
 #include "system_tray.h"
+#include "thread_pool.h"
 #include "thread_safe.h"
 #include "utility.h"
 
@@ -457,9 +464,45 @@ namespace stream {
       int lowseq;
       udp::endpoint peer;
 
+      // Picks the send thread of this session when video_send_threads is set
+      std::uint32_t send_shard;
+
+      struct {
+        // Speed of the host interface in Mbps, 0 if unknown
+        int link_speed;
+
+        // Percentage of the pacing rate in use, lowered while the client reports loss
+        std::atomic<int> loss_scale { 100 };
+
+        // Pacing rate of the last frame in Mbps, and the time it took to send that frame
+        std::atomic<int> rate { 0 };
+        std::atomic<std::int64_t> drain_time_us { 0 };
+      } pacing;
+
+      struct {
+        // Parity percentage of P-frames, tracking the client loss reports when adaptive_fec is enabled
+        std::atomic<int> percentage;
+
+        // Loss reports without loss since the percentage last changed
+        int clean_reports;
+      } fec;
+
       std::optional<crypto::cipher::gcm_t> cipher;
       std::uint64_t gcm_iv_counter;
 
+      // Smoothed interval between the frames sent to the client, and its standard deviation
+      struct {
+        std::chrono::steady_clock::time_point last_frame_start;
+        double avg_ms = 0;
+        double variance = 0;
+        std::atomic<std::int64_t> avg_us { 0 };
+        std::atomic<std::int64_t> stddev_us { 0 };
+      } frame_interval;
+
+      // When video capture started, and how long it took to send the first IDR frame after that
+      std::chrono::steady_clock::time_point capture_start;
+      std::atomic<std::int64_t> first_idr_us { 0 };
+
       safe::mail_raw_t::event_t<bool> idr_events;
       safe::mail_raw_t::event_t<std::pair<int64_t, int64_t>> invalidate_ref_frames_events;
       safe::mail_raw_t::event_t<video::dynamic_param_t> dynamic_param_change_events;  // 新增：动态参数调整事件
@@ -484,6 +527,8 @@ namespace stream {
       std::unique_ptr<platf::deinit_t> qos;
 
       bool enable_mic;
+
+      audio::latency_tracker_t latency;
     } audio;
 
     struct {
@@ -838,11 +883,16 @@ namespace stream {
 
       size_t blocksize;
       size_t prefixsize;
-      util::buffer_t<char> shards;
-      util::buffer_t<char> headers;
-      util::buffer_t<uint8_t *> shards_p;
 
-      std::vector<platf::buffer_descriptor_t> payload_buffers;
+      // The packet headers are kept in headers instead of at the start of each shard,
+      // and are protected by FEC alongside the shard payloads
+      bool split_headers;
+
+      char *headers;
+      uint8_t **headers_p;
+      uint8_t **shards_p;
+
+      std::vector<platf::buffer_descriptor_t> *payload_buffers;
 
       char *
       data(size_t el) {
@@ -854,76 +904,200 @@ namespace stream {
         return prefixsize ? &headers[el * prefixsize] : nullptr;
       }
 
+      /**
+       * @brief Get the packet header of a shard, wherever it lives.
+       */
+      char *
+      header(size_t el) {
+        return split_headers ? prefix(el) : data(el);
+      }
+
       size_t
       size() const {
         return nr_shards;
       }
     };
 
-    static fec_t
-    encode(const std::string_view &payload, size_t blocksize, size_t fecpercentage, size_t minparityshards, size_t prefixsize) {
-      auto payload_size = payload.size();
+    /**
+     * @brief Scratch memory for the parts of a FEC block that can't point into the frame.
+     * @details Holds the packet headers or encryption prefixes, the data shards that have to be
+     *          copied (the one carrying the frame header and the zero-padded last one) and the
+     *          parity shards. The broadcast thread keeps one arena per FEC block and reuses it
+     *          for every frame, so it only allocates when a frame needs more shards than before.
+     */
+    struct arena_t {
+      util::buffer_t<char> headers;
+      util::buffer_t<char> shards;
+      util::buffer_t<uint8_t *> headers_p;
+      util::buffer_t<uint8_t *> shards_p;
+
+      std::vector<platf::buffer_descriptor_t> payload_buffers;
+    };
+
+    template <class T>
+    static T *
+    reserve(util::buffer_t<T> &buffer, size_t elements) {
+      if (buffer.size() < elements) {
+        buffer = util::buffer_t<T> { elements };
+      }
+
+      return buffer.begin();
+    }
+
+    /**
+     * @brief Thread-safe cache of Reed-Solomon codecs keyed by shard geometry.
+     * @details Creating a codec builds and inverts its encoding matrix, which is far more
+     *          expensive than encoding a typical frame. Codecs are only read by
+     *          reed_solomon_encode(), so one instance is shared by all sessions and FEC workers.
+     */
+    class rs_cache_t {
+    public:
+      reed_solomon *
+      get(size_t data_shards, size_t parity_shards) {
+        auto key = (std::uint32_t) (data_shards << 16 | parity_shards);
+
+        {
+          std::shared_lock lg { _lock };
+          if (auto it = _codecs.find(key); it != std::end(_codecs)) {
+            return it->second.get();
+          }
+        }
+
+        // Build the codec without holding the lock, so lookups of other geometries aren't blocked
+        rs_t rs { reed_solomon_new(data_shards, parity_shards) };
+        if (!rs) {
+          return nullptr;
+        }
+
+        std::unique_lock lg { _lock };
+        return _codecs.try_emplace(key, std::move(rs)).first->second.get();
+      }
+
+      size_t
+      size() {
+        std::shared_lock lg { _lock };
+        return _codecs.size();
+      }
+
+    private:
+      std::shared_mutex _lock;
+      std::unordered_map<std::uint32_t, rs_t> _codecs;
+    };
+
+    static rs_cache_t rs_cache;
+
+    reed_solomon *
+    get_rs(size_t data_shards, size_t parity_shards) {
+      return rs_cache.get(data_shards, parity_shards);
+    }
 
+    geometry_t
+    compute_geometry(size_t payload_size, size_t blocksize, size_t fecpercentage, size_t minparityshards) {
       auto pad = payload_size % blocksize != 0;
 
-      auto aligned_data_shards = payload_size / blocksize;
-      auto data_shards = aligned_data_shards + (pad ? 1 : 0);
+      auto data_shards = payload_size / blocksize + (pad ? 1 : 0);
       auto parity_shards = (data_shards * fecpercentage + 99) / 100;
 
       // increase the FEC percentage for this frame if the parity shard minimum is not met
       if (parity_shards < minparityshards && fecpercentage != 0) {
         parity_shards = minparityshards;
         fecpercentage = (100 * parity_shards) / data_shards;
-
-        BOOST_LOG(verbose) << "Increasing FEC percentage to "sv << fecpercentage << " to meet parity shard minimum"sv << std::endl;
       }
 
-      auto nr_shards = data_shards + parity_shards;
+      return { data_shards, parity_shards, fecpercentage };
+    }
 
-      // If we need to store a zero-padded data shard, allocate that first to
-      // to keep the shards in order and reduce buffer fragmentation
-      auto parity_shard_offset = pad ? 1 : 0;
-      util::buffer_t<char> shards { (parity_shard_offset + parity_shards) * blocksize };
-      util::buffer_t<uint8_t *> shards_p { nr_shards };
-      std::vector<platf::buffer_descriptor_t> payload_buffers;
-      payload_buffers.reserve(2);
+    size_t
+    gather_shards(const std::string_view &frame_header, const std::string_view &payload, size_t first_shard, size_t data_shards, size_t blocksize, char *scratch, uint8_t **shards_p) {
+      auto frame_size = frame_header.size() + payload.size();
 
-      // Point into the payload buffer for all except the final padded data shard
-      auto next = std::begin(payload);
-      for (auto x = 0; x < aligned_data_shards; ++x) {
-        shards_p[x] = (uint8_t *) next;
-        next += blocksize;
-      }
-      payload_buffers.emplace_back(std::begin(payload), aligned_data_shards * blocksize);
+      size_t copied = 0;
+      for (size_t x = 0; x < data_shards; ++x) {
+        auto offset = (first_shard + x) * blocksize;
+        if (offset >= frame_header.size() && offset + blocksize <= frame_size) {
+          shards_p[x] = (uint8_t *) &payload[offset - frame_header.size()];
+          continue;
+        }
 
-      // If the last data shard needs to be zero-padded, we must use the shards buffer
-      if (pad) {
-        shards_p[aligned_data_shards] = (uint8_t *) &shards[0];
+        auto shard = &scratch[copied++ * blocksize];
 
-        // GCC doesn't figure out that std::copy_n() can be replaced with memcpy() here
-        // and ends up compiling a horribly slow element-by-element copy loop, so we
-        // help it by using memcpy()/memset() directly.
-        auto copy_len = std::min<size_t>(blocksize, std::end(payload) - next);
-        std::memcpy(shards_p[aligned_data_shards], next, copy_len);
-        if (copy_len < blocksize) {
-          // Zero any additional space after the end of the payload
-          std::memset(shards_p[aligned_data_shards] + copy_len, 0, blocksize - copy_len);
+        size_t len = 0;
+        if (offset < frame_header.size()) {
+          len = std::min(blocksize, frame_header.size() - offset);
+          std::memcpy(shard, &frame_header[offset], len);
         }
+        if (offset + len < frame_size) {
+          auto payload_offset = offset + len - frame_header.size();
+          auto payload_len = std::min(blocksize - len, payload.size() - payload_offset);
+          std::memcpy(shard + len, &payload[payload_offset], payload_len);
+          len += payload_len;
+        }
+
+        // Zero any additional space after the end of the payload
+        std::memset(shard + len, 0, blocksize - len);
+        shards_p[x] = (uint8_t *) shard;
       }
 
-      // Add a payload buffer describing the shard buffer
-      payload_buffers.emplace_back(std::begin(shards), shards.size());
+      return copied;
+    }
 
-      if (fecpercentage != 0) {
-        // Point into our allocated buffer for the parity shards
-        for (auto x = 0; x < parity_shards; ++x) {
-          shards_p[data_shards + x] = (uint8_t *) &shards[(parity_shard_offset + x) * blocksize];
-        }
+    /**
+     * @brief Lay out the shards of a FEC block in its arena, ready for the headers to be filled in.
+     * @param frame_header The bytes sent in front of the payload, if any.
+     * @param payload The frame payload.
+     * @param first_shard The index of the first shard of the block within the frame.
+     * @param block_size The number of frame bytes in the block.
+     * @param blocksize The size of each shard.
+     * @param fecpercentage The requested FEC percentage.
+     * @param minparityshards The minimum number of parity shards requested by the client.
+     * @param prefixsize The size of the header stored in front of each shard.
+     * @param split_headers Whether the headers are packet headers protected by FEC, rather than unprotected prefixes.
+     * @param arena The arena holding everything that doesn't point into the frame.
+     * @return The shards of the block, which stay valid until the arena is reused.
+     */
+    fec_t
+    layout(const std::string_view &frame_header, const std::string_view &payload, size_t first_shard, size_t block_size, size_t blocksize,
+      size_t fecpercentage, size_t minparityshards, size_t prefixsize, bool split_headers, arena_t &arena) {
+      auto geometry = compute_geometry(block_size, blocksize, fecpercentage, minparityshards);
+      auto data_shards = geometry.data_shards;
+      auto parity_shards = geometry.parity_shards;
 
-        // packets = parity_shards + data_shards
-        rs_t rs { reed_solomon_new(data_shards, parity_shards) };
+      if (geometry.percentage != fecpercentage) {
+        fecpercentage = geometry.percentage;
 
-        reed_solomon_encode(rs.get(), shards_p.begin(), nr_shards, blocksize);
+        BOOST_LOG(verbose) << "Increasing FEC percentage to "sv << fecpercentage << " to meet parity shard minimum"sv << std::endl;
+      }
+
+      auto nr_shards = geometry.nr_shards();
+
+      auto headers = reserve(arena.headers, nr_shards * prefixsize);
+      auto headers_p = reserve(arena.headers_p, nr_shards);
+      auto shards = reserve(arena.shards, (2 + parity_shards) * blocksize);
+      auto shards_p = reserve(arena.shards_p, nr_shards);
+
+      std::memset(headers, 0, nr_shards * prefixsize);
+      for (auto x = 0; x < nr_shards; ++x) {
+        headers_p[x] = (uint8_t *) &headers[x * prefixsize];
+      }
+
+      // Copied data shards come first and the parity shards follow them, so the zero-padded
+      // last data shard and the parity shards end up in a single payload buffer
+      auto copied = gather_shards(frame_header, payload, first_shard, data_shards, blocksize, shards, shards_p);
+      for (auto x = 0; x < parity_shards; ++x) {
+        shards_p[data_shards + x] = (uint8_t *) &shards[(copied + x) * blocksize];
+      }
+      std::memset(&shards[copied * blocksize], 0, parity_shards * blocksize);
+
+      // Describe the shards with as few payload buffers as possible
+      auto &payload_buffers = arena.payload_buffers;
+      payload_buffers.clear();
+      for (auto x = 0; x < nr_shards; ++x) {
+        if (!payload_buffers.empty() && payload_buffers.back().buffer + payload_buffers.back().size == (char *) shards_p[x]) {
+          payload_buffers.back().size += blocksize;
+        }
+        else {
+          payload_buffers.emplace_back((char *) shards_p[x], blocksize);
+        }
       }
 
       return {
@@ -932,14 +1106,145 @@ namespace stream {
         fecpercentage,
         blocksize,
         prefixsize,
-        std::move(shards),
-        util::buffer_t<char> { nr_shards * prefixsize },
-        std::move(shards_p),
-        std::move(payload_buffers),
+        split_headers,
+        prefixsize ? headers : nullptr,
+        headers_p,
+        shards_p,
+        &payload_buffers,
       };
     }
+
+    /**
+     * @brief Compute the parity shards of a FEC block.
+     * @details Reed-Solomon works on each byte offset of the shards independently, so encoding the
+     *          split headers and the shard payloads separately yields the same parity as encoding
+     *          packets with the header in front of the payload.
+     * @param shards The FEC block returned by layout(), with the packet headers filled in.
+     */
+    void
+    encode(fec_t &shards) {
+      if (shards.nr_shards == shards.data_shards) {
+        return;
+      }
+
+      // packets = parity_shards + data_shards
+      auto rs = get_rs(shards.data_shards, shards.nr_shards - shards.data_shards);
+      if (!rs) {
+        throw std::runtime_error("Couldn't create Reed-Solomon codec");
+      }
+
+      reed_solomon_encode(rs, shards.shards_p, shards.nr_shards, shards.blocksize);
+      if (shards.split_headers) {
+        reed_solomon_encode(rs, shards.headers_p, shards.nr_shards, shards.prefixsize);
+      }
+    }
+
+    size_t
+    warm_rs_cache(size_t fecpercentage, size_t minparityshards) {
+      if (fecpercentage == 0) {
+        return rs_cache.size();
+      }
+
+      auto max_data_shards_per_fec_block = (DATA_SHARDS_MAX * 100) / (100 + fecpercentage);
+      for (size_t data_shards = 1; data_shards <= max_data_shards_per_fec_block; ++data_shards) {
+        // The block size doesn't affect the shard counts, so any block size will do here
+        auto geometry = compute_geometry(data_shards, 1, fecpercentage, minparityshards);
+        get_rs(geometry.data_shards, geometry.parity_shards);
+      }
+
+      return rs_cache.size();
+    }
   }  // namespace fec
 
+  namespace pacing {
+    // Share of the link that video bursts may use, as with the old fixed rate of 80% of 1 Gbps
+    constexpr int LINK_SHARE_PERCENT = 80;
+
+    // Link speed assumed when the speed of the host interface can't be determined
+    constexpr int DEFAULT_LINK_SPEED = 1000;
+
+    // Bursts are paced at this multiple of the session bitrate, but never slower than MIN_RATE,
+    // so a frame of average size is sent in a small fraction of the frame interval
+    constexpr int BITRATE_MULTIPLIER = 20;
+    constexpr int MIN_RATE = 100;
+
+    // Loss reports scale the rate down to no less than this percentage, and each
+    // report without loss recovers part of the way back
+    constexpr int MIN_LOSS_SCALE = 25;
+    constexpr int LOSS_SCALE_RECOVERY = 5;
+
+    int
+    auto_rate(int link_speed, int bitrate) {
+      if (link_speed <= 0) {
+        link_speed = DEFAULT_LINK_SPEED;
+      }
+
+      auto link_rate = (int) ((std::int64_t) link_speed * LINK_SHARE_PERCENT / 100);
+      auto bitrate_rate = (int) std::max<std::int64_t>((std::int64_t) bitrate * BITRATE_MULTIPLIER / 1000, MIN_RATE);
+
+      return std::max(1, std::min(link_rate, bitrate_rate));
+    }
+
+    int
+    adapt_scale(int scale, int loss_count) {
+      if (loss_count > 0) {
+        return std::max(MIN_LOSS_SCALE, scale * 3 / 4);
+      }
+
+      return std::min(100, scale + LOSS_SCALE_RECOVERY);
+    }
+
+    size_t
+    packets_in_1ms(int rate, size_t blocksize) {
+      //                                       Mbps        ms     byte
+      return std::max<size_t>(1, (size_t) rate * std::mega::num / 1000 / 8 / blocksize);
+    }
+
+    std::chrono::steady_clock::time_point
+    departure_time(std::chrono::steady_clock::time_point frame_start, size_t packets_sent, size_t packets_in_1ms) {
+      return frame_start + std::chrono::duration_cast<std::chrono::nanoseconds>(1ms) * packets_sent / packets_in_1ms;
+    }
+  }  // namespace pacing
+
+  namespace adaptive_fec {
+    // Parity of P-frames never drops below this percentage, or below the configured one if that's lower
+    constexpr int MIN_PERCENTAGE = 5;
+
+    // Each report with loss raises parity by this many points, up to the configured percentage
+    constexpr int LOSS_STEP = 5;
+
+    // Reports without loss needed to lower parity by one point. Moonlight reports
+    // every 50ms, so parity falls from 20% to the minimum in under 8 seconds.
+    constexpr int CLEAN_REPORTS_PER_STEP = 10;
+
+    // The FEC percentage field of a video packet is 8 bits wide
+    constexpr int MAX_FRAME_PERCENTAGE = 255;
+
+    int
+    adapt_percentage(int percentage, int loss_count, int &clean_reports, int max_percentage) {
+      if (loss_count > 0) {
+        clean_reports = 0;
+        return std::min(max_percentage, percentage + LOSS_STEP);
+      }
+
+      if (++clean_reports < CLEAN_REPORTS_PER_STEP) {
+        return percentage;
+      }
+
+      clean_reports = 0;
+      return std::max(std::min(MIN_PERCENTAGE, max_percentage), percentage - 1);
+    }
+
+    int
+    frame_percentage(int percentage, bool key_frame) {
+      if (key_frame) {
+        return std::min(MAX_FRAME_PERCENTAGE, percentage * 2);
+      }
+
+      return percentage;
+    }
+  }  // namespace adaptive_fec
+
   /**
    * @brief Combines two buffers and inserts new buffers at each slice boundary of the result.
    * @param insert_size The number of bytes to insert.
@@ -1209,6 +1514,26 @@ namespace stream {
 
       auto lastGoodFrame = stats[3];
 
+      if (config::stream.adaptive_pacing) {
+        auto &loss_scale = session->video.pacing.loss_scale;
+        auto scale = loss_scale.load(std::memory_order_relaxed);
+        auto new_scale = pacing::adapt_scale(scale, count);
+        if (new_scale != scale) {
+          loss_scale.store(new_scale, std::memory_order_relaxed);
+          BOOST_LOG(verbose) << "Video pacing scaled to "sv << new_scale << '%';
+        }
+      }
+
+      if (config::stream.adaptive_fec) {
+        auto &fec = session->video.fec;
+        auto percentage = fec.percentage.load(std::memory_order_relaxed);
+        auto new_percentage = adaptive_fec::adapt_percentage(percentage, count, fec.clean_reports, config::stream.fec_percentage);
+        if (new_percentage != percentage) {
+          fec.percentage.store(new_percentage, std::memory_order_relaxed);
+          BOOST_LOG(verbose) << "Video FEC changed to "sv << new_percentage << '%';
+        }
+      }
+
       BOOST_LOG(verbose)
         << "type [IDX_LOSS_STATS]"sv << std::endl
         << "---begin stats---" << std::endl
@@ -1437,6 +1762,12 @@ namespace stream {
         << "firstFrame [" << firstFrame << ']' << std::endl
         << "lastFrame [" << lastFrame << ']';
 
+      // The client lost frames that FEC couldn't recover, so protect the following ones as much as allowed
+      if (config::stream.adaptive_fec) {
+        session->video.fec.percentage.store(config::stream.fec_percentage, std::memory_order_relaxed);
+        session->video.fec.clean_reports = 0;
+      }
+
       session->video.invalidate_ref_frames_events->raise(std::make_pair(firstFrame, lastFrame));
     });
 
@@ -1658,6 +1989,35 @@ namespace stream {
     server->flush();
   }
 
+  // The most datagrams drained from a socket per recv_batch() call
+  constexpr auto RECV_BATCH_SIZE = 16;
+
+  /**
+   * @brief Preallocated buffers for draining a socket with platf::recv_batch().
+   */
+  struct recv_batch_t {
+    std::array<std::array<char, 2048>, RECV_BATCH_SIZE> buffers;
+    std::array<platf::received_datagram_t, RECV_BATCH_SIZE> datagrams;
+
+    /**
+     * @brief Receive the datagrams queued on a socket without blocking.
+     * @param sock The socket to drain.
+     * @return The number of datagrams received, or -1 if batched receive isn't available.
+     */
+    int
+    recv(udp::socket &sock) {
+      platf::recv_batch_info_t recv_info {
+        (uintptr_t) sock.native_handle(),
+        buffers[0].data(),
+        buffers[0].size(),
+        datagrams.data(),
+        datagrams.size(),
+      };
+
+      return platf::recv_batch(recv_info);
+    }
+  };
+
   void
   micRecvThread(broadcast_ctx_t &ctx) {
     auto broadcast_shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
@@ -1667,6 +2027,10 @@ namespace stream {
     std::array<char, 2048> mic_recv_buffer;
     bool mic_device_initialized = false;
 
+    // Drain the socket with recvmmsg() where available, one async_receive_from() per packet otherwise
+    auto mic_recv_batch = std::make_unique<recv_batch_t>();
+    bool mic_batched_recv = true;
+
     // 麦克风统计结构体（按客户端地址分组）
     struct MicStats {
       uint64_t total_packets = 0;
@@ -1770,50 +2134,13 @@ namespace stream {
       audio::write_mic_data(audio_data, data_size, sequence_number);
     };
 
-    std::function<void(const boost::system::error_code, size_t)> mic_recv_func;
-    mic_recv_func = [&](const boost::system::error_code &ec, size_t received_bytes) {
-      if (!ctx.mic_socket_enabled.load()) {
-        return;
-      }
-
-      // 致命错误（socket 已关闭/无效）：不重新注册接收，让 mic_io.run() 自然退出
-      if (ec) {
-        if (ec == boost::asio::error::operation_aborted ||
-            ec == boost::asio::error::bad_descriptor ||
-            ec == boost::system::errc::bad_file_descriptor ||
-            ec == boost::system::errc::not_a_socket) {
-          BOOST_LOG(debug) << "Mic socket closed: "sv << ec.message();
-          return;
-        }
-      }
-
-      // fail_guard：在此之后的任何 return 都会重新注册 async_receive_from
-      // 包括瞬态错误（connection_refused/reset）和数据处理
-      auto fg = util::fail_guard([&]() {
-        if (ctx.mic_socket_enabled.load()) {
-          ctx.mic_sock.async_receive_from(asio::buffer(mic_recv_buffer), peer, 0, mic_recv_func);
-        }
-      });
-
-      // 瞬态错误（connection_refused/reset）：记录但继续接收
-      // 这些通常是 ICMP 错误（客户端断开、端口不可达等），不应停止整个接收
-      if (ec) {
-        if (ec == boost::system::errc::connection_refused ||
-            ec == boost::system::errc::connection_reset) {
-          BOOST_LOG(debug) << "Mic socket transient error (ignored): "sv << ec.message();
-        }
-        else {
-          BOOST_LOG(error) << "Mic socket error: "sv << ec.message();
-        }
-        return;  // fail_guard 会重新注册接收
-      }
-
+    auto handle_mic_packet = [&](const char *buf, size_t received_bytes, const udp::endpoint &from) {
       if (received_bytes < sizeof(RTP_PACKET)) {
         return;
       }
 
       // 获取客户端标识：设备名拼接IP地址
-      std::string client_ip = peer.address().to_string();
+      std::string client_ip = from.address().to_string();
       std::string client_id;
       {
         boost::lock_guard<boost::mutex> lg(ctx.client_name_mutex);
@@ -1827,7 +2154,7 @@ namespace stream {
 
       // 尝试16位扩展包类型
       if (received_bytes >= sizeof(rtp_packet_ext_t)) {
-        auto *header_ext = (rtp_packet_ext_t *) mic_recv_buffer.data();
+        auto *header_ext = (rtp_packet_ext_t *) buf;
         if (header_ext->packetType == packetTypes[IDX_MIC_DATA]) {
           size_t header_size = sizeof(rtp_packet_ext_t);
           if (received_bytes > header_size) {
@@ -1836,14 +2163,14 @@ namespace stream {
             // if (!validate_mic_ssrc(ssrc, client_id)) {
             //   return;
             // }
-            process_audio_data(reinterpret_cast<const uint8_t *>(mic_recv_buffer.data()) + header_size, received_bytes - header_size, sequence_number, client_id, client_ip);
+            process_audio_data(reinterpret_cast<const uint8_t *>(buf) + header_size, received_bytes - header_size, sequence_number, client_id, client_ip);
           }
           return;
         }
       }
 
       // 8位包类型
-      auto *header = (mic_packet_t *) mic_recv_buffer.data();
+      auto *header = (mic_packet_t *) buf;
       if (header->rtp.packetType == MIC_PACKET_TYPE_OPUS) {
         size_t header_size = sizeof(mic_packet_t);
         if (received_bytes > header_size) {
@@ -1861,11 +2188,98 @@ namespace stream {
           //                 << " bytes, data=" << data_size 
           //                 << " bytes, sequenceNumber=" << sequence_number << " (little-endian)"
           //                 << " from " << client_id;
-          process_audio_data(reinterpret_cast<const uint8_t *>(mic_recv_buffer.data()) + header_size, data_size, sequence_number, client_id, client_ip);
+          process_audio_data(reinterpret_cast<const uint8_t *>(buf) + header_size, data_size, sequence_number, client_id, client_ip);
         }
       }
     };
 
+    std::function<void(const boost::system::error_code, size_t)> mic_recv_func;
+    std::function<void(const boost::system::error_code)> mic_wait_func;
+
+    // 开始接收：优先批量接收，不支持时回退到逐包接收
+    auto start_mic_recv = [&]() {
+      if (mic_batched_recv) {
+        ctx.mic_sock.async_wait(udp::socket::wait_read, mic_wait_func);
+      }
+      else {
+        ctx.mic_sock.async_receive_from(asio::buffer(mic_recv_buffer), peer, 0, mic_recv_func);
+      }
+    };
+
+    mic_wait_func = [&](const boost::system::error_code &ec) {
+      if (!ctx.mic_socket_enabled.load()) {
+        return;
+      }
+
+      // 等待只会因 socket 关闭而失败，ICMP 等瞬态错误由 recv_batch() 处理
+      if (ec) {
+        BOOST_LOG(debug) << "Mic socket closed: "sv << ec.message();
+        return;
+      }
+
+      auto fg = util::fail_guard([&]() {
+        if (ctx.mic_socket_enabled.load()) {
+          start_mic_recv();
+        }
+      });
+
+      auto &batch = *mic_recv_batch;
+      int count;
+      do {
+        count = batch.recv(ctx.mic_sock);
+        if (count < 0) {
+          BOOST_LOG(debug) << "Batched receive unavailable on mic socket, falling back to unbatched receive"sv;
+          mic_batched_recv = false;
+          return;
+        }
+
+        for (int x = 0; x < count; ++x) {
+          auto &datagram = batch.datagrams[x];
+          handle_mic_packet(batch.buffers[x].data(), datagram.size, udp::endpoint { datagram.address, datagram.port });
+        }
+      } while (count == batch.datagrams.size());
+    };
+
+    mic_recv_func = [&](const boost::system::error_code &ec, size_t received_bytes) {
+      if (!ctx.mic_socket_enabled.load()) {
+        return;
+      }
+
+      // 致命错误（socket 已关闭/无效）：不重新注册接收，让 mic_io.run() 自然退出
+      if (ec) {
+        if (ec == boost::asio::error::operation_aborted ||
+            ec == boost::asio::error::bad_descriptor ||
+            ec == boost::system::errc::bad_file_descriptor ||
+            ec == boost::system::errc::not_a_socket) {
+          BOOST_LOG(debug) << "Mic socket closed: "sv << ec.message();
+          return;
+        }
+      }
+
+      // fail_guard：在此之后的任何 return 都会重新注册 async_receive_from
+      // 包括瞬态错误（connection_refused/reset）和数据处理
+      auto fg = util::fail_guard([&]() {
+        if (ctx.mic_socket_enabled.load()) {
+          start_mic_recv();
+        }
+      });
+
+      // 瞬态错误（connection_refused/reset）：记录但继续接收
+      // 这些通常是 ICMP 错误（客户端断开、端口不可达等），不应停止整个接收
+      if (ec) {
+        if (ec == boost::system::errc::connection_refused ||
+            ec == boost::system::errc::connection_reset) {
+          BOOST_LOG(debug) << "Mic socket transient error (ignored): "sv << ec.message();
+        }
+        else {
+          BOOST_LOG(error) << "Mic socket error: "sv << ec.message();
+        }
+        return;  // fail_guard 会重新注册接收
+      }
+
+      handle_mic_packet(mic_recv_buffer.data(), received_bytes, peer);
+    };
+
     BOOST_LOG(debug) << "Starting microphone receive thread";
 
     auto retry_delay = 300ms;  // 初始重试延迟，指数退避到最大5秒
@@ -1896,7 +2310,7 @@ namespace stream {
         mic_device_initialized = true;
       }
 
-      ctx.mic_sock.async_receive_from(asio::buffer(mic_recv_buffer), peer, 0, mic_recv_func);
+      start_mic_recv();
 
       while (ctx.mic_socket_enabled.load() && !broadcast_shutdown_event->peek()) {
         mic_io.run();
@@ -1926,6 +2340,15 @@ namespace stream {
     BOOST_LOG(debug) << "Microphone receive thread ended";
   }
 
+  /**
+   * @brief Check if the video socket may send with MSG_ZEROCOPY.
+   * @details Completion notifications are numbered per socket, so zero-copy is only tracked when a single thread sends.
+   */
+  static bool
+  video_zerocopy_requested() {
+    return config::stream.zerocopy_send && config::stream.video_send_threads == 0;
+  }
+
   void
   recvThread(broadcast_ctx_t &ctx) {
     std::unordered_map<av_session_id_t, message_queue_t> peer_to_video_session;
@@ -1941,6 +2364,10 @@ namespace stream {
     std::array<std::array<char, 2048>, 2> buffers;
     std::array<std::function<void(const boost::system::error_code, size_t)>, 2> recv_funcs;
 
+    // Sockets are drained with recvmmsg() where available, one async_receive_from() per packet otherwise
+    auto recv_batches = std::make_unique<std::array<recv_batch_t, 2>>();
+    std::array<std::function<void(const boost::system::error_code)>, 2> wait_funcs;
+
     // 统一处理PING包逻辑
     auto handle_ping = [](auto &session_map, auto &peer, auto &buf, size_t bytes, std::string_view type_str) {
       try {
@@ -2023,12 +2450,71 @@ namespace stream {
       };
     };
 
+    // 初始化批量接收函数：socket 可读时一次取出所有排队的数据包
+    auto init_wait_func = [&](auto &sock, size_t buf_idx, auto &session_map, std::string_view type_str) {
+      wait_funcs[buf_idx] = [&, buf_idx, type_str](const boost::system::error_code &ec) {
+        // 等待只会因 socket 关闭而失败，ICMP 等瞬态错误由 recv_batch() 处理
+        if (ec) {
+          if (ec != boost::asio::error::operation_aborted &&
+              ec != boost::asio::error::bad_descriptor) {
+            BOOST_LOG(error) << type_str << " receive error: "sv << ec.message();
+          }
+          return;
+        }
+
+        auto &batch = (*recv_batches)[buf_idx];
+        int count;
+        do {
+          count = batch.recv(sock);
+          if (count < 0) {
+            BOOST_LOG(debug) << "Batched receive unavailable on "sv << type_str << " socket, falling back to unbatched receive"sv;
+            sock.async_receive_from(asio::buffer(buffers[buf_idx]), peer, 0, recv_funcs[buf_idx]);
+            return;
+          }
+
+          if (count > 0) {
+            update_session_map(message_queue_queue, peer_to_video_session, peer_to_audio_session);
+          }
+
+          for (int x = 0; x < count; ++x) {
+            auto &datagram = batch.datagrams[x];
+            auto from = udp::endpoint { datagram.address, datagram.port };
+
+            BOOST_LOG(verbose) << "Recv: "sv << from.address().to_string() << ':' << from.port() << " :: " << type_str;
+            if (datagram.size == 0) {
+              BOOST_LOG(warning) << "Received empty packet";
+            }
+            else {
+              handle_ping(session_map, from, batch.buffers[x], datagram.size, type_str);
+            }
+          }
+        } while (count == batch.datagrams.size());
+
+        try {
+          sock.async_wait(udp::socket::wait_read, wait_funcs[buf_idx]);
+        }
+        catch (const std::exception &e) {
+          BOOST_LOG(error) << "Failed to restart async receive: " << e.what();
+        }
+      };
+    };
+
     try {
       init_recv_func(video_sock, 0, peer_to_video_session, "VIDEO");
       init_recv_func(audio_sock, 1, peer_to_audio_session, "AUDIO");
+      init_wait_func(video_sock, 0, peer_to_video_session, "VIDEO");
+      init_wait_func(audio_sock, 1, peer_to_audio_session, "AUDIO");
 
-      video_sock.async_receive_from(asio::buffer(buffers[0]), peer, 0, recv_funcs[0]);
-      audio_sock.async_receive_from(asio::buffer(buffers[1]), peer, 0, recv_funcs[1]);
+      // Zero-copy completions queued on the video socket keep it flagged with an error until the
+      // sender reaps them at its next frame, which would wake a readiness wait over and over. A
+      // plain receive consumes that wakeup inside the reactor and only completes on a datagram.
+      if (video_zerocopy_requested()) {
+        video_sock.async_receive_from(asio::buffer(buffers[0]), peer, 0, recv_funcs[0]);
+      }
+      else {
+        video_sock.async_wait(udp::socket::wait_read, wait_funcs[0]);
+      }
+      audio_sock.async_wait(udp::socket::wait_read, wait_funcs[1]);
 
       while (!broadcast_shutdown_event->peek()) {
         io.run();
@@ -2039,334 +2525,689 @@ namespace stream {
     }
   }
 
-  void
-  videoBroadcastThread(udp::socket &sock) {
-    auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
-    auto packets = mail::man->queue<video::packet_t>(mail::video_packets);
-    auto video_epoch = std::chrono::steady_clock::now();
+  // There are 2 bits for FEC block count for a maximum of 4 FEC blocks
+  constexpr auto MAX_FEC_BLOCKS = 4;
 
-    // Video traffic is sent on this thread
-    platf::adjust_thread_priority(platf::thread_priority_e::high);
+  // Frames whose zero-copy sends may be pending before the sender waits for the oldest one
+  constexpr auto MAX_ZEROCOPY_FRAMES_IN_FLIGHT = 8;
+
+  /**
+   * @brief State a video send thread carries from one frame to the next.
+   */
+  struct video_sender_t {
+    video_sender_t(udp::socket &sock, std::chrono::steady_clock::time_point video_epoch, thread_pool_util::ThreadPool *fec_pool, bool kernel_pacing):
+        sock { sock },
+        video_epoch { video_epoch },
+        fec_pool { fec_pool },
+        kernel_pacing { kernel_pacing },
+        frame_processing_latency_logger { debug, "Frame processing latency", "ms" },
+        frame_send_batch_latency_logger { debug, "Network: each send_batch() latency" },
+        frame_fec_latency_logger { debug, "Network: each FEC block latency" },
+        frame_encrypt_latency_logger { debug, "Network: each block encryption latency" },
+        frame_network_latency_logger { debug, "Network: frame's overall network latency" },
+        frame_drain_time_logger { debug, "Network: frame drain time", "ms" },
+        frame_syscalls_logger { debug, "Network: system calls per frame", "" },
+        zerocopy_completion_logger { debug, "Network: zero-copy completion latency", "ms" },
+        ratecontrol_next_frame_start { std::chrono::steady_clock::now() },
+        timer { platf::create_high_precision_timer() },
+        fec_arenas { std::make_unique<fec_arenas_t>() } {}
+
+    using fec_arenas_t = std::array<fec::arena_t, MAX_FEC_BLOCKS>;
 
-    logging::min_max_avg_periodic_logger<double> frame_processing_latency_logger(debug, "Frame processing latency", "ms");
+    /**
+     * @brief The buffers of a frame that was sent with MSG_ZEROCOPY.
+     * @details The kernel reads them while the packets are on their way out, so they can't be
+     *          freed or reused until the sends are complete.
+     */
+    struct in_flight_frame_t {
+      // The zero-copy send count once the frame was sent
+      std::uint32_t sends;
+      std::chrono::steady_clock::time_point sent_time;
 
-    logging::time_delta_periodic_logger frame_send_batch_latency_logger(debug, "Network: each send_batch() latency");
-    logging::time_delta_periodic_logger frame_fec_latency_logger(debug, "Network: each FEC block latency");
-    logging::time_delta_periodic_logger frame_network_latency_logger(debug, "Network: frame's overall network latency");
+      video::packet_t packet;
+      std::vector<uint8_t> payload_with_replacements;
+      std::vector<uint8_t> payload_new;
+      std::unique_ptr<fec_arenas_t> fec_arenas;
+    };
 
-    crypto::aes_t iv(12);
+    udp::socket &sock;
+    std::chrono::steady_clock::time_point video_epoch;
 
-    auto timer = platf::create_high_precision_timer();
-    if (!timer || !*timer) {
-      BOOST_LOG(error) << "Failed to create timer, aborting video broadcast thread";
-      return;
-    }
+    // Optional pool used to encode the FEC blocks of multi-block frames in parallel
+    thread_pool_util::ThreadPool *fec_pool;
 
-    auto ratecontrol_next_frame_start = std::chrono::steady_clock::now();
+    // Packets carry their departure times and the kernel paces them, instead of this thread sleeping
+    bool kernel_pacing;
 
-    while (auto packet = packets->pop()) {
-      if (shutdown_event->peek()) {
-        break;
-      }
+    logging::min_max_avg_periodic_logger<double> frame_processing_latency_logger;
 
-      frame_network_latency_logger.first_point_now();
+    logging::time_delta_periodic_logger frame_send_batch_latency_logger;
+    logging::time_delta_periodic_logger frame_fec_latency_logger;
+    logging::time_delta_periodic_logger frame_encrypt_latency_logger;
+    logging::time_delta_periodic_logger frame_network_latency_logger;
+    logging::min_max_avg_periodic_logger<double> frame_drain_time_logger;
+    logging::min_max_avg_periodic_logger<double> frame_syscalls_logger;
+    logging::min_max_avg_periodic_logger<double> zerocopy_completion_logger;
 
-      auto session = (session_t *) packet->channel_data;
-      auto lowseq = session->video.lowseq;
+    // Earliest start of the next frame, so the last ratecontrol group of a frame isn't ignored.
+    // Sessions sharing a send thread share this timeline, so their frames go out one after another
+    // instead of bursting into the NIC at the same time.
+    std::chrono::steady_clock::time_point ratecontrol_next_frame_start;
 
-      std::string_view payload { (char *) packet->data(), packet->data_size() };
-      std::vector<uint8_t> payload_with_replacements;
+    // The packets of the FEC block being sent, encrypted in one batch before they are paced out
+    std::vector<crypto::cipher::gcm_buffer_t> cipher_buffers;
 
-      // Apply replacements on the packet payload before performing any other operations.
-      // We need to know the final frame size to calculate the last packet size, and we
-      // must avoid matching replacements against the frame header or any other non-video
-      // part of the payload.
-      if (packet->is_idr() && packet->replacements) {
-        for (auto &replacement : *packet->replacements) {
-          auto frame_old = replacement.old;
-          auto frame_new = replacement._new;
+    std::unique_ptr<platf::high_precision_timer> timer;
 
-          payload_with_replacements = replace(payload, frame_old, frame_new);
-          payload = { (char *) payload_with_replacements.data(), payload_with_replacements.size() };
-        }
-      }
+    // Packet headers, copied shards and parity shards of each FEC block, reused across frames
+    std::unique_ptr<fec_arenas_t> fec_arenas;
+
+    // Set when packets are sent with MSG_ZEROCOPY. The buffers of each frame are then parked in
+    // in_flight_frames until the kernel is done with them, and their arenas go back to spare_fec_arenas.
+    platf::zerocopy_t *zerocopy = nullptr;
+    std::deque<in_flight_frame_t> in_flight_frames;
+    std::vector<std::unique_ptr<fec_arenas_t>> spare_fec_arenas;
+    bool zerocopy_copied_logged = false;
+  };
+
+  /**
+   * @brief Recycle the buffers of frames whose zero-copy sends are complete.
+   * @details Only blocks once too many frames are in flight, so a stalled link can't pin unbounded memory.
+   * @param sender The state of the calling send thread.
+   */
+  static void
+  reclaim_zerocopy_buffers(video_sender_t &sender) {
+    auto &in_flight = sender.in_flight_frames;
 
-      video_short_frame_header_t frame_header = {};
-      frame_header.headerType = 0x01;  // Short header type
-      frame_header.frameType = packet->is_idr()                     ? 2 :
-                               packet->after_ref_frame_invalidation ? 5 :
-                                                                      1;
-      frame_header.lastPayloadLen = (payload.size() + sizeof(frame_header)) % (session->config.packetsize - sizeof(NV_VIDEO_PACKET));
-      if (frame_header.lastPayloadLen == 0) {
-        frame_header.lastPayloadLen = session->config.packetsize - sizeof(NV_VIDEO_PACKET);
+    while (!in_flight.empty()) {
+      auto &frame = in_flight.front();
+
+      auto timeout = in_flight.size() > MAX_ZEROCOPY_FRAMES_IN_FLIGHT ? 100ms : 0ms;
+      if (sender.zerocopy->wait(frame.sends, timeout)) {
+        auto latency = std::chrono::steady_clock::now() - frame.sent_time;
+        sender.zerocopy_completion_logger.collect_and_log(std::chrono::duration<double, std::milli>(latency).count());
+      }
+      else if (timeout == 0ms) {
+        break;
+      }
+      else {
+        // The pages stay pinned by the kernel, so reusing them can at worst garble packets that are already late
+        BOOST_LOG(warning) << "Zero-copy sends of frame "sv << frame.packet->frame_index() << " didn't complete in time"sv;
       }
 
-      if (packet->frame_timestamp) {
-        auto duration_to_latency = [](const std::chrono::steady_clock::duration &duration) {
-          const auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
-          return (uint16_t) std::clamp<decltype(duration_us)>((duration_us + 50) / 100, 0, std::numeric_limits<uint16_t>::max());
-        };
+      sender.spare_fec_arenas.emplace_back(std::move(frame.fec_arenas));
+      in_flight.pop_front();
+    }
 
-        uint16_t latency = duration_to_latency(std::chrono::steady_clock::now() - *packet->frame_timestamp);
-        frame_header.frame_processing_latency = latency;
-        frame_processing_latency_logger.collect_and_log(latency / 10.);
+    if (!sender.zerocopy_copied_logged && sender.zerocopy->copied() > 0) {
+      BOOST_LOG(info) << "The kernel copies some zero-copy sends, zerocopy_send has little benefit on this route"sv;
+      sender.zerocopy_copied_logged = true;
+    }
+  }
+
+  /**
+   * @brief Packetize a video frame, protect it with FEC and send it to its session.
+   * @param sender The state of the calling send thread.
+   * @param packet The encoded frame.
+   */
+  static void
+  send_video_frame(video_sender_t &sender, video::packet_t &packet) {
+    auto &sock = sender.sock;
+    auto &video_epoch = sender.video_epoch;
+    auto fec_pool = sender.fec_pool;
+    auto &frame_processing_latency_logger = sender.frame_processing_latency_logger;
+    auto &frame_send_batch_latency_logger = sender.frame_send_batch_latency_logger;
+    auto &frame_fec_latency_logger = sender.frame_fec_latency_logger;
+    auto &frame_encrypt_latency_logger = sender.frame_encrypt_latency_logger;
+    auto &frame_network_latency_logger = sender.frame_network_latency_logger;
+    auto &frame_drain_time_logger = sender.frame_drain_time_logger;
+    auto &cipher_buffers = sender.cipher_buffers;
+    auto &timer = sender.timer;
+
+    if (sender.zerocopy) {
+      reclaim_zerocopy_buffers(sender);
+    }
+
+    // The arenas of the previous frame may still be in flight
+    if (!sender.fec_arenas) {
+      if (sender.spare_fec_arenas.empty()) {
+        sender.fec_arenas = std::make_unique<video_sender_t::fec_arenas_t>();
       }
       else {
-        frame_header.frame_processing_latency = 0;
+        sender.fec_arenas = std::move(sender.spare_fec_arenas.back());
+        sender.spare_fec_arenas.pop_back();
+      }
+    }
+    auto &fec_arenas = *sender.fec_arenas;
+
+    frame_network_latency_logger.first_point_now();
+
+    auto session = (session_t *) packet->channel_data;
+    auto lowseq = session->video.lowseq;
+    auto &pacing_state = session->video.pacing;
+    auto &ratecontrol_next_frame_start = sender.ratecontrol_next_frame_start;
+
+    std::string_view payload { (char *) packet->data(), packet->data_size() };
+    std::vector<uint8_t> payload_with_replacements;
+
+    // Apply replacements on the packet payload before performing any other operations.
+    // We need to know the final frame size to calculate the last packet size, and we
+    // must avoid matching replacements against the frame header or any other non-video
+    // part of the payload.
+    if (packet->is_idr() && packet->replacements) {
+      for (auto &replacement : *packet->replacements) {
+        auto frame_old = replacement.old;
+        auto frame_new = replacement._new;
+
+        payload_with_replacements = replace(payload, frame_old, frame_new);
+        payload = { (char *) payload_with_replacements.data(), payload_with_replacements.size() };
       }
+    }
+
+    video_short_frame_header_t frame_header = {};
+    frame_header.headerType = 0x01;  // Short header type
+    frame_header.frameType = packet->is_idr()                     ? 2 :
+                             packet->after_ref_frame_invalidation ? 5 :
+                                                                    1;
+    frame_header.lastPayloadLen = (payload.size() + sizeof(frame_header)) % (session->config.packetsize - sizeof(NV_VIDEO_PACKET));
+    if (frame_header.lastPayloadLen == 0) {
+      frame_header.lastPayloadLen = session->config.packetsize - sizeof(NV_VIDEO_PACKET);
+    }
+
+    if (packet->frame_timestamp) {
+      auto duration_to_latency = [](const std::chrono::steady_clock::duration &duration) {
+        const auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        return (uint16_t) std::clamp<decltype(duration_us)>((duration_us + 50) / 100, 0, std::numeric_limits<uint16_t>::max());
+      };
+
+      uint16_t latency = duration_to_latency(std::chrono::steady_clock::now() - *packet->frame_timestamp);
+      frame_header.frame_processing_latency = latency;
+      frame_processing_latency_logger.collect_and_log(latency / 10.);
+    }
+    else {
+      frame_header.frame_processing_latency = 0;
+    }
 
-      auto fecPercentage = config::stream.fec_percentage;
+    auto fecPercentage = config::stream.fec_percentage;
+    if (config::stream.adaptive_fec) {
+      fecPercentage = adaptive_fec::frame_percentage(session->video.fec.percentage.load(std::memory_order_relaxed),
+        packet->is_idr() || packet->after_ref_frame_invalidation);
+    }
+
+    auto blocksize = session->config.packetsize + MAX_RTP_HEADER_SIZE;
+    auto payload_blocksize = blocksize - sizeof(video_packet_raw_t);
 
-      // Insert space for packet headers
-      auto blocksize = session->config.packetsize + MAX_RTP_HEADER_SIZE;
-      auto payload_blocksize = blocksize - sizeof(video_packet_raw_t);
-      auto payload_new = concat_and_insert(sizeof(video_packet_raw_t), payload_blocksize,
+    // Without encryption, the data shards point straight into the encoded frame and the packet
+    // headers are sent from the FEC arenas. Encrypted packets are built in place, so they
+    // still need a copy of the frame with space inserted for the packet headers.
+    bool split_headers = !session->video.cipher;
+
+    std::string_view frame_prefix;
+    std::vector<uint8_t> payload_new;
+    size_t shard_size;
+    if (split_headers) {
+      frame_prefix = std::string_view { (char *) &frame_header, sizeof(frame_header) };
+      shard_size = payload_blocksize;
+    }
+    else {
+      payload_new = concat_and_insert(sizeof(video_packet_raw_t), payload_blocksize,
         std::string_view { (char *) &frame_header, sizeof(frame_header) }, payload);
 
       payload = std::string_view { (char *) payload_new.data(), payload_new.size() };
+      shard_size = blocksize;
+    }
+
+    // The number of frame bytes to send, and the size they occupy on the wire with packet headers
+    auto frame_size = frame_prefix.size() + payload.size();
+    auto wire_size = frame_size;
+    if (split_headers) {
+      wire_size += ((frame_size + (shard_size - 1)) / shard_size) * sizeof(video_packet_raw_t);
+    }
+
+    // The max number of data shards per block is found by solving this system of equations for D:
+    // D = 255 - P
+    // P = D * F
+    // which results in the solution:
+    // D = 255 / (1 + F)
+    // multiplied by 100 since F is the percentage as an integer:
+    // D = (255 * 100) / (100 + F)
+    auto max_data_shards_per_fec_block = (DATA_SHARDS_MAX * 100) / (100 + fecPercentage);
+
+    // Compute the number of FEC blocks needed for this frame using the block size and max shards
+    auto max_data_per_fec_block = max_data_shards_per_fec_block * blocksize;
+    auto fec_blocks_needed = (wire_size + (max_data_per_fec_block - 1)) / max_data_per_fec_block;
+
+    // If the number of FEC blocks needed exceeds the protocol limit, turn off FEC for this frame.
+    // For normal FEC percentages, this should only happen for enormous frames (over 800 packets at 20%).
+    if (fec_blocks_needed > MAX_FEC_BLOCKS) {
+      BOOST_LOG(warning) << "Skipping FEC for abnormally large encoded frame (needed "sv << fec_blocks_needed << " FEC blocks)"sv;
+      fecPercentage = 0;
+      fec_blocks_needed = MAX_FEC_BLOCKS;
+    }
 
-      // There are 2 bits for FEC block count for a maximum of 4 FEC blocks
-      constexpr auto MAX_FEC_BLOCKS = 4;
+    BOOST_LOG(verbose) << "Generating "sv << fec_blocks_needed << " FEC blocks"sv;
 
-      // The max number of data shards per block is found by solving this system of equations for D:
-      // D = 255 - P
-      // P = D * F
-      // which results in the solution:
-      // D = 255 / (1 + F)
-      // multiplied by 100 since F is the percentage as an integer:
-      // D = (255 * 100) / (100 + F)
-      auto max_data_shards_per_fec_block = (DATA_SHARDS_MAX * 100) / (100 + fecPercentage);
+    // Align individual FEC blocks to blocksize
+    auto unaligned_size = wire_size / fec_blocks_needed;
+    auto shards_per_block = (unaligned_size + (blocksize - 1)) / blocksize;
 
-      // Compute the number of FEC blocks needed for this frame using the block size and max shards
-      auto max_data_per_fec_block = max_data_shards_per_fec_block * blocksize;
-      auto fec_blocks_needed = (payload.size() + (max_data_per_fec_block - 1)) / max_data_per_fec_block;
+    // If we exceed the 10-bit FEC packet index (which means our frame exceeded 4096 packets),
+    // the frame will be unrecoverable. Log an error for this case.
+    if (shards_per_block >= 1024) {
+      BOOST_LOG(error) << "Encoder produced a frame too large to send! Is the encoder broken? (needed "sv << shards_per_block << " packets)"sv;
+    }
 
-      // If the number of FEC blocks needed exceeds the protocol limit, turn off FEC for this frame.
-      // For normal FEC percentages, this should only happen for enormous frames (over 800 packets at 20%).
-      if (fec_blocks_needed > MAX_FEC_BLOCKS) {
-        BOOST_LOG(warning) << "Skipping FEC for abnormally large encoded frame (needed "sv << fec_blocks_needed << " FEC blocks)"sv;
-        fecPercentage = 0;
-        fec_blocks_needed = MAX_FEC_BLOCKS;
+    // Keep the buffers alive while the kernel may still be reading them, even if sending failed halfway
+    auto zerocopy_sends = sender.zerocopy ? sender.zerocopy->sends() : 0;
+    auto park_zerocopy_buffers = util::fail_guard([&]() {
+      if (!sender.zerocopy || sender.zerocopy->sends() == zerocopy_sends) {
+        return;
       }
 
-      std::array<std::string_view, MAX_FEC_BLOCKS> fec_blocks;
-      decltype(fec_blocks)::iterator
-        fec_blocks_begin = std::begin(fec_blocks),
-        fec_blocks_end = std::begin(fec_blocks) + fec_blocks_needed;
+      sender.in_flight_frames.emplace_back(video_sender_t::in_flight_frame_t {
+        sender.zerocopy->sends(),
+        std::chrono::steady_clock::now(),
+        std::move(packet),
+        std::move(payload_with_replacements),
+        std::move(payload_new),
+        std::move(sender.fec_arenas),
+      });
+    });
 
-      BOOST_LOG(verbose) << "Generating "sv << fec_blocks_needed << " FEC blocks"sv;
+    size_t frame_syscalls = 0;
 
-      // Align individual FEC blocks to blocksize
-      auto unaligned_size = payload.size() / fec_blocks_needed;
-      auto aligned_size = ((unaligned_size + (blocksize - 1)) / blocksize) * blocksize;
+    try {
+      // Pace at the configured rate, or at one derived from the link speed and the session bitrate,
+      // scaled down while the client reports packet loss
+      auto pacing_rate = config::stream.pacing_rate > 0 ?
+                           config::stream.pacing_rate :
+                           pacing::auto_rate(pacing_state.link_speed, session->current_total_bitrate.load(std::memory_order_relaxed));
+      pacing_rate = std::max(1, pacing_rate * pacing_state.loss_scale.load(std::memory_order_relaxed) / 100);
+      pacing_state.rate.store(pacing_rate, std::memory_order_relaxed);
+
+      size_t ratecontrol_packets_in_1ms = pacing::packets_in_1ms(pacing_rate, blocksize);
+
+      // Send less than 64K in a single batch.
+      // On Windows, batches above 64K seem to bypass SO_SNDBUF regardless of its size,
+      // appear in "Other I/O" and begin waiting for interrupts.
+      // This gives inconsistent performance so we'd rather avoid it.
+      size_t send_batch_size = 64 * 1024 / blocksize;
+      // Also don't exceed 64 packets, which can happen when Moonlight requests
+      // unusually small packet size.
+      // Generic Segmentation Offload on Linux can't do more than 64.
+      send_batch_size = std::min<size_t>(64, send_batch_size);
+
+      // Don't ignore the last ratecontrol group of the previous frame
+      auto ratecontrol_frame_start = std::max(ratecontrol_next_frame_start, std::chrono::steady_clock::now());
+
+      size_t ratecontrol_frame_packets_sent = 0;
+      size_t ratecontrol_group_packets_sent = 0;
+
+      // If video encryption is enabled, we allocate space for the encryption header before each shard
+      size_t prefixsize = session->video.cipher ? sizeof(video_packet_enc_prefix_t) : 0;
+      size_t minparityshards = session->config.minRequiredFecPackets;
+
+      std::array<fec::fec_t, MAX_FEC_BLOCKS> fec_shards;
+      std::array<std::future<void>, MAX_FEC_BLOCKS> fec_futures;
+      auto wait_for_fec = util::fail_guard([&]() {
+        // Data shards point into the frame and the arenas, so every queued block must be done before they go away
+        for (auto &future : fec_futures) {
+          if (future.valid()) {
+            future.wait();
+          }
+        }
+      });
 
-      // If we exceed the 10-bit FEC packet index (which means our frame exceeded 4096 packets),
-      // the frame will be unrecoverable. Log an error for this case.
-      if (aligned_size / blocksize >= 1024) {
-        BOOST_LOG(error) << "Encoder produced a frame too large to send! Is the encoder broken? (needed "sv << (aligned_size / blocksize) << " packets)"sv;
+      // Fill in the packet headers of all FEC blocks up front. The sequence numbers of a block
+      // only depend on the shard counts of the blocks before it, so every block can be
+      // handed to the FEC workers before the first one is sent.
+      auto block_lowseq = lowseq;
+      for (int blockIndex = 0; blockIndex < fec_blocks_needed; ++blockIndex) {
+        // Split the data into aligned FEC blocks, the last block extending to the end of the payload
+        auto first_shard = blockIndex * shards_per_block;
+        auto block_size = blockIndex == fec_blocks_needed - 1 ?
+                            frame_size - first_shard * shard_size :
+                            shards_per_block * shard_size;
+
+        auto &shards = fec_shards[blockIndex] = fec::layout(frame_prefix, payload, first_shard, block_size, shard_size,
+          fecPercentage, minparityshards, split_headers ? sizeof(video_packet_raw_t) : prefixsize, split_headers, fec_arenas[blockIndex]);
+        auto packets = shards.data_shards;
+
+        for (int x = 0; x < packets; ++x) {
+          auto *inspect = (video_packet_raw_t *) shards.header(x);
+
+          inspect->packet.frameIndex = packet->frame_index();
+          inspect->packet.streamPacketIndex = ((uint32_t) block_lowseq + x) << 8;
+
+          // Match multiFecFlags with Moonlight
+          inspect->packet.multiFecFlags = 0x10;
+          inspect->packet.multiFecBlocks = (blockIndex << 4) | ((fec_blocks_needed - 1) << 6);
+
+          inspect->packet.flags = FLAG_CONTAINS_PIC_DATA;
+          if (x == 0) {
+            inspect->packet.flags |= FLAG_SOF;
+          }
+          if (x == packets - 1) {
+            inspect->packet.flags |= FLAG_EOF;
+          }
+        }
+
+        block_lowseq += shards.size();
+
+        if (fec_pool && fec_blocks_needed > 1) {
+          fec_futures[blockIndex] = fec_pool->push([&shards]() {
+            fec::encode(shards);
+          });
+        }
       }
 
-      // Split the data into aligned FEC blocks
-      for (int x = 0; x < fec_blocks_needed; ++x) {
-        if (x == fec_blocks_needed - 1) {
-          // The last block must extend to the end of the payload
-          fec_blocks[x] = payload.substr(x * aligned_size);
+      for (int blockIndex = 0; blockIndex < fec_blocks_needed; ++blockIndex) {
+        auto &shards = fec_shards[blockIndex];
+
+        frame_fec_latency_logger.first_point_now();
+        // Block N goes out as soon as its parity is ready, while later blocks are still being encoded
+        if (fec_futures[blockIndex].valid()) {
+          fec_futures[blockIndex].get();
         }
         else {
-          // Earlier blocks just extend to the next block offset
-          fec_blocks[x] = payload.substr(x * aligned_size, aligned_size);
+          fec::encode(shards);
         }
-      }
+        frame_fec_latency_logger.second_point_now_and_log();
+
+        auto peer_address = session->video.peer.address();
+        auto batch_info = platf::batched_send_info_t {
+          shards.headers,
+          shards.prefixsize,
+          *shards.payload_buffers,
+          shards.blocksize,
+          0,
+          0,
+          (uintptr_t) sock.native_handle(),
+          peer_address,
+          session->video.peer.port(),
+          session->localAddress,
+        };
+        batch_info.zerocopy = sender.zerocopy;
 
-      try {
-        // Use around 80% of 1Gbps          1Gbps            percent    ms     packet      byte
-        size_t ratecontrol_packets_in_1ms = std::giga::num * 80 / 100 / 1000 / blocksize / 8;
-
-        // Send less than 64K in a single batch.
-        // On Windows, batches above 64K seem to bypass SO_SNDBUF regardless of its size,
-        // appear in "Other I/O" and begin waiting for interrupts.
-        // This gives inconsistent performance so we'd rather avoid it.
-        size_t send_batch_size = 64 * 1024 / blocksize;
-        // Also don't exceed 64 packets, which can happen when Moonlight requests
-        // unusually small packet size.
-        // Generic Segmentation Offload on Linux can't do more than 64.
-        send_batch_size = std::min<size_t>(64, send_batch_size);
-
-        // Don't ignore the last ratecontrol group of the previous frame
-        auto ratecontrol_frame_start = std::max(ratecontrol_next_frame_start, std::chrono::steady_clock::now());
-
-        size_t ratecontrol_frame_packets_sent = 0;
-        size_t ratecontrol_group_packets_sent = 0;
-
-        auto blockIndex = 0;
-        std::for_each(fec_blocks_begin, fec_blocks_end, [&](std::string_view &current_payload) {
-          auto packets = (current_payload.size() + (blocksize - 1)) / blocksize;
-
-          for (int x = 0; x < packets; ++x) {
-            auto *inspect = (video_packet_raw_t *) &current_payload[x * blocksize];
-
-            inspect->packet.frameIndex = packet->frame_index();
-            inspect->packet.streamPacketIndex = ((uint32_t) lowseq + x) << 8;
-
-            // Match multiFecFlags with Moonlight
-            inspect->packet.multiFecFlags = 0x10;
-            inspect->packet.multiFecBlocks = (blockIndex << 4) | ((fec_blocks_needed - 1) << 6);
-
-            inspect->packet.flags = FLAG_CONTAINS_PIC_DATA;
-            if (x == 0) {
-              inspect->packet.flags |= FLAG_SOF;
-            }
-            if (x == packets - 1) {
-              inspect->packet.flags |= FLAG_EOF;
-            }
+        size_t next_shard_to_send = 0;
+
+        // RTP video timestamps use a 90 KHz clock and the frame_timestamp from when the frame was captured
+        // When a timestamp isn't available (duplicate frames), the timestamp from rate control is used instead.
+        bool frame_is_dupe = false;
+        if (!packet->frame_timestamp) {
+          packet->frame_timestamp = ratecontrol_next_frame_start;
+          frame_is_dupe = true;
+        }
+        using rtp_tick = std::chrono::duration<uint32_t, std::ratio<1, 90000>>;
+        uint32_t timestamp = std::chrono::round<rtp_tick>(*packet->frame_timestamp - video_epoch).count();
+
+        // set FEC info now that we know for sure what our percentage will be for this frame
+        cipher_buffers.clear();
+        for (auto x = 0; x < shards.size(); ++x) {
+          auto *inspect = (video_packet_raw_t *) shards.header(x);
+
+          inspect->packet.fecInfo =
+            (x << 12 |
+              shards.data_shards << 22 |
+              shards.percentage << 4);
+
+          inspect->rtp.header = 0x80 | FLAG_EXTENSION;
+          inspect->rtp.sequenceNumber = util::endian::big<uint16_t>(lowseq + x);
+          inspect->rtp.timestamp = util::endian::big<uint32_t>(timestamp);
+
+          inspect->packet.multiFecBlocks = (blockIndex << 4) | ((fec_blocks_needed - 1) << 6);
+          inspect->packet.frameIndex = packet->frame_index();
+
+          // Queue this shard for encryption if video encryption is enabled
+          if (session->video.cipher) {
+            // We use the deterministic IV construction algorithm specified in NIST SP 800-38D
+            // Section 8.2.1. The sequence number is our "invocation" field and the 'V' in the
+            // high bytes is the "fixed" field. Because each client provides their own unique
+            // key, our values in the fixed field need only uniquely identify each independent
+            // use of the client's key with AES-GCM in our code.
+            //
+            // The IV counter is 64 bits long which allows for 2^64 encrypted video packets
+            // to be sent to each client before the IV repeats.
+            auto *prefix = (video_packet_enc_prefix_t *) shards.prefix(x);
+            prefix->frameNumber = packet->frame_index();
+            std::fill(std::begin(prefix->iv), std::end(prefix->iv), 0);
+            std::copy_n((uint8_t *) &session->video.gcm_iv_counter, sizeof(session->video.gcm_iv_counter), std::begin(prefix->iv));
+            prefix->iv[11] = 'V';  // Video stream
+            session->video.gcm_iv_counter++;
+
+            // Encrypt the target buffer in place
+            cipher_buffers.emplace_back(crypto::cipher::gcm_buffer_t {
+              std::string_view { (char *) inspect, (size_t) blocksize },
+              prefix->tag,
+              (uint8_t *) inspect,
+              prefix->iv,
+            });
           }
+        }
 
-          frame_fec_latency_logger.first_point_now();
-          // If video encryption is enabled, we allocate space for the encryption header before each shard
-          auto shards = fec::encode(current_payload, blocksize, fecPercentage, session->config.minRequiredFecPackets,
-            session->video.cipher ? sizeof(video_packet_enc_prefix_t) : 0);
-          frame_fec_latency_logger.second_point_now_and_log();
-
-          auto peer_address = session->video.peer.address();
-          auto batch_info = platf::batched_send_info_t {
-            shards.headers.begin(),
-            shards.prefixsize,
-            shards.payload_buffers,
-            shards.blocksize,
-            0,
-            0,
-            (uintptr_t) sock.native_handle(),
-            peer_address,
-            session->video.peer.port(),
-            session->localAddress,
-          };
-
-          size_t next_shard_to_send = 0;
-
-          // RTP video timestamps use a 90 KHz clock and the frame_timestamp from when the frame was captured
-          // When a timestamp isn't available (duplicate frames), the timestamp from rate control is used instead.
-          bool frame_is_dupe = false;
-          if (!packet->frame_timestamp) {
-            packet->frame_timestamp = ratecontrol_next_frame_start;
-            frame_is_dupe = true;
+        // Encrypt the whole block up front, so pacing only waits on the network
+        if (!cipher_buffers.empty()) {
+          frame_encrypt_latency_logger.first_point_now();
+          if (session->video.cipher->encrypt(cipher_buffers) != cipher_buffers.size()) {
+            BOOST_LOG(error) << "Failed to encrypt video packets"sv;
           }
-          using rtp_tick = std::chrono::duration<uint32_t, std::ratio<1, 90000>>;
-          uint32_t timestamp = std::chrono::round<rtp_tick>(*packet->frame_timestamp - video_epoch).count();
-
-          // set FEC info now that we know for sure what our percentage will be for this frame
-          for (auto x = 0; x < shards.size(); ++x) {
-            auto *inspect = (video_packet_raw_t *) shards.data(x);
-
-            inspect->packet.fecInfo =
-              (x << 12 |
-                shards.data_shards << 22 |
-                shards.percentage << 4);
-
-            inspect->rtp.header = 0x80 | FLAG_EXTENSION;
-            inspect->rtp.sequenceNumber = util::endian::big<uint16_t>(lowseq + x);
-            inspect->rtp.timestamp = util::endian::big<uint32_t>(timestamp);
-
-            inspect->packet.multiFecBlocks = (blockIndex << 4) | ((fec_blocks_needed - 1) << 6);
-            inspect->packet.frameIndex = packet->frame_index();
-
-            // Encrypt this shard if video encryption is enabled
-            if (session->video.cipher) {
-              // We use the deterministic IV construction algorithm specified in NIST SP 800-38D
-              // Section 8.2.1. The sequence number is our "invocation" field and the 'V' in the
-              // high bytes is the "fixed" field. Because each client provides their own unique
-              // key, our values in the fixed field need only uniquely identify each independent
-              // use of the client's key with AES-GCM in our code.
-              //
-              // The IV counter is 64 bits long which allows for 2^64 encrypted video packets
-              // to be sent to each client before the IV repeats.
-              std::copy_n((uint8_t *) &session->video.gcm_iv_counter, sizeof(session->video.gcm_iv_counter), std::begin(iv));
-              iv[11] = 'V';  // Video stream
-              session->video.gcm_iv_counter++;
-
-              // Encrypt the target buffer in place
-              auto *prefix = (video_packet_enc_prefix_t *) shards.prefix(x);
-              prefix->frameNumber = packet->frame_index();
-              std::copy(std::begin(iv), std::end(iv), prefix->iv);
-              session->video.cipher->encrypt(std::string_view { (char *) inspect, (size_t) blocksize },
-                prefix->tag, (uint8_t *) inspect, &iv);
-            }
+          frame_encrypt_latency_logger.second_point_now_and_log();
+        }
 
-            if (x - next_shard_to_send + 1 >= send_batch_size ||
-                x + 1 == shards.size()) {
-              // Do pacing within the frame.
-              // Also trigger pacing before the first send_batch() of the frame
-              // to account for the last send_batch() of the previous frame.
-              if (ratecontrol_group_packets_sent >= ratecontrol_packets_in_1ms ||
-                  ratecontrol_frame_packets_sent == 0) {
-                auto due = ratecontrol_frame_start +
-                           std::chrono::duration_cast<std::chrono::nanoseconds>(1ms) *
-                             ratecontrol_frame_packets_sent / ratecontrol_packets_in_1ms;
-
-                auto now = std::chrono::steady_clock::now();
-                if (now < due) {
-                  timer->sleep_for(due - now);
-                }
-
-                ratecontrol_group_packets_sent = 0;
+        for (auto x = 0; x < shards.size(); ++x) {
+          if (x - next_shard_to_send + 1 >= send_batch_size ||
+              x + 1 == shards.size()) {
+            // With kernel pacing, stamp the batch with the departure time of its first packet
+            // and let the kernel hold packets until they are due.
+            if (sender.kernel_pacing) {
+              batch_info.send_time = pacing::departure_time(ratecontrol_frame_start, ratecontrol_frame_packets_sent, ratecontrol_packets_in_1ms);
+              batch_info.send_interval = std::chrono::duration_cast<std::chrono::nanoseconds>(1ms) / ratecontrol_packets_in_1ms;
+            }
+            // Do pacing within the frame.
+            // Also trigger pacing before the first send_batch() of the frame
+            // to account for the last send_batch() of the previous frame.
+            else if (ratecontrol_group_packets_sent >= ratecontrol_packets_in_1ms ||
+                     ratecontrol_frame_packets_sent == 0) {
+              auto due = pacing::departure_time(ratecontrol_frame_start, ratecontrol_frame_packets_sent, ratecontrol_packets_in_1ms);
+
+              auto now = std::chrono::steady_clock::now();
+              if (now < due) {
+                timer->sleep_for(due - now);
               }
 
-              size_t current_batch_size = x - next_shard_to_send + 1;
-              batch_info.block_offset = next_shard_to_send;
-              batch_info.block_count = current_batch_size;
-
-              frame_send_batch_latency_logger.first_point_now();
-              // Use a batched send if it's supported on this platform
-              if (!platf::send_batch(batch_info)) {
-                // Batched send is not available, so send each packet individually
-                BOOST_LOG(verbose) << "Falling back to unbatched send"sv;
-                for (auto y = 0; y < current_batch_size; y++) {
-                  auto send_info = platf::send_info_t {
-                    shards.prefix(next_shard_to_send + y),
-                    shards.prefixsize,
-                    shards.data(next_shard_to_send + y),
-                    shards.blocksize,
-                    (uintptr_t) sock.native_handle(),
-                    peer_address,
-                    session->video.peer.port(),
-                    session->localAddress,
-                  };
-
-                  platf::send(send_info);
-                }
-              }
-              frame_send_batch_latency_logger.second_point_now_and_log();
+              ratecontrol_group_packets_sent = 0;
+            }
 
-              ratecontrol_group_packets_sent += current_batch_size;
-              ratecontrol_frame_packets_sent += current_batch_size;
-              next_shard_to_send = x + 1;
+            size_t current_batch_size = x - next_shard_to_send + 1;
+            batch_info.block_offset = next_shard_to_send;
+            batch_info.block_count = current_batch_size;
+
+            frame_send_batch_latency_logger.first_point_now();
+            // Use a batched send if it's supported on this platform
+            if (!platf::send_batch(batch_info)) {
+              // Batched send is not available, so send each packet individually
+              BOOST_LOG(verbose) << "Falling back to unbatched send"sv;
+              for (auto y = 0; y < current_batch_size; y++) {
+                auto send_info = platf::send_info_t {
+                  shards.prefix(next_shard_to_send + y),
+                  shards.prefixsize,
+                  shards.data(next_shard_to_send + y),
+                  shards.blocksize,
+                  (uintptr_t) sock.native_handle(),
+                  peer_address,
+                  session->video.peer.port(),
+                  session->localAddress,
+                };
+
+                platf::send(send_info);
+              }
             }
+            frame_send_batch_latency_logger.second_point_now_and_log();
+
+            ratecontrol_group_packets_sent += current_batch_size;
+            ratecontrol_frame_packets_sent += current_batch_size;
+            next_shard_to_send = x + 1;
           }
+        }
+
+        // remember this in case the next frame comes immediately
+        ratecontrol_next_frame_start = pacing::departure_time(ratecontrol_frame_start, ratecontrol_frame_packets_sent, ratecontrol_packets_in_1ms);
+
+        frame_network_latency_logger.second_point_now_and_log();
+        frame_syscalls += batch_info.syscalls;
+
+        BOOST_LOG(verbose) << "Sent Frame seq ["sv << packet->frame_index() << "] pts ["sv << timestamp
+                           << "] shards ["sv << shards.size() << "/"sv << shards.percentage << "%]"sv
+                           << (frame_is_dupe ? " Dupe" : "")
+                           << (packet->is_idr() ? " Key" : "")
+                           << (packet->after_ref_frame_invalidation ? " RFI" : "");
+
+        lowseq += shards.size();
+      }
 
-          // remember this in case the next frame comes immediately
-          ratecontrol_next_frame_start = ratecontrol_frame_start +
-                                         std::chrono::duration_cast<std::chrono::nanoseconds>(1ms) *
-                                           ratecontrol_frame_packets_sent / ratecontrol_packets_in_1ms;
+      session->video.lowseq = lowseq;
 
-          frame_network_latency_logger.second_point_now_and_log();
+      // With kernel pacing the sends return right away, so the frame drains when its last packet is due
+      auto drain_end = sender.kernel_pacing ? ratecontrol_next_frame_start : std::chrono::steady_clock::now();
+      auto drain_time = std::max(drain_end - ratecontrol_frame_start, std::chrono::steady_clock::duration::zero());
+      pacing_state.drain_time_us.store(std::chrono::duration_cast<std::chrono::microseconds>(drain_time).count(), std::memory_order_relaxed);
+      frame_drain_time_logger.collect_and_log(std::chrono::duration<double, std::milli>(drain_time).count());
+      sender.frame_syscalls_logger.collect_and_log(frame_syscalls);
 
-          BOOST_LOG(verbose) << "Sent Frame seq ["sv << packet->frame_index() << "] pts ["sv << timestamp
-                             << "] shards ["sv << shards.size() << "/"sv << shards.percentage << "%]"sv
-                             << (frame_is_dupe ? " Dupe" : "")
-                             << (packet->is_idr() ? " Key" : "")
-                             << (packet->after_ref_frame_invalidation ? " RFI" : "");
+      // Exponentially weighted, so the figures follow the last few seconds of the stream
+      auto &frame_interval = session->video.frame_interval;
+      if (frame_interval.last_frame_start != std::chrono::steady_clock::time_point {}) {
+        auto interval_ms = std::chrono::duration<double, std::milli>(ratecontrol_frame_start - frame_interval.last_frame_start).count();
+        if (frame_interval.avg_ms == 0) {
+          frame_interval.avg_ms = interval_ms;
+        }
 
-          ++blockIndex;
-          lowseq += shards.size();
-        });
+        constexpr double weight = 1.0 / 32;
+        auto deviation = interval_ms - frame_interval.avg_ms;
+        frame_interval.avg_ms += deviation * weight;
+        frame_interval.variance = (1 - weight) * (frame_interval.variance + deviation * deviation * weight);
 
-        session->video.lowseq = lowseq;
+        frame_interval.avg_us.store(std::llround(frame_interval.avg_ms * 1000), std::memory_order_relaxed);
+        frame_interval.stddev_us.store(std::llround(std::sqrt(frame_interval.variance) * 1000), std::memory_order_relaxed);
       }
-      catch (const std::exception &e) {
-        BOOST_LOG(error) << "Broadcast video failed "sv << e.what();
-        std::this_thread::sleep_for(100ms);
+      frame_interval.last_frame_start = ratecontrol_frame_start;
+
+      if (packet->is_idr() && session->video.first_idr_us.load(std::memory_order_relaxed) == 0) {
+        auto time_to_idr = std::chrono::steady_clock::now() - session->video.capture_start;
+        session->video.first_idr_us.store(std::chrono::duration_cast<std::chrono::microseconds>(time_to_idr).count(), std::memory_order_relaxed);
+        BOOST_LOG(info) << "Time to first IDR frame: "sv << std::chrono::duration<double, std::milli>(time_to_idr).count() << "ms"sv;
+      }
+    }
+    catch (const std::exception &e) {
+      BOOST_LOG(error) << "Broadcast video failed "sv << e.what();
+      std::this_thread::sleep_for(100ms);
+    }
+  }
+
+  /**
+   * @brief Send the video frames of the sessions assigned to one send thread.
+   * @param sender The state of this send thread.
+   * @param packets The frames of the sessions assigned to this thread.
+   */
+  static void
+  videoSendThread(video_sender_t &sender, safe::queue_t<video::packet_t> &packets) {
+    platf::adjust_thread_priority(platf::thread_priority_e::high);
+
+    while (auto packet = packets.pop()) {
+      send_video_frame(sender, packet);
+    }
+  }
+
+  void
+  videoBroadcastThread(udp::socket &sock) {
+    auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
+    auto packets = mail::man->queue<video::packet_t>(mail::video_packets);
+    auto video_epoch = std::chrono::steady_clock::now();
+
+    // Video traffic is sent on this thread, unless sessions are spread over dedicated send threads
+    platf::adjust_thread_priority(platf::thread_priority_e::high);
+
+    std::unique_ptr<thread_pool_util::ThreadPool> fec_pool;
+    if (config::stream.fec_threads > 0) {
+      BOOST_LOG(info) << "Encoding FEC blocks on "sv << config::stream.fec_threads << " worker thread(s)"sv;
+      fec_pool = std::make_unique<thread_pool_util::ThreadPool>(config::stream.fec_threads);
+    }
+
+    // Hand pacing to the kernel if requested and supported, otherwise fall back to sleeping between batches
+    bool kernel_pacing = false;
+    if (config::stream.kernel_pacing) {
+      kernel_pacing = platf::enable_socket_txtime(sock.native_handle());
+      if (kernel_pacing) {
+        BOOST_LOG(info) << "Video pacing is done by the kernel"sv;
+      }
+      else {
+        BOOST_LOG(warning) << "Kernel pacing is not supported, falling back to timer-based pacing"sv;
+      }
+    }
+
+    video_sender_t sender { sock, video_epoch, fec_pool.get(), kernel_pacing };
+    if (!sender.timer || !*sender.timer) {
+      BOOST_LOG(error) << "Failed to create timer, aborting video broadcast thread";
+      return;
+    }
+
+    std::unique_ptr<platf::zerocopy_t> zerocopy;
+    if (config::stream.zerocopy_send) {
+      if (!video_zerocopy_requested()) {
+        BOOST_LOG(warning) << "Zero-copy sends are not used with video_send_threads"sv;
+      }
+      else if ((zerocopy = platf::enable_socket_zerocopy(sock.native_handle()))) {
+        BOOST_LOG(info) << "Sending video with MSG_ZEROCOPY"sv;
+        sender.zerocopy = zerocopy.get();
+      }
+      else {
+        BOOST_LOG(warning) << "Zero-copy sends are not supported, falling back to copying sends"sv;
       }
     }
 
+    // Each send thread has its own queue, so pacing or a large IDR frame of one session
+    // doesn't hold up the frames of sessions assigned to other threads
+    std::vector<std::unique_ptr<video_sender_t>> shard_senders;
+    std::vector<std::unique_ptr<safe::queue_t<video::packet_t>>> shard_packets;
+    std::vector<std::thread> shard_threads;
+    auto stop_shards = util::fail_guard([&]() {
+      for (auto &queue : shard_packets) {
+        queue->stop();
+      }
+      for (auto &thread : shard_threads) {
+        thread.join();
+      }
+    });
+
+    if (config::stream.video_send_threads > 0) {
+      BOOST_LOG(info) << "Sending video on "sv << config::stream.video_send_threads << " thread(s)"sv;
+
+      for (int x = 0; x < config::stream.video_send_threads; ++x) {
+        auto &shard_sender = shard_senders.emplace_back(std::make_unique<video_sender_t>(sock, video_epoch, fec_pool.get(), kernel_pacing));
+        if (!shard_sender->timer || !*shard_sender->timer) {
+          BOOST_LOG(error) << "Failed to create timer, aborting video broadcast thread";
+          return;
+        }
+
+        auto &queue = shard_packets.emplace_back(std::make_unique<safe::queue_t<video::packet_t>>(32));
+        shard_threads.emplace_back(videoSendThread, std::ref(*shard_sender), std::ref(*queue));
+      }
+    }
+
+    while (auto packet = packets->pop()) {
+      if (shutdown_event->peek()) {
+        break;
+      }
+
+      if (shard_packets.empty()) {
+        send_video_frame(sender, packet);
+        continue;
+      }
+
+      auto session = (session_t *) packet->channel_data;
+      shard_packets[session->video.send_shard % shard_packets.size()]->raise(std::move(packet));
+    }
+
     shutdown_event->raise(true);
   }
 
@@ -2391,6 +3232,8 @@ namespace stream {
     audio_packet.rtp.packetType = 97;
     audio_packet.rtp.ssrc = 0;
 
+    std::chrono::milliseconds latency_budget { config::audio.latency_budget };
+
     // Audio traffic is sent on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
 
@@ -2402,6 +3245,11 @@ namespace stream {
       TUPLE_2D_REF(channel_data, packet_data, *packet);
       auto session = (session_t *) channel_data;
 
+      // Late packets are skipped before they take a sequence number or timestamp
+      if (!session->audio.latency.admit(*packet_data, std::chrono::steady_clock::now(), latency_budget)) {
+        continue;
+      }
+
       auto sequenceNumber = session->audio.sequenceNumber;
       auto timestamp = session->audio.timestamp;
 
@@ -2419,7 +3267,7 @@ namespace stream {
                         << ", will " << (audio_encryption_enabled ? "ENCRYPT" : "NOT encrypt") << " audio data";
       }
 
-      size_t plaintext_size = packet_data.size();
+      size_t plaintext_size = packet_data->data.size();
       
       // 验证 cipher 是否已初始化
       if (sequenceNumber == 0) {
@@ -2428,7 +3276,7 @@ namespace stream {
                         << ", key_size=" << session->audio.cipher.key.size();
       }
       
-      auto bytes = encode_audio(audio_encryption_enabled, packet_data,
+      auto bytes = encode_audio(audio_encryption_enabled, packet_data->data,
         shards_p[sequenceNumber % RTPA_DATA_SHARDS], iv, session->audio.cipher);
       
       if (sequenceNumber == 0) {
@@ -2718,6 +3566,18 @@ namespace stream {
       return;
     }
 
+    // Build the FEC codecs this session will need in the background, so the first
+    // frames don't pay for the matrix setup on the video broadcast thread
+    task_pool.push([fecpercentage = (size_t) config::stream.fec_percentage, minparityshards = (size_t) session->config.minRequiredFecPackets]() {
+      auto start = std::chrono::steady_clock::now();
+      auto codecs = fec::warm_rs_cache(fecpercentage, minparityshards);
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+      BOOST_LOG(debug) << "FEC codec cache warmed for "sv << fecpercentage << "% in "sv << elapsed.count() << "ms ("sv << codecs << " codecs)"sv;
+    });
+
+    session->video.pacing.link_speed = platf::get_link_speed(session->localAddress.to_string());
+    BOOST_LOG(debug) << "Video pacing link speed: "sv << session->video.pacing.link_speed << " Mbps"sv;
+
     // Enable local prioritization and QoS tagging on video traffic if requested by the client
     auto address = session->video.peer.address();
     session->video.qos = platf::enable_socket_qos(ref->video_sock.native_handle(), address,
@@ -2726,6 +3586,7 @@ namespace stream {
     BOOST_LOG(debug) << "Start capturing Video"sv;
     // Debug: Log the display_name before calling video::capture
     BOOST_LOG(debug) << "stream.cpp: session->config.monitor.display_name = [" << (session->config.monitor.display_name.empty() ? "<empty>" : session->config.monitor.display_name) << "]";
+    session->video.capture_start = std::chrono::steady_clock::now();
     video::capture(session->mail, session->config.monitor, session, session->video.dynamic_param_change_events);
   }
 
@@ -2755,6 +3616,7 @@ namespace stream {
   namespace session {
     std::atomic_uint running_sessions;
     std::atomic_uint running_non_control_only_sessions;  // 跟踪非仅控制流会话的数量
+    std::atomic_uint next_video_send_shard;  // Sessions are handed to the video send threads in turn
 
     state_e
     state(session_t &session) {
@@ -2998,6 +3860,11 @@ namespace stream {
       session->video.invalidate_ref_frames_events = mail->event<std::pair<int64_t, int64_t>>(mail::invalidate_ref_frames);
       session->video.dynamic_param_change_events = mail->event<video::dynamic_param_t>(mail::dynamic_param_change);
       session->video.lowseq = 0;
+      session->video.send_shard = next_video_send_shard++;
+      session->video.pacing.link_speed = 0;
+
+      session->video.fec.percentage = config::stream.fec_percentage;
+      session->video.fec.clean_reports = 0;
       session->video.ping_payload = launch_session.av_ping_payload;
       if (config.encryptionFlagsEnabled & SS_ENC_VIDEO) {
         BOOST_LOG(info) << "Video encryption enabled"sv;
@@ -3161,6 +4028,16 @@ namespace stream {
           // This is the user-configured bitrate, which may have been changed dynamically
           info.bitrate = session_p->current_total_bitrate.load(std::memory_order_relaxed);
 
+          // Get the video pacing rate and how long the last frame took to send at that rate
+          info.pacing_rate = session_p->video.pacing.rate.load(std::memory_order_relaxed);
+          info.frame_drain_time = session_p->video.pacing.drain_time_us.load(std::memory_order_relaxed) / 1000.0;
+          info.fec_percentage = session_p->video.fec.percentage.load(std::memory_order_relaxed);
+          info.time_to_first_idr = session_p->video.first_idr_us.load(std::memory_order_relaxed) / 1000.0;
+          info.frame_interval = session_p->video.frame_interval.avg_us.load(std::memory_order_relaxed) / 1000.0;
+          info.frame_interval_stddev = session_p->video.frame_interval.stddev_us.load(std::memory_order_relaxed) / 1000.0;
+          info.audio_latency = session_p->audio.latency.avg_us.load(std::memory_order_relaxed) / 1000.0;
+          info.audio_late_packets = session_p->audio.latency.late_packets.load(std::memory_order_relaxed);
+
           // Get audio and other settings
           info.host_audio = session_p->config.audio.flags[audio::config_t::HOST_AUDIO];
           info.enable_hdr = session_p->config.monitor.dynamicRange > 0;
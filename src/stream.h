@@ -46,6 +46,14 @@ namespace stream {
     int height;
     int fps;
     int bitrate;  // Current bitrate in Kbps
+    int pacing_rate;  // Current video pacing rate in Mbps
+    double frame_drain_time;  // Time taken to send the last video frame in ms
+    int fec_percentage;  // Current FEC percentage of P-frames
+    double time_to_first_idr;  // Time from the start of video capture to the first IDR frame sent in ms, 0 until then
+    double frame_interval;  // Smoothed interval between frames sent to the client in ms
+    double frame_interval_stddev;  // Standard deviation of the interval between frames sent to the client in ms
+    double audio_latency;  // Smoothed time from audio capture to sending it to the client in ms
+    std::uint64_t audio_late_packets;  // Audio packets dropped for exceeding the latency budget
     bool host_audio;
     bool enable_hdr;
     bool enable_mic;
@@ -6,11 +6,15 @@
 #include <algorithm>
 #include <atomic>
 #include <bitset>
+#include <cmath>
 #include <functional>
+#include <future>
 #include <list>
+#include <sstream>
 #include <thread>
 
 #include <boost/pointer_cast.hpp>
+#include <nlohmann/json.hpp>
 
 extern "C" {
 #include <libavutil/hdr_dynamic_metadata.h>
@@ -45,15 +49,23 @@ struct AMFEncoderContext_Partial {
 #include "cbs.h"
 #include "config.h"
 #include "display_device/display_device.h"
+#include "file_handler.h"
 #include "globals.h"
+#include "image_pool.h"
 #include "input.h"
 #include "logging.h"
 #include "nvenc/nvenc_encoder.h"
 #include "amf/amf_encoder.h"
 #include "platform/common.h"
 #include "sync.h"
+#include "thread_pool.h"
+#include "version.h"
 #include "video.h"
 
+extern "C" {
+#include "bgra_convert.h"
+}
+
 #ifdef _WIN32
 extern "C" {
   #include <libavutil/hwcontext_d3d11va.h>
@@ -162,48 +174,38 @@ namespace video {
   public:
     int
     convert(platf::img_t &img) override {
-      // If we need to add aspect ratio padding, we need to scale into an intermediate output buffer
-      bool requires_padding = (sw_frame->width != sws_output_frame->width || sw_frame->height != sws_output_frame->height);
-
-      // Setup the input frame using the caller's img_t
-      sws_input_frame->data[0] = img.data;
-      sws_input_frame->linesize[0] = img.row_pitch;
-
-      // Perform color conversion and scaling to the final size
-      auto status = sws_scale_frame(sws.get(), requires_padding ? sws_output_frame.get() : sw_frame.get(), sws_input_frame.get());
-      if (status < 0) {
-        char string[AV_ERROR_MAX_STRING_SIZE];
-        BOOST_LOG(error) << "Couldn't scale frame: "sv << av_make_error_string(string, AV_ERROR_MAX_STRING_SIZE, status);
-        return -1;
+      scale_latency_logger.first_point_now();
+      if (bgra_convert) {
+        // Without scaling, convert with the vectorized kernels
+        convert_slices(img);
       }
+      else {
+        // Setup the input frame using the caller's img_t
+        sws_input_frame->data[0] = img.data;
+        sws_input_frame->linesize[0] = img.row_pitch;
 
-      // If we require aspect ratio padding, copy the output frame into the final padded frame
-      if (requires_padding) {
-        auto fmt_desc = av_pix_fmt_desc_get((AVPixelFormat) sws_output_frame->format);
-        auto planes = av_pix_fmt_count_planes((AVPixelFormat) sws_output_frame->format);
-        for (int plane = 0; plane < planes; plane++) {
-          auto shift_h = plane == 0 ? 0 : fmt_desc->log2_chroma_h;
-          auto shift_w = plane == 0 ? 0 : fmt_desc->log2_chroma_w;
-          auto offset = ((offsetW >> shift_w) * fmt_desc->comp[plane].step) + (offsetH >> shift_h) * sw_frame->linesize[plane];
-
-          // Copy line-by-line to preserve leading padding for each row
-          for (int line = 0; line < sws_output_frame->height >> shift_h; line++) {
-            memcpy(sw_frame->data[plane] + offset + (line * sw_frame->linesize[plane]),
-              sws_output_frame->data[plane] + (line * sws_output_frame->linesize[plane]),
-              (size_t) (sws_output_frame->width >> shift_w) * fmt_desc->comp[plane].step);
-          }
+        // Perform color conversion and scaling to the final size, straight into the picture area of the padded frame.
+        // The scaler splits the frame into horizontal slices across its worker threads.
+        auto status = sws_scale_frame(sws.get(), sws_output_frame.get(), sws_input_frame.get());
+        if (status < 0) {
+          char string[AV_ERROR_MAX_STRING_SIZE];
+          BOOST_LOG(error) << "Couldn't scale frame: "sv << av_make_error_string(string, AV_ERROR_MAX_STRING_SIZE, status);
+          return -1;
         }
       }
+      scale_latency_logger.second_point_now_and_log();
 
       // If frame is not a software frame, it means we still need to transfer from main memory
       // to vram memory
       if (frame->hw_frames_ctx) {
+        upload_latency_logger.first_point_now();
         auto status = av_hwframe_transfer_data(frame, sw_frame.get(), 0);
         if (status < 0) {
           char string[AV_ERROR_MAX_STRING_SIZE];
           BOOST_LOG(error) << "Failed to transfer image data to hardware frame: "sv << av_make_error_string(string, AV_ERROR_MAX_STRING_SIZE, status);
           return -1;
         }
+        upload_latency_logger.second_point_now_and_log();
       }
 
       return 0;
@@ -223,11 +225,80 @@ namespace video {
         sw_frame.reset(frame);
       }
 
+      return map_output_frame();
+    }
+
+    /**
+     * @brief Point the scaler output at the picture area of the software frame.
+     * @details With aspect ratio padding, the picture is offset within the frame. The output frame
+     *          shares the buffers of the software frame, so the scaler writes each row in place.
+     * @return 0 on success, -1 on failure.
+     */
+    int
+    map_output_frame() {
+      auto fmt_desc = av_pix_fmt_desc_get((AVPixelFormat) sws_output_frame->format);
+      auto planes = av_pix_fmt_count_planes((AVPixelFormat) sws_output_frame->format);
+      for (int plane = 0; plane < planes; plane++) {
+        auto shift_h = plane == 0 ? 0 : fmt_desc->log2_chroma_h;
+        auto shift_w = plane == 0 ? 0 : fmt_desc->log2_chroma_w;
+        auto offset = ((offsetW >> shift_w) * fmt_desc->comp[plane].step) + (offsetH >> shift_h) * sw_frame->linesize[plane];
+
+        sws_output_frame->data[plane] = sw_frame->data[plane] + offset;
+        sws_output_frame->linesize[plane] = sw_frame->linesize[plane];
+      }
+
+      // The scaler only writes into output frames that already own buffers
+      for (int x = 0; x < AV_NUM_DATA_POINTERS && sw_frame->buf[x]; ++x) {
+        sws_output_frame->buf[x] = av_buffer_ref(sw_frame->buf[x]);
+        if (!sws_output_frame->buf[x]) {
+          return -1;
+        }
+      }
+
       return 0;
     }
 
+    /**
+     * @brief Convert the image in horizontal slices, one on this thread and the others on the slice threads.
+     * @param img The captured image, the same size as the picture area of the frame.
+     */
+    void
+    convert_slices(platf::img_t &img) {
+      auto height = sws_output_frame->height;
+      auto slices = (int) bgra_convert_threads + 1;
+
+      // Slices start on even rows so each one covers whole chroma rows
+      auto slice_height = ((height + slices - 1) / slices + 1) & ~1;
+
+      auto convert_slice = [this, &img](int y, int rows) {
+        uint8_t *dst[3];
+        for (int plane = 0; plane < 3; ++plane) {
+          auto plane_y = plane == 0 ? y : y / 2;
+          dst[plane] = sws_output_frame->data[plane] ? sws_output_frame->data[plane] + (ptrdiff_t) plane_y * sws_output_frame->linesize[plane] : nullptr;
+        }
+
+        bgra_convert(img.data + (ptrdiff_t) y * img.row_pitch, img.row_pitch, sws_output_frame->width, rows, dst, sws_output_frame->linesize, &bgra_convert_matrix);
+      };
+
+      std::vector<std::future<void>> slice_futures;
+      for (int y = slice_height; y < height; y += slice_height) {
+        slice_futures.emplace_back(bgra_convert_pool.push(convert_slice, y, std::min(slice_height, height - y)));
+      }
+
+      convert_slice(0, std::min(slice_height, height));
+
+      for (auto &future : slice_futures) {
+        future.get();
+      }
+    }
+
     void
     apply_colorspace() override {
+      if (bgra_convert) {
+        auto color_vectors = color_vectors_from_colorspace(colorspace, false);
+        bgra_convert_matrix_init(&bgra_convert_matrix, color_vectors->color_vec_y, color_vectors->color_vec_u, color_vectors->color_vec_v, colorspace.bit_depth);
+      }
+
       auto avcodec_colorspace = avcodec_colorspace_from_sunshine_colorspace(colorspace);
       sws_setColorspaceDetails(sws.get(),
         sws_getCoefficients(SWS_CS_DEFAULT), 0,
@@ -286,6 +357,35 @@ namespace video {
       offsetW = (frame->width - out_width) / 2;
       offsetH = (frame->height - out_height) / 2;
 
+      // The vectorized kernels convert 4:2:0 formats without scaling
+      if (in_width == out_width && in_height == out_height && !(out_width & 1) && !(out_height & 1)) {
+        switch (format) {
+          case AV_PIX_FMT_NV12:
+            bgra_convert = bgra_to_nv12_fn;
+            break;
+          case AV_PIX_FMT_P010:
+            bgra_convert = bgra_to_p010_fn;
+            break;
+          case AV_PIX_FMT_YUV420P:
+            bgra_convert = bgra_to_yuv420p_fn;
+            break;
+          case AV_PIX_FMT_YUV420P10:
+            bgra_convert = bgra_to_yuv420p10_fn;
+            break;
+          default:
+            break;
+        }
+      }
+
+      if (bgra_convert) {
+        bgra_convert_threads = slice_threads() - 1;
+        bgra_convert_pool.start(bgra_convert_threads);
+      }
+
+      BOOST_LOG(info) << "Software conversion "sv << in_width << 'x' << in_height << " -> "sv << out_width << 'x' << out_height
+                      << " using "sv << slice_threads() << " slice threads"sv
+                      << (bgra_convert ? " and "s + bgra_convert_isa + " kernels"s : ""s);
+
       sws.reset(sws_alloc_context());
       if (!sws) {
         return -1;
@@ -299,7 +399,7 @@ namespace video {
       av_dict_set_int(&options, "dsth", sws_output_frame->height, 0);
       av_dict_set_int(&options, "dst_format", sws_output_frame->format, 0);
       av_dict_set_int(&options, "sws_flags", SWS_LANCZOS | SWS_ACCURATE_RND, 0);
-      av_dict_set_int(&options, "threads", config::video.min_threads, 0);
+      av_dict_set_int(&options, "threads", slice_threads(), 0);
 
       auto status = av_opt_set_dict(sws.get(), &options);
       av_dict_free(&options);
@@ -319,6 +419,17 @@ namespace video {
       return 0;
     }
 
+    /**
+     * @brief Number of threads converting slices of each frame.
+     * @details Conversion runs between encodes, while the encoder threads are mostly idle, so it
+     *          may use more threads than the encoder does. Half the cores leaves room for capture.
+     */
+    static int
+    slice_threads() {
+      auto cores = (int) std::thread::hardware_concurrency();
+      return std::clamp(cores / 2, std::min(std::max(config::video.min_threads, 1), 16), 16);
+    }
+
     // Store ownership when frame is hw_frame
     avcodec_frame_t hw_frame;
 
@@ -330,6 +441,15 @@ namespace video {
     // Offset of input image to output frame in pixels
     int offsetW;
     int offsetH;
+
+    // Vectorized conversion, used instead of the scaler when the frame isn't scaled
+    bgra_convert_t bgra_convert = nullptr;
+    bgra_convert_matrix_t bgra_convert_matrix {};
+    std::size_t bgra_convert_threads = 0;
+    thread_pool_util::ThreadPool bgra_convert_pool;
+
+    logging::time_delta_periodic_logger scale_latency_logger { debug, "Software conversion: colour conversion latency" };
+    logging::time_delta_periodic_logger upload_latency_logger { debug, "Software conversion: av_hwframe_transfer_data() latency" };
   };
 
   enum flag_e : uint32_t {
@@ -519,6 +639,16 @@ namespace video {
       }
     }
 
+    reconfigure_e
+    reconfigure_kind(dynamic_param_type_e type) const override {
+      // These are set on the codec context directly, like the bitrate
+      if (type == dynamic_param_type_e::QP || type == dynamic_param_type_e::VBV_BUFFER_SIZE) {
+        return reconfigure_e::in_place;
+      }
+
+      return encode_session_t::reconfigure_kind(type);
+    }
+
     avcodec_ctx_t avcodec_ctx;
     std::unique_ptr<platf::avcodec_encode_device_t> device;
 
@@ -529,6 +659,8 @@ namespace video {
 
     // inject sps/vps data into idr pictures
     int inject;
+
+    logging::time_delta_periodic_logger encode_latency_logger { debug, "AVCodec encoder: frame encode latency" };
   };
 
   class nvenc_encode_session_t: public encode_session_t {
@@ -769,6 +901,122 @@ namespace video {
   auto capture_thread_async = safe::make_shared<capture_thread_async_ctx_t>(start_capture_async, end_capture_async);
   auto capture_thread_sync = safe::make_shared<capture_thread_sync_ctx_t>(start_capture_sync, end_capture_sync);
 
+  std::future<std::unique_ptr<encode_session_t>>
+  make_encode_session_async(std::shared_ptr<platf::display_t> disp, const encoder_t &encoder, const config_t &config);
+
+  /**
+   * @brief Encode sessions built ahead of time for recently used configurations.
+   * @details Sessions are built in the background for a display that is already capturing, and taken
+   *          by the next capture_async() for the same encoder, configuration and display. Some encode
+   *          devices keep their display alive, so the capture thread drops the sessions of its display
+   *          before reinitializing or stopping.
+   */
+  class encoder_pool_t {
+  public:
+    /**
+     * @brief Take a session for the configuration, waiting for it if it's still being built.
+     * @return The session, or `nullptr` if the pool doesn't have one.
+     */
+    std::unique_ptr<encode_session_t>
+    take(const encoder_t &encoder, const config_t &config, const std::shared_ptr<platf::display_t> &disp) {
+      std::future<std::unique_ptr<encode_session_t>> session;
+      {
+        std::list<entry_t> dropped;
+        std::lock_guard lg { mutex };
+        drop_expired(dropped);
+
+        auto it = find(encoder, config, disp);
+        if (it == std::end(entries)) {
+          return nullptr;
+        }
+
+        session = std::move(it->session);
+        entries.erase(it);
+      }
+
+      return session.get();
+    }
+
+    /**
+     * @brief Build a session for the configuration in the background, unless the pool already has one.
+     * @details The least recently warmed session is dropped when the pool is full.
+     * @param images The images of the session asking for it. Nothing is built once they are stopped,
+     *               so the pool can't keep a display alive after its capture thread dropped it.
+     */
+    void
+    warm(const encoder_t &encoder, const config_t &config, const std::shared_ptr<platf::display_t> &disp, const img_event_t &images) {
+      if (config::video.encoder_pool_size <= 0) {
+        return;
+      }
+
+      // Sessions are destroyed outside of the lock, as that waits for them to finish building
+      std::list<entry_t> dropped;
+      std::lock_guard lg { mutex };
+      drop_expired(dropped);
+
+      if (!images->running() || find(encoder, config, disp) != std::end(entries)) {
+        return;
+      }
+
+      while (entries.size() >= (std::size_t) config::video.encoder_pool_size) {
+        dropped.splice(std::end(dropped), entries, std::begin(entries));
+      }
+
+      BOOST_LOG(debug) << "Warming pooled encoder for "sv << config.width << 'x' << config.height << 'x' << config.get_effective_framerate();
+      entries.emplace_back(entry_t { &encoder, config, disp, make_encode_session_async(disp, encoder, config) });
+    }
+
+    /**
+     * @brief Drop the sessions built for a display.
+     */
+    void
+    drop(const platf::display_t *disp) {
+      std::list<entry_t> dropped;
+      std::lock_guard lg { mutex };
+
+      KITTY_WHILE_LOOP(auto it = std::begin(entries), it != std::end(entries), {
+        if (it->display.expired() || it->display.lock().get() == disp) {
+          dropped.splice(std::end(dropped), entries, it++);
+          continue;
+        }
+
+        ++it;
+      })
+    }
+
+  private:
+    struct entry_t {
+      const encoder_t *encoder;
+      config_t config;
+      std::weak_ptr<platf::display_t> display;
+      std::future<std::unique_ptr<encode_session_t>> session;
+    };
+
+    void
+    drop_expired(std::list<entry_t> &dropped) {
+      KITTY_WHILE_LOOP(auto it = std::begin(entries), it != std::end(entries), {
+        if (it->display.expired()) {
+          dropped.splice(std::end(dropped), entries, it++);
+          continue;
+        }
+
+        ++it;
+      })
+    }
+
+    std::list<entry_t>::iterator
+    find(const encoder_t &encoder, const config_t &config, const std::shared_ptr<platf::display_t> &disp) {
+      return std::find_if(std::begin(entries), std::end(entries), [&](const entry_t &entry) {
+        return entry.encoder == &encoder && entry.display.lock() == disp && entry.config == config;
+      });
+    }
+
+    std::mutex mutex;
+    std::list<entry_t> entries;
+  };
+
+  encoder_pool_t encoder_pool;
+
 #ifdef _WIN32
   encoder_t nvenc {
     "nvenc"sv,
@@ -1502,6 +1750,11 @@ namespace video {
       for (auto &capture_ctx : capture_ctx_queue->unsafe()) {
         capture_ctx.images->stop();
       }
+
+      // Pooled encoders can hold references to the display
+      if (auto disp = display_wp->lock()) {
+        encoder_pool.drop(disp.get());
+      }
     });
 
     auto switch_display_event = mail::man->event<int>(mail::switch_display);
@@ -1558,90 +1811,25 @@ namespace video {
     display_wp = disp;
 
     constexpr auto capture_buffer_size = 12;
-    std::list<std::shared_ptr<platf::img_t>> imgs(capture_buffer_size);
-
-    std::vector<std::optional<std::chrono::steady_clock::time_point>> imgs_used_timestamps;
-    const std::chrono::seconds trim_timeot = 3s;
-    auto trim_imgs = [&]() {
-      // count allocated and used within current pool
-      size_t allocated_count = 0;
-      size_t used_count = 0;
-      for (const auto &img : imgs) {
-        if (img) {
-          allocated_count += 1;
-          if (img.use_count() > 1) {
-            used_count += 1;
-          }
-        }
-      }
-
-      // remember the timestamp of currently used count
-      const auto now = std::chrono::steady_clock::now();
-      if (imgs_used_timestamps.size() <= used_count) {
-        imgs_used_timestamps.resize(used_count + 1);
-      }
-      imgs_used_timestamps[used_count] = now;
-
-      // decide whether to trim allocated unused above the currently used count
-      // based on last used timestamp and universal timeout
-      size_t trim_target = used_count;
-      for (size_t i = used_count; i < imgs_used_timestamps.size(); i++) {
-        if (imgs_used_timestamps[i] && now - *imgs_used_timestamps[i] < trim_timeot) {
-          trim_target = i;
-        }
-      }
+    constexpr auto trim_timeout = 3s;
+    auto imgs = std::make_shared<image_pool::pool_t<platf::img_t>>(capture_buffer_size);
 
-      // trim allocated unused above the newly decided trim target
-      if (allocated_count > trim_target) {
-        size_t to_trim = allocated_count - trim_target;
-        // prioritize trimming least recently used
-        for (auto it = imgs.rbegin(); it != imgs.rend(); it++) {
-          auto &img = *it;
-          if (img && img.use_count() == 1) {
-            img.reset();
-            to_trim -= 1;
-            if (to_trim == 0) break;
-          }
-        }
-        // forget timestamps that no longer relevant
-        imgs_used_timestamps.resize(trim_target + 1);
-      }
+    auto log_pool_stats = [&]() {
+      auto stats = imgs->stats();
+      BOOST_LOG(debug) << "Capture image pool: "sv << stats.allocated << '/' << stats.capacity << " allocated, "sv
+                       << stats.in_use << " in use, "sv << stats.trimmed << " trimmed, "sv << stats.exhausted << " times exhausted"sv;
     };
 
     auto pull_free_image_callback = [&](std::shared_ptr<platf::img_t> &img_out) -> bool {
       img_out.reset();
       while (capture_ctx_queue->running()) {
-        // pick first allocated but unused
-        for (auto it = imgs.begin(); it != imgs.end(); it++) {
-          if (*it && it->use_count() == 1) {
-            img_out = *it;
-            if (it != imgs.begin()) {
-              // move image to the front of the list to prioritize its reusal
-              imgs.erase(it);
-              imgs.push_front(img_out);
-            }
-            break;
-          }
-        }
-        // otherwise pick first unallocated
-        if (!img_out) {
-          for (auto it = imgs.begin(); it != imgs.end(); it++) {
-            if (!*it) {
-              // allocate image
-              *it = disp->alloc_img();
-              img_out = *it;
-              if (it != imgs.begin()) {
-                // move image to the front of the list to prioritize its reusal
-                imgs.erase(it);
-                imgs.push_front(img_out);
-              }
-              break;
-            }
-          }
-        }
+        // The most recently used image comes first, otherwise a new one is allocated
+        img_out = imgs->acquire([&]() { return disp->alloc_img(); });
         if (img_out) {
           // trim allocated but unused portion of the pool based on timeouts
-          trim_imgs();
+          if (imgs->trim(std::chrono::steady_clock::now(), trim_timeout)) {
+            log_pool_stats();
+          }
           img_out->frame_timestamp.reset();
           return true;
         }
@@ -1702,15 +1890,18 @@ namespace video {
         case platf::capture_e::reinit: {
           reinit_event.raise(true);
 
-          // Some classes of images contain references to the display --> display won't delete unless img is deleted
-          for (auto &img : imgs) {
-            img.reset();
-          }
+          // Some classes of images contain references to the display --> display won't delete unless img is deleted.
+          // The old pool frees its images once the encoders have released the last of them.
+          log_pool_stats();
+          imgs = std::make_shared<image_pool::pool_t<platf::img_t>>(capture_buffer_size);
 
           // display_wp is modified in this thread only
           // Wait for the other shared_ptr's of display to be destroyed.
           // New displays will only be created in this thread.
           while (display_wp->use_count() != 1) {
+            // Pooled encoders can hold references to the display too
+            encoder_pool.drop(disp.get());
+
             // Free images that weren't consumed by the encoders. These can reference the display and prevent
             // the ref count from reaching 1. We do this here rather than on the encoder thread to avoid race
             // conditions where the encoding loop might free a good frame after reinitializing if we capture
@@ -1955,6 +2146,7 @@ namespace video {
     }
 
     // send the frame to the encoder
+    session.encode_latency_logger.first_point_now();
     auto ret = avcodec_send_frame(ctx.get(), frame);
     if (ret < 0) {
       char err_str[AV_ERROR_MAX_STRING_SIZE] { 0 };
@@ -2009,6 +2201,7 @@ namespace video {
 
       if (av_packet && av_packet->pts == frame_nr) {
         packet->frame_timestamp = frame_timestamp;
+        session.encode_latency_logger.second_point_now_and_log();
       }
 
       packet->replacements = &session.replacements;
@@ -2773,30 +2966,177 @@ namespace video {
     return nullptr;
   }
 
+  std::unique_ptr<platf::encode_device_t>
+  make_encode_device(platf::display_t &disp, const encoder_t &encoder, const config_t &config);
+
+  bool
+  apply_dynamic_param(config_t &config, const dynamic_param_t &param) {
+    switch (param.type) {
+      case dynamic_param_type_e::BITRATE:
+        // The same FEC allowance as the encoders' set_bitrate()
+        config.bitrate = param.value.int_value;
+        if (config::stream.fec_percentage > 0 && config::stream.fec_percentage <= 80) {
+          config.bitrate = config.bitrate * (100 - config::stream.fec_percentage) / 100;
+        }
+        return true;
+      case dynamic_param_type_e::FPS: {
+        auto framerate = param.value.float_value;
+        config.framerate = (int) std::lround(framerate);
+
+        // Keep fractional rates like 59.94 exact
+        if (std::abs(framerate - config.framerate) > 0.005f) {
+          config.frameRateNum = (int) std::lround(framerate * 1000);
+          config.frameRateDen = 1000;
+        }
+        else {
+          config.frameRateNum = 0;
+          config.frameRateDen = 1;
+        }
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+
+  frame_pacer_t::frame_pacer_t(double framerate) {
+    set_framerate(framerate);
+  }
+
+  void
+  frame_pacer_t::set_framerate(double framerate) {
+    period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double> { 1.0 / framerate });
+  }
+
+  frame_pacer_t::clock::duration
+  frame_pacer_t::wait_for(clock::time_point now) const {
+    if (!next_tick) {
+      // Nothing to pace yet, encode a duplicate at the usual minimum rate
+      return period * 2;
+    }
+
+    // Allow for the usual lateness of captured frames, up to half a frame
+    auto tolerance = std::clamp<clock::duration>(jitter * 2 + 1ms, 1ms, period / 2);
+    return std::max<clock::duration>(*next_tick + tolerance - now, 0s);
+  }
+
+  frame_pacer_t::clock::duration
+  frame_pacer_t::hold_for(clock::time_point now) const {
+    if (!next_tick) {
+      return 0s;
+    }
+
+    return std::max<clock::duration>(*next_tick - period / 2 - now, 0s);
+  }
+
+  void
+  frame_pacer_t::frame_arrived(clock::time_point arrival) {
+    if (!next_tick) {
+      // Start with a generous tolerance, it narrows as frames arrive on time
+      next_tick = arrival;
+      jitter = period / 4;
+      return;
+    }
+
+    // Frames much later than their tick, like those of a game rendering below the stream
+    // framerate, don't move the ticks
+    auto error = arrival - *next_tick;
+    if (error > period / 2 || error < -period / 2) {
+      return;
+    }
+
+    *next_tick += error / 8;
+    jitter += (std::chrono::abs(error) - jitter) / 8;
+  }
+
+  void
+  frame_pacer_t::frame_dropped() {
+    ++dropped;
+  }
+
+  void
+  frame_pacer_t::frame_released(clock::time_point now, bool duplicate) {
+    ++released;
+    if (duplicate) {
+      ++duplicated;
+    }
+
+    if (!next_tick) {
+      return;
+    }
+
+    *next_tick += period;
+
+    // Lock onto captured frames again after a stall, rather than catching up with a burst of frames
+    if (*next_tick + period < now) {
+      next_tick.reset();
+    }
+  }
+
+  /**
+   * @brief Build an encode session for the display, loaded with a dummy image.
+   * @details The dummy image lets the session encode something even before the first frame is captured.
+   */
+  std::unique_ptr<encode_session_t>
+  make_loaded_encode_session(platf::display_t &disp, const encoder_t &encoder, const config_t &config, std::unique_ptr<platf::encode_device_t> encode_device) {
+    auto session = make_encode_session(&disp, encoder, config, disp.width, disp.height, std::move(encode_device));
+    if (!session) {
+      return nullptr;
+    }
+
+    // Load a dummy image into the session to ensure we have something to encode
+    // even if we timeout waiting on the first frame. This is a relatively large
+    // allocation which can be freed immediately after convert().
+    auto dummy_img = disp.alloc_img();
+    if (!dummy_img || disp.dummy_img(dummy_img.get()) || session->convert(*dummy_img)) {
+      return nullptr;
+    }
+
+    return session;
+  }
+
+  /**
+   * @brief Start building an encoder for a new configuration in the background.
+   * @details The new encoder is loaded with a dummy image, so it can be swapped in right away.
+   */
+  std::future<std::unique_ptr<encode_session_t>>
+  make_encode_session_async(std::shared_ptr<platf::display_t> disp, const encoder_t &encoder, const config_t &config) {
+    return std::async(std::launch::async, [disp = std::move(disp), &encoder, config]() mutable {
+      // The capture thread waits for other references to the display to go away before reinitializing it
+      auto release_display = util::fail_guard([&disp]() {
+        disp.reset();
+      });
+
+      auto encode_device = make_encode_device(*disp, encoder, config);
+      if (!encode_device) {
+        return std::unique_ptr<encode_session_t> {};
+      }
+
+      return make_loaded_encode_session(*disp, encoder, config, std::move(encode_device));
+    });
+  }
+
   void
   encode_run(
     int &frame_nr,  // Store progress of the frame number
     safe::mail_t mail,
+    safe::mail_raw_t::queue_t<packet_t> packets,
     img_event_t images,
-    config_t config,
+    config_t &config,  // Updated with dynamic parameter changes, so they survive reinitialization
     std::shared_ptr<platf::display_t> disp,
-    std::unique_ptr<platf::encode_device_t> encode_device,
+    std::unique_ptr<encode_session_t> session,  // Loaded with a dummy image, see make_loaded_encode_session()
     safe::signal_t &reinit_event,
     const encoder_t &encoder,
     void *channel_data,
-    std::optional<safe::mail_raw_t::event_t<dynamic_param_t>> dynamic_param_events) {
-    auto session = make_encode_session(disp.get(), encoder, config, disp->width, disp->height, std::move(encode_device));
-    if (!session) {
-      return;
-    }
-
+    std::optional<safe::mail_raw_t::event_t<dynamic_param_t>> dynamic_param_events,
+    std::function<void()> on_first_frame) {  // Called once the session encoded its first frame, which is an IDR frame
     // As a workaround for NVENC hangs and to generally speed up encoder reinit,
     // we will complete the encoder teardown in a separate thread if supported.
     // This will move expensive processing off the encoder thread to allow us
     // to restart encoding as soon as possible. For cases where the NVENC driver
     // hang occurs, this thread may probably never exit, but it will allow
     // streaming to continue without requiring a full restart of Sunshine.
-    auto fail_guard = util::fail_guard([&encoder, &session] {
+    auto retire_session = [&encoder](std::unique_ptr<encode_session_t> &session) {
       if (encoder.flags & ASYNC_TEARDOWN) {
         std::thread encoder_teardown_thread { [session = std::move(session)]() mutable {
           BOOST_LOG(info) << "Starting async encoder teardown";
@@ -2805,37 +3145,79 @@ namespace video {
         } };
         encoder_teardown_thread.detach();
       }
+      else {
+        session.reset();
+      }
+    };
+    auto fail_guard = util::fail_guard([&retire_session, &session] {
+      retire_session(session);
     });
 
     // set minimum frame time based on client-requested target framerate or minimum_fps_target
     std::chrono::duration<double, std::milli> minimum_frame_time;
-    if (config::video.minimum_fps_target > 0) {
-      // Use minimum_fps_target if specified
-      minimum_frame_time = std::chrono::duration<double, std::milli> { 1000.0 / config::video.minimum_fps_target };
-      BOOST_LOG(info) << "Minimum frame time set to "sv << minimum_frame_time.count() << "ms, based on minimum_fps_target "sv << config::video.minimum_fps_target << " fps."sv;
-    }
-    else {
-      // Default behavior: about half the stream FPS
-      minimum_frame_time = std::chrono::duration<double, std::milli> { 2000.0 / config.framerate };
-      BOOST_LOG(info) << "Minimum frame time set to "sv << minimum_frame_time.count() << "ms, based on client-requested target framerate "sv << config.framerate << "."sv;
+    auto set_minimum_frame_time = [&minimum_frame_time](const config_t &config) {
+      if (config::video.minimum_fps_target > 0) {
+        // Use minimum_fps_target if specified
+        minimum_frame_time = std::chrono::duration<double, std::milli> { 1000.0 / config::video.minimum_fps_target };
+        BOOST_LOG(info) << "Minimum frame time set to "sv << minimum_frame_time.count() << "ms, based on minimum_fps_target "sv << config::video.minimum_fps_target << " fps."sv;
+      }
+      else {
+        // Default behavior: about half the stream FPS
+        minimum_frame_time = std::chrono::duration<double, std::milli> { 2000.0 / config.framerate };
+        BOOST_LOG(info) << "Minimum frame time set to "sv << minimum_frame_time.count() << "ms, based on client-requested target framerate "sv << config.framerate << "."sv;
+      }
+    };
+    set_minimum_frame_time(config);
+
+    // Variable refresh rate streams follow the game, so they aren't paced
+    std::optional<frame_pacer_t> pacer;
+    if (config::video.frame_pacing && !config::video.variable_refresh_rate) {
+      pacer.emplace(config.get_effective_framerate());
     }
 
     auto shutdown_event = mail->event<bool>(mail::shutdown);
-    auto packets = mail::man->queue<packet_t>(mail::video_packets);
     auto idr_events = mail->event<bool>(mail::idr);
     auto invalidate_ref_frames_events = mail->event<std::pair<int64_t, int64_t>>(mail::invalidate_ref_frames);
     auto dynamic_param_events_ptr = dynamic_param_events.value_or(mail::man->event<dynamic_param_t>(mail::dynamic_param_change));
 
-    {
-      // Load a dummy image into the AVFrame to ensure we have something to encode
-      // even if we timeout waiting on the first frame. This is a relatively large
-      // allocation which can be freed immediately after convert(), so we do this
-      // in a separate scope.
-      auto dummy_img = disp->alloc_img();
-      if (!dummy_img || disp->dummy_img(dummy_img.get()) || session->convert(*dummy_img)) {
-        return;
+    // Contents of the last converted image, so repeated frames of a static screen aren't converted again
+    std::uint64_t converted_content_serial = 0;
+    std::uint64_t skipped_conversions = 0;
+
+    // Soft reconfiguration: the configuration dynamic parameters ask for, and the encoder being
+    // built for it. In-place changes made during the build are replayed on the new encoder.
+    auto target_config = config;
+    config_t pending_config;
+    std::future<std::unique_ptr<encode_session_t>> pending_session;
+    std::vector<dynamic_param_t> replayed_params;
+
+    auto swap_pending_session = [&]() {
+      if (auto new_session = pending_session.get()) {
+        for (auto &param : replayed_params) {
+          new_session->set_dynamic_param(param);
+          apply_dynamic_param(pending_config, param);
+        }
+
+        retire_session(session);
+        session = std::move(new_session);
+        session->request_idr_frame();
+        config = pending_config;
+        set_minimum_frame_time(config);
+        if (pacer) {
+          pacer->set_framerate(config.get_effective_framerate());
+        }
+
+        // The new encoder only holds the dummy image
+        converted_content_serial = 0;
+
+        BOOST_LOG(info) << "Swapped in reconfigured encoder: "sv << config.width << 'x' << config.height << 'x' << config.get_effective_framerate();
       }
-    }
+      else {
+        BOOST_LOG(warning) << "Couldn't build the reconfigured encoder, keeping the current one"sv;
+        target_config = config;
+      }
+      replayed_params.clear();
+    };
 
     while (true) {
       // Break out of the encoding loop if any of the following are true:
@@ -2865,29 +3247,84 @@ namespace video {
       // 处理动态参数调整
       while (dynamic_param_events_ptr->peek()) {
         if (auto param = dynamic_param_events_ptr->pop(0ms)) {
-          BOOST_LOG(info) << "Applying dynamic parameter change: type=" << (int) param->type;
-          session->set_dynamic_param(*param);
+          auto kind = session->reconfigure_kind(param->type);
+          BOOST_LOG(info) << "Applying dynamic parameter change: type=" << (int) param->type << ", reconfigure=" << (int) kind;
+
+          switch (kind) {
+            case reconfigure_e::in_place:
+              session->set_dynamic_param(*param);
+              apply_dynamic_param(config, *param);
+              apply_dynamic_param(target_config, *param);
+              if (pending_session.valid()) {
+                replayed_params.emplace_back(*param);
+              }
+              break;
+            case reconfigure_e::soft:
+              apply_dynamic_param(target_config, *param);
+              break;
+            case reconfigure_e::hard:
+              // The display is reconfigured for it, which reinitializes capture and the encoder
+            case reconfigure_e::ignored:
+              session->set_dynamic_param(*param);
+              break;
+          }
         }
       }
 
+      if (!pending_session.valid() && target_config != config) {
+        pending_config = target_config;
+        pending_session = make_encode_session_async(disp, encoder, pending_config);
+      }
+
       if (requested_idr_frame) {
         session->request_idr_frame();
       }
 
       std::optional<std::chrono::steady_clock::time_point> frame_timestamp;
       bool has_new_frame = false;
+      bool has_captured_frame = false;
 
       // Encode at a minimum FPS to avoid image quality issues with static content
       // When variable_refresh_rate is enabled, only encode when we have a new frame
       if (!requested_idr_frame || images->peek()) {
-        if (auto img = images->pop(minimum_frame_time)) {
+        auto img = pacer ? images->pop(pacer->wait_for(std::chrono::steady_clock::now())) : images->pop(minimum_frame_time);
+        if (img && pacer) {
+          pacer->frame_arrived(img->frame_timestamp.value_or(std::chrono::steady_clock::now()));
+
+          // Hold a frame that came early for the next tick, a newer one replaces it
+          for (auto hold = pacer->hold_for(std::chrono::steady_clock::now()); hold > 0s && images->running();
+               hold = pacer->hold_for(std::chrono::steady_clock::now())) {
+            if (auto newer = images->pop(hold)) {
+              img = std::move(newer);
+              pacer->frame_dropped();
+              pacer->frame_arrived(img->frame_timestamp.value_or(std::chrono::steady_clock::now()));
+            }
+          }
+        }
+
+        if (img) {
+          // Swap in the reconfigured encoder when it's ready, with a captured image to convert.
+          // The current encoder keeps encoding until then.
+          if (pending_session.valid() && pending_session.wait_for(0s) == std::future_status::ready) {
+            swap_pending_session();
+          }
+
           frame_timestamp = img->frame_timestamp;
-          if (session->convert(*img)) {
-            BOOST_LOG(error) << "Could not convert image"sv;
-            // Don't exit permanently — break to let the outer reinit loop handle recovery
-            break;
+          has_captured_frame = true;
+          if (img->content_serial && img->content_serial == converted_content_serial) {
+            // The screen hasn't changed, so the encoder already holds this frame and
+            // will encode it as a cheap repeat of the previous one
+            ++skipped_conversions;
+          }
+          else {
+            if (session->convert(*img)) {
+              BOOST_LOG(error) << "Could not convert image"sv;
+              // Don't exit permanently — break to let the outer reinit loop handle recovery
+              break;
+            }
+            converted_content_serial = img->content_serial;
+            has_new_frame = true;
           }
-          has_new_frame = true;
         }
         else if (!images->running()) {
           break;
@@ -2905,14 +3342,30 @@ namespace video {
         // If minimum_fps_target is set, we'll encode anyway to maintain minimum FPS
       }
 
+      if (pacer) {
+        pacer->frame_released(std::chrono::steady_clock::now(), !has_captured_frame);
+      }
+
       if (encode(frame_nr++, *session, packets, channel_data, frame_timestamp)) {
         BOOST_LOG(error) << "Could not encode video packet"sv;
         // Don't exit permanently — break to let the outer reinit loop handle recovery
         break;
       }
 
+      if (on_first_frame) {
+        std::exchange(on_first_frame, nullptr)();
+      }
+
       session->request_normal_frame();
     }
+
+    if (skipped_conversions) {
+      BOOST_LOG(debug) << "Skipped conversion of "sv << skipped_conversions << " unchanged frames"sv;
+    }
+    if (pacer) {
+      BOOST_LOG(info) << "Frame pacing: "sv << pacer->released << " frames, "sv << pacer->dropped << " dropped, "sv
+                      << pacer->duplicated << " duplicated"sv;
+    }
   }
 
   input::touch_port_t
@@ -3262,6 +3715,7 @@ namespace video {
   void
   capture_async(
     safe::mail_t mail,
+    safe::mail_raw_t::queue_t<packet_t> packets,
     config_t &config,
     void *channel_data,
     std::optional<safe::mail_raw_t::event_t<dynamic_param_t>> dynamic_param_events) {
@@ -3407,9 +3861,21 @@ namespace video {
 
       auto &encoder = *chosen_encoder;
 
-      auto encode_device = make_encode_device(*display, encoder, config);
-      if (!encode_device) {
-        return;
+      // Take a session built ahead of time if there is one
+      auto encoder_start = std::chrono::steady_clock::now();
+      auto session = encoder_pool.take(encoder, config, display);
+      bool pooled = (bool) session;
+      if (!session) {
+        auto encode_device = make_encode_device(*display, encoder, config);
+        if (!encode_device) {
+          return;
+        }
+
+        session = make_loaded_encode_session(*display, encoder, config, std::move(encode_device));
+      }
+      if (session) {
+        BOOST_LOG(info) << "Encoder ready in "sv << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - encoder_start).count()
+                        << "ms"sv << (pooled ? " (pooled)"sv : ""sv);
       }
 
       // Absolute mouse coordinates require that the dimensions of the screen are known
@@ -3417,7 +3883,7 @@ namespace video {
 
       // Update client with our current HDR display state
       hdr_info_t hdr_info = std::make_unique<hdr_info_raw_t>(false);
-      if (colorspace_is_hdr(encode_device->colorspace)) {
+      if (colorspace_is_hdr(colorspace_from_client_config(config, display->is_hdr()))) {
         if (display->get_hdr_metadata(hdr_info->metadata)) {
           hdr_info->enabled = true;
         }
@@ -3427,16 +3893,285 @@ namespace video {
       }
       hdr_event->raise(std::move(hdr_info));
 
+      if (!session) {
+        continue;
+      }
+
+      // Keep a session warm for the next capture, but only once this one is streaming, so
+      // building the spare doesn't compete with the startup of the live encoder
+      auto warm_pool = [&encoder, config, display, images]() {
+        encoder_pool.warm(encoder, config, display, images);
+      };
+
       encode_run(
         frame_nr,
-        mail, images,
+        mail, packets, images,
         config, display,
-        std::move(encode_device),
+        std::move(session),
         ref->reinit_event, *ref->encoder_p,
-        channel_data, dynamic_param_events);
+        channel_data, dynamic_param_events,
+        std::move(warm_pool));
+    }
+  }
+
+  /**
+   * @brief One encoder feeding every session that requested the same video configuration.
+   * @details The encoder runs on its own mail. A fan-out thread hands each encoded frame to all
+   *          subscribed sessions, forwards their IDR requests and reference frame invalidations to
+   *          the encoder, and relays display state changes back to them.
+   */
+  struct shared_encode_t {
+    struct subscriber_t {
+      explicit subscriber_t(const safe::mail_t &mail, void *channel_data, std::optional<safe::mail_raw_t::event_t<dynamic_param_t>> dynamic_param_events):
+          channel_data { channel_data },
+          shutdown_event { mail->event<bool>(mail::shutdown) },
+          idr_events { mail->event<bool>(mail::idr) },
+          invalidate_ref_frames_events { mail->event<std::pair<int64_t, int64_t>>(mail::invalidate_ref_frames) },
+          hdr_event { mail->event<hdr_info_t>(mail::hdr) },
+          touch_port_event { mail->event<input::touch_port_t>(mail::touch_port) },
+          resolution_change_event { mail->event<std::pair<std::uint32_t, std::uint32_t>>(mail::resolution_change) },
+          dynamic_param_events { std::move(dynamic_param_events) } {}
+
+      void *channel_data;
+
+      safe::mail_raw_t::event_t<bool> shutdown_event;
+      safe::mail_raw_t::event_t<bool> idr_events;
+      safe::mail_raw_t::event_t<std::pair<int64_t, int64_t>> invalidate_ref_frames_events;
+      safe::mail_raw_t::event_t<hdr_info_t> hdr_event;
+      safe::mail_raw_t::event_t<input::touch_port_t> touch_port_event;
+      safe::mail_raw_t::event_t<std::pair<std::uint32_t, std::uint32_t>> resolution_change_event;
+      std::optional<safe::mail_raw_t::event_t<dynamic_param_t>> dynamic_param_events;
+
+      // Subtracted from the frame numbers of the encoder, so the session counts frames from
+      // the first IDR frame it receives. Unset until then.
+      std::optional<int64_t> frame_offset;
+    };
+
+    explicit shared_encode_t(const config_t &config):
+        config { config },
+        mail { std::make_shared<safe::mail_raw_t>() },
+        packets { mail->queue<packet_t>(mail::video_packets) },
+        shutdown_event { mail->event<bool>(mail::shutdown) },
+        idr_events { mail->event<bool>(mail::idr) },
+        invalidate_ref_frames_events { mail->event<std::pair<int64_t, int64_t>>(mail::invalidate_ref_frames) },
+        hdr_event { mail->event<hdr_info_t>(mail::hdr) },
+        touch_port_event { mail->event<input::touch_port_t>(mail::touch_port) },
+        resolution_change_event { mail->event<std::pair<std::uint32_t, std::uint32_t>>(mail::resolution_change) },
+        dynamic_param_events { mail->event<dynamic_param_t>(mail::dynamic_param_change) } {}
+
+    // The configuration requested by the sessions, before the encoder adapts it to the display
+    const config_t config;
+
+    // Held here so events raised before the threads pick them up aren't lost
+    safe::mail_t mail;
+    safe::mail_raw_t::queue_t<packet_t> packets;
+    safe::mail_raw_t::event_t<bool> shutdown_event;
+    safe::mail_raw_t::event_t<bool> idr_events;
+    safe::mail_raw_t::event_t<std::pair<int64_t, int64_t>> invalidate_ref_frames_events;
+    safe::mail_raw_t::event_t<hdr_info_t> hdr_event;
+    safe::mail_raw_t::event_t<input::touch_port_t> touch_port_event;
+    safe::mail_raw_t::event_t<std::pair<std::uint32_t, std::uint32_t>> resolution_change_event;
+    safe::mail_raw_t::event_t<dynamic_param_t> dynamic_param_events;
+
+    std::mutex subscribers_mutex;
+    std::vector<std::shared_ptr<subscriber_t>> subscribers;
+
+    // The last display state raised by the encoder, replayed to sessions that join later
+    hdr_info_t hdr_info;
+    std::optional<input::touch_port_t> touch_port;
+    std::optional<std::pair<std::uint32_t, std::uint32_t>> resolution;
+
+    std::thread encode_thread;
+    std::thread fanout_thread;
+  };
+
+  static std::mutex shared_encoders_mutex;
+  static std::vector<std::shared_ptr<shared_encode_t>> shared_encoders;
+
+  /**
+   * @brief Replay the display state of a shared encoder to a subscriber.
+   * @param shared The shared encoder, with its subscribers_mutex held.
+   * @param subscriber The session to update.
+   */
+  static void
+  replay_display_state(shared_encode_t &shared, shared_encode_t::subscriber_t &subscriber) {
+    if (shared.hdr_info) {
+      subscriber.hdr_event->raise(std::make_unique<hdr_info_raw_t>(*shared.hdr_info));
+    }
+    if (shared.touch_port) {
+      subscriber.touch_port_event->raise(*shared.touch_port);
+    }
+    if (shared.resolution) {
+      subscriber.resolution_change_event->raise(*shared.resolution);
     }
   }
 
+  /**
+   * @brief Fan the frames of a shared encoder out to its subscribers.
+   * @param shared The shared encoder.
+   */
+  static void
+  shared_encode_fanout(shared_encode_t &shared) {
+    auto packets = mail::man->queue<packet_t>(mail::video_packets);
+
+    while (!shared.shutdown_event->peek()) {
+      auto packet = shared.packets->pop(10ms);
+
+      std::lock_guard lg { shared.subscribers_mutex };
+
+      // Display state changes go to every session
+      bool display_changed = false;
+      if (shared.hdr_event->peek()) {
+        shared.hdr_info = shared.hdr_event->pop();
+        display_changed = true;
+      }
+      if (shared.touch_port_event->peek()) {
+        shared.touch_port = shared.touch_port_event->pop();
+        display_changed = true;
+      }
+      if (shared.resolution_change_event->peek()) {
+        shared.resolution = shared.resolution_change_event->pop();
+        display_changed = true;
+      }
+
+      // Merge the requests of all sessions into a single IDR frame or invalidation range.
+      // Invalidated frames are translated from the numbering of each session to the encoder's.
+      bool idr_requested = false;
+      std::optional<std::pair<int64_t, int64_t>> invalidated_frames;
+      for (auto &subscriber : shared.subscribers) {
+        if (display_changed) {
+          replay_display_state(shared, *subscriber);
+        }
+
+        if (subscriber->idr_events->peek()) {
+          subscriber->idr_events->pop();
+          idr_requested = true;
+        }
+
+        while (subscriber->invalidate_ref_frames_events->peek()) {
+          auto frames = subscriber->invalidate_ref_frames_events->pop(0ms);
+          if (!frames || !subscriber->frame_offset) {
+            continue;
+          }
+
+          auto first = frames->first + *subscriber->frame_offset;
+          auto last = frames->second + *subscriber->frame_offset;
+          if (invalidated_frames) {
+            first = std::min(first, invalidated_frames->first);
+            last = std::max(last, invalidated_frames->second);
+          }
+          invalidated_frames = std::make_pair(first, last);
+        }
+
+        // The encoder settings are shared, so one session can't change them for everyone
+        if (subscriber->dynamic_param_events) {
+          while ((*subscriber->dynamic_param_events)->peek()) {
+            if (auto param = (*subscriber->dynamic_param_events)->pop(0ms)) {
+              BOOST_LOG(warning) << "Ignoring dynamic parameter change for shared encoder: type="sv << (int) param->type;
+            }
+          }
+        }
+      }
+
+      if (invalidated_frames) {
+        shared.invalidate_ref_frames_events->raise(*invalidated_frames);
+      }
+      if (idr_requested) {
+        shared.idr_events->raise(true);
+      }
+
+      if (!packet) {
+        continue;
+      }
+
+      std::shared_ptr<packet_raw_t> source = std::move(packet);
+      for (auto &subscriber : shared.subscribers) {
+        // Sessions join the stream at an IDR frame
+        if (!subscriber->frame_offset) {
+          if (!source->is_idr()) {
+            continue;
+          }
+
+          subscriber->frame_offset = source->frame_index() - 1;
+        }
+
+        auto subscriber_packet = std::make_unique<packet_raw_shared_t>(source, source->frame_index() - *subscriber->frame_offset);
+        subscriber_packet->channel_data = subscriber->channel_data;
+        packets->raise(std::move(subscriber_packet));
+      }
+    }
+
+    // If the encoder failed, end the sessions as a dedicated encoder would
+    std::lock_guard lg { shared.subscribers_mutex };
+    for (auto &subscriber : shared.subscribers) {
+      subscriber->shutdown_event->raise(true);
+    }
+  }
+
+  /**
+   * @brief Stream a session from an encoder shared with all sessions of the same video configuration.
+   * @details The encoder is started by the first session and stopped when the last one ends.
+   */
+  static void
+  capture_shared(
+    safe::mail_t mail,
+    const config_t &config,
+    void *channel_data,
+    std::optional<safe::mail_raw_t::event_t<dynamic_param_t>> dynamic_param_events) {
+    auto subscriber = std::make_shared<shared_encode_t::subscriber_t>(mail, channel_data, std::move(dynamic_param_events));
+
+    std::shared_ptr<shared_encode_t> shared;
+    {
+      std::lock_guard lg { shared_encoders_mutex };
+
+      auto it = std::find_if(std::begin(shared_encoders), std::end(shared_encoders), [&config](const auto &shared) {
+        return shared->config == config && !shared->shutdown_event->peek();
+      });
+
+      if (it != std::end(shared_encoders)) {
+        shared = *it;
+      }
+      else {
+        shared = std::make_shared<shared_encode_t>(config);
+        shared->fanout_thread = std::thread { shared_encode_fanout, std::ref(*shared) };
+        shared->encode_thread = std::thread { [shared = shared.get()]() {
+          auto config = shared->config;
+          capture_async(shared->mail, shared->packets, config, nullptr, shared->dynamic_param_events);
+        } };
+
+        shared_encoders.emplace_back(shared);
+      }
+
+      std::lock_guard lg_subscribers { shared->subscribers_mutex };
+      replay_display_state(*shared, *subscriber);
+      shared->subscribers.emplace_back(subscriber);
+
+      BOOST_LOG(info) << "Shared encoder "sv << config.width << 'x' << config.height << 'x' << config.framerate
+                      << " now has "sv << shared->subscribers.size() << " session(s)"sv;
+    }
+
+    // Stream until this session ends, or until the encoder fails
+    subscriber->shutdown_event->view();
+
+    {
+      std::lock_guard lg { shared_encoders_mutex };
+      std::lock_guard lg_subscribers { shared->subscribers_mutex };
+
+      std::erase(shared->subscribers, subscriber);
+      if (!shared->subscribers.empty()) {
+        return;
+      }
+
+      std::erase(shared_encoders, shared);
+    }
+
+    // The last session stops the encoder
+    BOOST_LOG(info) << "Stopping shared encoder"sv;
+    shared->shutdown_event->raise(true);
+    shared->encode_thread.join();
+    shared->fanout_thread.join();
+  }
+
   void
   capture(
     safe::mail_t mail,
@@ -3447,7 +4182,12 @@ namespace video {
 
     idr_events->raise(true);
     if (chosen_encoder->flags & PARALLEL_ENCODING) {
-      capture_async(std::move(mail), config, channel_data, dynamic_param_events);
+      if (config::video.shared_encoding) {
+        capture_shared(std::move(mail), config, channel_data, dynamic_param_events);
+        return;
+      }
+
+      capture_async(std::move(mail), mail::man->queue<packet_t>(mail::video_packets), config, channel_data, dynamic_param_events);
     }
     else {
       safe::signal_t join_event;
@@ -3578,6 +4318,11 @@ namespace video {
 
   bool
   validate_encoder(encoder_t &encoder, bool expect_failure) {
+    return validate_encoder(encoder, expect_failure, active_hevc_mode, active_av1_mode);
+  }
+
+  bool
+  validate_encoder(encoder_t &encoder, bool expect_failure, int hevc_mode, int av1_mode) {
     std::shared_ptr<platf::display_t> disp;
 
     BOOST_LOG(info) << "Trying encoder ["sv << encoder.name << ']';
@@ -3597,8 +4342,8 @@ namespace video {
       // We'll let the actual validation fail naturally
     }
 
-    auto test_hevc = active_hevc_mode >= 2 || (active_hevc_mode == 0 && !(encoder.flags & H264_ONLY));
-    auto test_av1 = active_av1_mode >= 2 || (active_av1_mode == 0 && !(encoder.flags & H264_ONLY));
+    auto test_hevc = hevc_mode >= 2 || (hevc_mode == 0 && !(encoder.flags & H264_ONLY));
+    auto test_av1 = av1_mode >= 2 || (av1_mode == 0 && !(encoder.flags & H264_ONLY));
 
     encoder.h264.capabilities.set();
     encoder.hevc.capabilities.set();
@@ -3788,56 +4533,174 @@ namespace video {
     return true;
   }
 
-  int
-  probe_encoders() {
-    if (!allow_encoder_probing()) {
-      // Error already logged
-      return -1;
+  /**
+   * @brief Format version of the encoder cache, to be bumped whenever the stored results change meaning.
+   */
+  static constexpr int encoder_cache_version = 1;
+
+  std::string
+  serialize_probe_results(const std::string &key, const encoder_t &encoder) {
+    nlohmann::json tree;
+    tree["version"] = encoder_cache_version;
+    tree["key"] = key;
+    tree["encoder"] = std::string { encoder.name };
+    tree["h264"] = encoder.h264.capabilities.to_string();
+    tree["hevc"] = encoder.hevc.capabilities.to_string();
+    tree["av1"] = encoder.av1.capabilities.to_string();
+
+    return tree.dump(2);
+  }
+
+  encoder_t *
+  restore_probe_results(const std::string &data, const std::string &key, const std::vector<encoder_t *> &encoder_list) {
+    if (data.empty()) {
+      return nullptr;
     }
-    auto encoder_list = encoders;
 
-    // If we already have a good encoder, check to see if another probe is required
-    if (chosen_encoder && !(chosen_encoder->flags & ALWAYS_REPROBE) && !platf::needs_encoder_reenumeration()) {
-      BOOST_LOG(info) << "Using cached encoder validation results";
-      return 0;
+    try {
+      auto tree = nlohmann::json::parse(data);
+      if (tree.at("version").get<int>() != encoder_cache_version || tree.at("key").get<std::string>() != key) {
+        BOOST_LOG(info) << "Encoder cache is outdated"sv;
+        return nullptr;
+      }
+
+      auto name = tree.at("encoder").get<std::string>();
+      auto pos = std::find_if(std::begin(encoder_list), std::end(encoder_list), [&name](auto encoder) {
+        return encoder->name == name;
+      });
+      if (pos == std::end(encoder_list)) {
+        return nullptr;
+      }
+
+      // Parse every codec before touching the encoder
+      std::bitset<encoder_t::MAX_FLAGS> h264 { tree.at("h264").get<std::string>() };
+      std::bitset<encoder_t::MAX_FLAGS> hevc { tree.at("hevc").get<std::string>() };
+      std::bitset<encoder_t::MAX_FLAGS> av1 { tree.at("av1").get<std::string>() };
+      if (!h264[encoder_t::PASSED]) {
+        return nullptr;
+      }
+
+      auto encoder = *pos;
+      encoder->h264.capabilities = h264;
+      encoder->hevc.capabilities = hevc;
+      encoder->av1.capabilities = av1;
+      return encoder;
+    }
+    catch (const std::exception &e) {
+      BOOST_LOG(warning) << "Invalid encoder cache: "sv << e.what();
+      return nullptr;
+    }
+  }
+
+  namespace {
+    /**
+     * @brief Serializes probing between stream launches and the revalidation of cached results.
+     */
+    std::mutex probe_mutex;
+
+    /**
+     * @brief Validates cached probe results in the background after startup.
+     */
+    std::thread revalidation_thread;
+
+    /**
+     * @brief The encoder and codec support selected by a probe.
+     */
+    struct probe_result_t {
+      encoder_t *encoder {};
+      int hevc_mode {};
+      int av1_mode {};
+      bool ref_frames_invalidation {};
+      std::array<bool, 3> yuv444_for_codec {};
+    };
+
+    std::string
+    encoder_cache_path() {
+      return (platf::appdata() / "encoder_cache.json").string();
+    }
+
+    /**
+     * @brief Identify the hardware, software and settings that encoder probe results depend on.
+     */
+    std::string
+    encoder_cache_key() {
+      std::ostringstream key;
+      key << PROJECT_VER << '|' << av_version_info() << '|' << avcodec_version() << '|' << platf::gpu_fingerprint() << '|'
+          << config::video.encoder << '|' << config::video.adapter_name << '|' << config::video.output_name << '|'
+          << config::video.hevc_mode << '|' << config::video.av1_mode << '|'
+          << config::sunshine.flags[config::flag::FORCE_VIDEO_HEADER_REPLACE];
+
+      for (auto &name : platf::display_names(platf::mem_type_e::system)) {
+        key << '|' << name;
+      }
+
+      return key.str();
     }
+  }  // namespace
+
+  /**
+   * @brief Select the preferred encoder, by validating encoders or from the encoder cache.
+   * @details The results are only stored in `result`, so the codecs advertised to clients don't
+   *          change while encoders are validated. publish_probe_result() makes them current.
+   * @param use_cache Restore the results of a previous probe if the hardware and settings still match.
+   * @param result The selected encoder and codec support.
+   * @return `0` on success and `1` if the results came from the cache, or `-1` on failure.
+   */
+  static int
+  select_encoder(bool use_cache, probe_result_t &result) {
+    auto encoder_list = encoders;
 
     // Restart encoder selection
     auto previous_encoder = chosen_encoder;
-    chosen_encoder = nullptr;
-    active_hevc_mode = config::video.hevc_mode;
-    active_av1_mode = config::video.av1_mode;
-    last_encoder_probe_supported_ref_frames_invalidation = false;
+    encoder_t *selected = nullptr;
+    auto hevc_mode = config::video.hevc_mode;
+    auto av1_mode = config::video.av1_mode;
 
     auto adjust_encoder_constraints = [&](encoder_t *encoder) {
       // If we can't satisfy both the encoder and codec requirement, prefer the encoder over codec support
-      if (active_hevc_mode == 3 && !encoder->hevc[encoder_t::DYNAMIC_RANGE]) {
+      if (hevc_mode == 3 && !encoder->hevc[encoder_t::DYNAMIC_RANGE]) {
         BOOST_LOG(warning) << "Encoder ["sv << encoder->name << "] does not support HEVC Main10 on this system"sv;
-        active_hevc_mode = 0;
+        hevc_mode = 0;
       }
-      else if (active_hevc_mode == 2 && !encoder->hevc[encoder_t::PASSED]) {
+      else if (hevc_mode == 2 && !encoder->hevc[encoder_t::PASSED]) {
         BOOST_LOG(warning) << "Encoder ["sv << encoder->name << "] does not support HEVC on this system"sv;
-        active_hevc_mode = 0;
+        hevc_mode = 0;
       }
 
-      if (active_av1_mode == 3 && !encoder->av1[encoder_t::DYNAMIC_RANGE]) {
+      if (av1_mode == 3 && !encoder->av1[encoder_t::DYNAMIC_RANGE]) {
         BOOST_LOG(warning) << "Encoder ["sv << encoder->name << "] does not support AV1 Main10 on this system"sv;
-        active_av1_mode = 0;
+        av1_mode = 0;
       }
-      else if (active_av1_mode == 2 && !encoder->av1[encoder_t::PASSED]) {
+      else if (av1_mode == 2 && !encoder->av1[encoder_t::PASSED]) {
         BOOST_LOG(warning) << "Encoder ["sv << encoder->name << "] does not support AV1 on this system"sv;
-        active_av1_mode = 0;
+        av1_mode = 0;
       }
     };
 
-    if (!config::video.encoder.empty()) {
+    std::string cache_key;
+    if (config::video.encoder_probe_cache) {
+      cache_key = encoder_cache_key();
+    }
+
+    if (use_cache && config::video.encoder_probe_cache) {
+      selected = restore_probe_results(file_handler::read_file(encoder_cache_path().c_str()), cache_key, encoder_list);
+      if (selected) {
+        BOOST_LOG(info) << "Using cached encoder probe results for ["sv << selected->name << ']';
+
+        // The cached encoder met the codec requirements when it was selected
+        adjust_encoder_constraints(selected);
+      }
+    }
+    auto from_cache = selected != nullptr;
+
+    if (selected == nullptr && !config::video.encoder.empty()) {
       // If there is a specific encoder specified, use it if it passes validation
       KITTY_WHILE_LOOP(auto pos = std::begin(encoder_list), pos != std::end(encoder_list), {
         auto encoder = *pos;
 
         if (encoder->name == config::video.encoder) {
           // Remove the encoder from the list entirely if it fails validation
-          if (!validate_encoder(*encoder, previous_encoder && previous_encoder != encoder)) {
+          if (!validate_encoder(*encoder, previous_encoder && previous_encoder != encoder, hevc_mode, av1_mode)) {
             pos = encoder_list.erase(pos);
             break;
           }
@@ -3845,64 +4708,66 @@ namespace video {
           // We will return an encoder here even if it fails one of the codec requirements specified by the user
           adjust_encoder_constraints(encoder);
 
-          chosen_encoder = encoder;
+          selected = encoder;
           break;
         }
 
         pos++;
       });
 
-      if (chosen_encoder == nullptr) {
+      if (selected == nullptr) {
         BOOST_LOG(error) << "Couldn't find any working encoder matching ["sv << config::video.encoder << ']';
       }
     }
 
-    BOOST_LOG(info) << "Testing for available encoders - Errors during this phase can be ignored (测试可用编码器 - 此阶段的错误可以忽略)";
+    if (selected == nullptr) {
+      BOOST_LOG(info) << "Testing for available encoders - Errors during this phase can be ignored (测试可用编码器 - 此阶段的错误可以忽略)";
+    }
 
     // If we haven't found an encoder yet, but we want one with specific codec support, search for that now.
-    if (chosen_encoder == nullptr && (active_hevc_mode >= 2 || active_av1_mode >= 2)) {
+    if (selected == nullptr && (hevc_mode >= 2 || av1_mode >= 2)) {
       KITTY_WHILE_LOOP(auto pos = std::begin(encoder_list), pos != std::end(encoder_list), {
         auto encoder = *pos;
 
         // Remove the encoder from the list entirely if it fails validation
-        if (!validate_encoder(*encoder, previous_encoder && previous_encoder != encoder)) {
+        if (!validate_encoder(*encoder, previous_encoder && previous_encoder != encoder, hevc_mode, av1_mode)) {
           pos = encoder_list.erase(pos);
           continue;
         }
 
         // Skip it if it doesn't support the specified codec at all
-        if ((active_hevc_mode >= 2 && !encoder->hevc[encoder_t::PASSED]) ||
-            (active_av1_mode >= 2 && !encoder->av1[encoder_t::PASSED])) {
+        if ((hevc_mode >= 2 && !encoder->hevc[encoder_t::PASSED]) ||
+            (av1_mode >= 2 && !encoder->av1[encoder_t::PASSED])) {
           pos++;
           continue;
         }
 
         // Skip it if it doesn't support HDR on the specified codec
-        if ((active_hevc_mode == 3 && !encoder->hevc[encoder_t::DYNAMIC_RANGE]) ||
-            (active_av1_mode == 3 && !encoder->av1[encoder_t::DYNAMIC_RANGE])) {
+        if ((hevc_mode == 3 && !encoder->hevc[encoder_t::DYNAMIC_RANGE]) ||
+            (av1_mode == 3 && !encoder->av1[encoder_t::DYNAMIC_RANGE])) {
           pos++;
           continue;
         }
 
-        chosen_encoder = encoder;
+        selected = encoder;
         break;
       });
 
-      if (chosen_encoder == nullptr) {
+      if (selected == nullptr) {
         BOOST_LOG(error) << "Couldn't find any working encoder that meets HEVC/AV1 requirements"sv;
       }
     }
 
     // If no encoder was specified or the specified encoder was unusable, keep trying
     // the remaining encoders until we find one that passes validation.
-    if (chosen_encoder == nullptr) {
+    if (selected == nullptr) {
       KITTY_WHILE_LOOP(auto pos = std::begin(encoder_list), pos != std::end(encoder_list), {
         auto encoder = *pos;
 
         // If we've used a previous encoder and it's not this one, we expect this encoder to
         // fail to validate. It will use a slightly different order of checks to more quickly
         // eliminate failing encoders.
-        if (!validate_encoder(*encoder, previous_encoder && previous_encoder != encoder)) {
+        if (!validate_encoder(*encoder, previous_encoder && previous_encoder != encoder, hevc_mode, av1_mode)) {
           pos = encoder_list.erase(pos);
           continue;
         }
@@ -3910,12 +4775,12 @@ namespace video {
         // We will return an encoder here even if it fails one of the codec requirements specified by the user
         adjust_encoder_constraints(encoder);
 
-        chosen_encoder = encoder;
+        selected = encoder;
         break;
       });
     }
 
-    if (chosen_encoder == nullptr) {
+    if (selected == nullptr) {
       const auto output_display_name { display_device::get_display_name(config::video.output_name) };
       BOOST_LOG(error) << "Unable to find display or encoder during startup."sv;
       if (!config::video.adapter_name.empty() || !output_display_name.empty()) {
@@ -3927,17 +4792,25 @@ namespace video {
       return -1;
     }
 
-    BOOST_LOG(info) << "Ignore any errors, Encoder testing completed (忽略任何错误，编码器测试完成)";
+    auto &encoder = *selected;
+
+    if (!from_cache) {
+      BOOST_LOG(info) << "Ignore any errors, Encoder testing completed (忽略任何错误，编码器测试完成)";
 
-    auto &encoder = *chosen_encoder;
+      if (config::video.encoder_probe_cache &&
+          file_handler::write_file(encoder_cache_path().c_str(), serialize_probe_results(cache_key, encoder))) {
+        BOOST_LOG(warning) << "Couldn't write the encoder cache to "sv << encoder_cache_path();
+      }
+    }
 
-    last_encoder_probe_supported_ref_frames_invalidation = (encoder.flags & REF_FRAMES_INVALIDATION);
-    last_encoder_probe_supported_yuv444_for_codec[0] = encoder.h264[encoder_t::PASSED] &&
-                                                       encoder.h264[encoder_t::YUV444];
-    last_encoder_probe_supported_yuv444_for_codec[1] = encoder.hevc[encoder_t::PASSED] &&
-                                                       encoder.hevc[encoder_t::YUV444];
-    last_encoder_probe_supported_yuv444_for_codec[2] = encoder.av1[encoder_t::PASSED] &&
-                                                       encoder.av1[encoder_t::YUV444];
+    result.encoder = selected;
+    result.ref_frames_invalidation = (encoder.flags & REF_FRAMES_INVALIDATION);
+    result.yuv444_for_codec[0] = encoder.h264[encoder_t::PASSED] &&
+                                 encoder.h264[encoder_t::YUV444];
+    result.yuv444_for_codec[1] = encoder.hevc[encoder_t::PASSED] &&
+                                 encoder.hevc[encoder_t::YUV444];
+    result.yuv444_for_codec[2] = encoder.av1[encoder_t::PASSED] &&
+                                 encoder.av1[encoder_t::YUV444];
 
     BOOST_LOG(debug) << "------  h264 ------"sv;
     for (int x = 0; x < encoder_t::MAX_FLAGS; ++x) {
@@ -3969,17 +4842,97 @@ namespace video {
       BOOST_LOG(info) << "Found AV1 encoder: "sv << encoder.av1.name << " ["sv << encoder.name << ']';
     }
 
-    if (active_hevc_mode == 0) {
-      active_hevc_mode = encoder.hevc[encoder_t::PASSED] ? (encoder.hevc[encoder_t::DYNAMIC_RANGE] ? 3 : 2) : 1;
+    if (hevc_mode == 0) {
+      hevc_mode = encoder.hevc[encoder_t::PASSED] ? (encoder.hevc[encoder_t::DYNAMIC_RANGE] ? 3 : 2) : 1;
     }
 
-    if (active_av1_mode == 0) {
-      active_av1_mode = encoder.av1[encoder_t::PASSED] ? (encoder.av1[encoder_t::DYNAMIC_RANGE] ? 3 : 2) : 1;
+    if (av1_mode == 0) {
+      av1_mode = encoder.av1[encoder_t::PASSED] ? (encoder.av1[encoder_t::DYNAMIC_RANGE] ? 3 : 2) : 1;
     }
 
+    result.hevc_mode = hevc_mode;
+    result.av1_mode = av1_mode;
+
+    return from_cache ? 1 : 0;
+  }
+
+  /**
+   * @brief Make the results of select_encoder() current. The caller must hold `probe_mutex`.
+   */
+  static void
+  publish_probe_result(const probe_result_t &result) {
+    chosen_encoder = result.encoder;
+    active_hevc_mode = result.hevc_mode;
+    active_av1_mode = result.av1_mode;
+    last_encoder_probe_supported_ref_frames_invalidation = result.ref_frames_invalidation;
+    last_encoder_probe_supported_yuv444_for_codec = result.yuv444_for_codec;
+  }
+
+  int
+  probe_encoders() {
+    std::lock_guard lg { probe_mutex };
+
+    if (!allow_encoder_probing()) {
+      // Error already logged
+      return -1;
+    }
+
+    // If we already have a good encoder, check to see if another probe is required
+    if (chosen_encoder && !(chosen_encoder->flags & ALWAYS_REPROBE) && !platf::needs_encoder_reenumeration()) {
+      BOOST_LOG(info) << "Using cached encoder validation results";
+      return 0;
+    }
+
+    // Only the startup probe is answered from the cache, later ones are expected to catch changes
+    static bool first_probe = true;
+    probe_result_t result;
+    auto status = select_encoder(std::exchange(first_probe, false), result);
+    if (status < 0) {
+      publish_probe_result({ nullptr, config::video.hevc_mode, config::video.av1_mode });
+      return status;
+    }
+
+    publish_probe_result(result);
+    if (status == 0) {
+      return 0;
+    }
+
+    // Validate the cached results in the background, so the advertised codecs are corrected before
+    // a client relies on them. A stream launched in the meantime waits for the new results.
+    auto cached = serialize_probe_results({}, *chosen_encoder);
+    revalidation_thread = std::thread { [cached = std::move(cached)]() {
+      std::lock_guard lg { probe_mutex };
+
+      if (mail::man->event<bool>(mail::shutdown)->peek() || !allow_encoder_probing()) {
+        return;
+      }
+
+      BOOST_LOG(info) << "Revalidating cached encoder probe results"sv;
+      probe_result_t result;
+      if (select_encoder(false, result) < 0) {
+        // Keep advertising the cached codecs, the next stream launch probes again
+        BOOST_LOG(warning) << "The cached encoder no longer works, encoders will be probed again on the next stream"sv;
+        chosen_encoder = nullptr;
+        return;
+      }
+
+      auto outdated = serialize_probe_results({}, *result.encoder) != cached;
+      publish_probe_result(result);
+      if (outdated) {
+        BOOST_LOG(warning) << "Cached encoder probe results were outdated and have been replaced"sv;
+      }
+    } };
+
     return 0;
   }
 
+  void
+  join_probe_revalidation() {
+    if (revalidation_thread.joinable()) {
+      revalidation_thread.join();
+    }
+  }
+
   // Linux only declaration
   typedef int (*vaapi_init_avcodec_hardware_input_buffer_fn)(platf::avcodec_encode_device_t *encode_device, AVBufferRef **hw_device_buf);
 
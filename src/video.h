@@ -49,6 +49,16 @@ namespace video {
   // 动态参数调节事件类型
   using dynamic_param_change_event_t = safe::mail_raw_t::event_t<dynamic_param_t>;
 
+  /**
+   * @brief How a dynamic parameter change reaches a running encoder.
+   */
+  enum class reconfigure_e : int {
+    in_place,  ///< The running encoder applies the change, without a keyframe
+    soft,  ///< A new encoder is built in the background while the old one keeps running, then swapped in
+    hard,  ///< The capture pipeline has to reinitialize, which rebuilds the encoder
+    ignored,  ///< The encoder can't apply the change
+  };
+
   /* Encoding configuration requested by remote client */
   struct config_t {
     int width;  // Video width in pixels
@@ -93,6 +103,84 @@ namespace video {
       }
       return static_cast<double>(framerate);
     }
+
+    bool
+    operator==(const config_t &) const = default;
+  };
+
+  /**
+   * @brief Record a dynamic parameter change in an encoder configuration.
+   * @details Keeps the configuration in step with the running encoder, so an encoder rebuilt
+   *          later starts with the same settings.
+   * @param config The configuration to update.
+   * @param param The parameter change.
+   * @return `true` if the parameter is part of the configuration.
+   */
+  bool
+  apply_dynamic_param(config_t &config, const dynamic_param_t &param);
+
+  /**
+   * @brief Decides when the encoder takes captured frames, so frames leave at a steady cadence.
+   * @details Ticks are spaced by the frame interval of the stream and follow the arrival of captured
+   *          frames, so a frame arriving on time is encoded right away. A frame arriving early, like
+   *          the second frame of a burst, is held until the window of the next tick opens and
+   *          replaced if a newer frame arrives meanwhile. When no frame arrives shortly after a tick,
+   *          the previous frame is encoded again instead of leaving a gap in the stream.
+   */
+  class frame_pacer_t {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    explicit frame_pacer_t(double framerate);
+
+    void
+    set_framerate(double framerate);
+
+    /**
+     * @brief How long to wait for a captured frame before encoding a duplicate.
+     */
+    clock::duration
+    wait_for(clock::time_point now) const;
+
+    /**
+     * @brief How long to hold a captured frame that arrived before the window of the next tick.
+     */
+    clock::duration
+    hold_for(clock::time_point now) const;
+
+    /**
+     * @brief Follow the arrival of a captured frame.
+     * @param arrival When the frame was captured.
+     */
+    void
+    frame_arrived(clock::time_point arrival);
+
+    /**
+     * @brief Record a held frame replaced by a newer one.
+     */
+    void
+    frame_dropped();
+
+    /**
+     * @brief Move on to the next tick after encoding a frame.
+     * @param now When the frame was handed to the encoder.
+     * @param duplicate The frame is a repeat of the previous one.
+     */
+    void
+    frame_released(clock::time_point now, bool duplicate);
+
+    std::uint64_t released = 0;  ///< Frames handed to the encoder, including duplicates
+    std::uint64_t dropped = 0;  ///< Frames replaced by a newer one while held
+    std::uint64_t duplicated = 0;  ///< Ticks without a captured frame
+
+  private:
+    clock::duration period;
+    std::optional<clock::time_point> next_tick;
+
+    /**
+     * @brief Smoothed distance between frame arrivals and their tick.
+     */
+    clock::duration jitter {};
   };
 
   platf::mem_type_e
@@ -287,6 +375,25 @@ namespace video {
 
     virtual void
     set_dynamic_param(const dynamic_param_t &param) = 0;  // 新增：通用动态参数调整方法
+
+    /**
+     * @brief Classify how a dynamic parameter change can be applied to this encoder.
+     * @details Every encoder changes its bitrate in place. A new framerate only needs a new
+     *          encoder for the same display, while a new resolution reinitializes the capture.
+     */
+    virtual reconfigure_e
+    reconfigure_kind(dynamic_param_type_e type) const {
+      switch (type) {
+        case dynamic_param_type_e::BITRATE:
+          return reconfigure_e::in_place;
+        case dynamic_param_type_e::FPS:
+          return reconfigure_e::soft;
+        case dynamic_param_type_e::RESOLUTION:
+          return reconfigure_e::hard;
+        default:
+          return reconfigure_e::ignored;
+      }
+    }
   };
 
   // encoders
@@ -402,6 +509,41 @@ namespace video {
     bool idr;
   };
 
+  /**
+   * @brief A frame of a shared encoder, renumbered for one of the sessions it is sent to.
+   */
+  struct packet_raw_shared_t: packet_raw_t {
+    packet_raw_shared_t(std::shared_ptr<packet_raw_t> source, int64_t frame_index):
+        source { std::move(source) }, index { frame_index } {
+      replacements = this->source->replacements;
+      after_ref_frame_invalidation = this->source->after_ref_frame_invalidation;
+      frame_timestamp = this->source->frame_timestamp;
+    }
+
+    bool
+    is_idr() override {
+      return source->is_idr();
+    }
+
+    int64_t
+    frame_index() override {
+      return index;
+    }
+
+    uint8_t *
+    data() override {
+      return source->data();
+    }
+
+    size_t
+    data_size() override {
+      return source->data_size();
+    }
+
+    std::shared_ptr<packet_raw_t> source;
+    int64_t index;
+  };
+
   using packet_t = std::unique_ptr<packet_raw_t>;
 
   struct hdr_info_raw_t {
@@ -431,6 +573,34 @@ namespace video {
   bool
   validate_encoder(encoder_t &encoder, bool expect_failure);
 
+  /**
+   * @brief Validate an encoder for the given codec requirements.
+   * @param hevc_mode The HEVC mode to test for, as in `config::video.hevc_mode`.
+   * @param av1_mode The AV1 mode to test for, as in `config::video.av1_mode`.
+   */
+  bool
+  validate_encoder(encoder_t &encoder, bool expect_failure, int hevc_mode, int av1_mode);
+
+  /**
+   * @brief Serialize the probe results of the chosen encoder for the encoder cache.
+   * @param key Identifies the hardware, drivers and settings the results are valid for.
+   * @param encoder The encoder chosen by the probe.
+   * @return The contents of the cache file.
+   */
+  std::string
+  serialize_probe_results(const std::string &key, const encoder_t &encoder);
+
+  /**
+   * @brief Restore probe results saved by serialize_probe_results().
+   * @param data The contents of the cache file.
+   * @param key The key of the current hardware, drivers and settings.
+   * @param encoder_list The encoders the cached one can be picked from.
+   * @return The cached encoder with its capabilities restored, or `nullptr` if the cache is
+   *         missing, invalid or was saved for another key. No encoder is changed then.
+   */
+  encoder_t *
+  restore_probe_results(const std::string &data, const std::string &key, const std::vector<encoder_t *> &encoder_list);
+
   /**
    * @brief Probe encoders and select the preferred encoder.
    * This is called once at startup and each time a stream is launched to
@@ -438,7 +608,16 @@ namespace video {
    * at runtime due to all sorts of things from driver updates to eGPUs.
    *
    * @warning This is only safe to call when there is no client actively streaming.
+   *
+   * The probe at startup reuses the results saved in the encoder cache when the GPUs, drivers,
+   * FFmpeg and settings are unchanged, and validates them again in the background.
    */
   int
   probe_encoders();
+
+  /**
+   * @brief Wait for the background validation of cached probe results, if one was started.
+   */
+  void
+  join_probe_revalidation();
 }  // namespace video
@@ -5,6 +5,11 @@
 #include <src/platform/common.h>
 
 #include <boost/asio/ip/host_name.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#ifdef __linux__
+  #include <time.h>
+#endif
 
 #include "../../tests_common.h"
 
@@ -54,3 +59,116 @@ TEST(HostnameTests, TestAsioEquality) {
   // These should be equivalent on all platforms for ASCII hostnames
   ASSERT_EQ(platf::get_host_name(), boost::asio::ip::host_name());
 }
+
+TEST(BatchedSendTests, SendTimeForBlockTest) {
+  auto address = boost::asio::ip::address {};
+  std::vector<platf::buffer_descriptor_t> payload_buffers;
+  platf::batched_send_info_t send_info {
+    nullptr,
+    0,
+    payload_buffers,
+    0,
+    0,
+    0,
+    0,
+    address,
+    0,
+    address,
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  send_info.send_time = start;
+  send_info.send_interval = std::chrono::microseconds { 14 };
+
+  ASSERT_EQ(send_info.send_time_for_block(0), start);
+  ASSERT_EQ(send_info.send_time_for_block(1), start + std::chrono::microseconds { 14 });
+  ASSERT_EQ(send_info.send_time_for_block(64), start + std::chrono::microseconds { 14 * 64 });
+}
+
+#ifdef __linux__
+TEST(BatchedSendTests, SteadyClockIsMonotonicClockTest) {
+  // SO_TXTIME departure times are steady_clock time points passed to the kernel as CLOCK_MONOTONIC
+  timespec ts;
+  ASSERT_EQ(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+  auto monotonic = std::chrono::seconds { ts.tv_sec } + std::chrono::nanoseconds { ts.tv_nsec };
+  auto steady = std::chrono::steady_clock::now().time_since_epoch();
+
+  ASSERT_LT(std::chrono::abs(steady - monotonic), std::chrono::seconds { 1 });
+}
+#endif
+
+TEST(BatchedSendTests, ZeroCopySendCompletesTest) {
+  boost::asio::io_context io_context;
+  auto loopback = boost::asio::ip::address { boost::asio::ip::address_v4::loopback() };
+  boost::asio::ip::udp::socket receiver { io_context, { loopback, 0 } };
+  boost::asio::ip::udp::socket sender { io_context, boost::asio::ip::udp::v4() };
+
+  auto zerocopy = platf::enable_socket_zerocopy(sender.native_handle());
+  if (!zerocopy) {
+    GTEST_SKIP() << "Zero-copy sends are not supported";
+  }
+
+  constexpr size_t packets = 4;
+  constexpr size_t payload_size = 1024;
+  std::vector<char> headers(packets * 16);
+  std::vector<char> payload(packets * payload_size, 'x');
+  std::vector<platf::buffer_descriptor_t> payload_buffers { { payload.data(), payload.size() } };
+
+  platf::batched_send_info_t send_info {
+    headers.data(),
+    16,
+    payload_buffers,
+    payload_size,
+    0,
+    packets,
+    (uintptr_t) sender.native_handle(),
+    loopback,
+    receiver.local_endpoint().port(),
+    loopback,
+  };
+  send_info.zerocopy = zerocopy.get();
+
+  ASSERT_TRUE(platf::send_batch(send_info));
+  ASSERT_GT(send_info.syscalls, 0);
+  ASSERT_GT(zerocopy->sends(), 0);
+  ASSERT_TRUE(zerocopy->wait(zerocopy->sends(), std::chrono::seconds { 1 }));
+
+  // Loopback never transmits from user memory, so the kernel reports every send as copied
+  ASSERT_EQ(zerocopy->copied(), zerocopy->sends());
+}
+
+TEST(BatchedRecvTests, DrainsQueuedDatagramsTest) {
+  boost::asio::io_context io_context;
+  auto loopback = boost::asio::ip::address { boost::asio::ip::address_v4::loopback() };
+  boost::asio::ip::udp::socket receiver { io_context, { loopback, 0 } };
+  boost::asio::ip::udp::socket sender { io_context, { loopback, 0 } };
+
+  for (size_t size = 1; size <= 3; ++size) {
+    sender.send_to(boost::asio::buffer(std::string(size, 'x')), receiver.local_endpoint());
+  }
+
+  std::array<std::array<char, 64>, 8> buffers;
+  std::array<platf::received_datagram_t, 8> datagrams;
+  platf::recv_batch_info_t recv_info {
+    (uintptr_t) receiver.native_handle(),
+    buffers[0].data(),
+    buffers[0].size(),
+    datagrams.data(),
+    datagrams.size(),
+  };
+
+  auto count = platf::recv_batch(recv_info);
+  if (count < 0) {
+    GTEST_SKIP() << "Batched receive is not supported";
+  }
+
+  // Loopback delivers synchronously, so all datagrams are already queued
+  ASSERT_EQ(count, 3);
+  for (size_t x = 0; x < 3; ++x) {
+    ASSERT_EQ(datagrams[x].size, x + 1);
+    ASSERT_EQ(datagrams[x].address, loopback);
+    ASSERT_EQ(datagrams[x].port, sender.local_endpoint().port());
+  }
+
+  ASSERT_EQ(platf::recv_batch(recv_info), 0);
+}
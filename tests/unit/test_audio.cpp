@@ -2,7 +2,10 @@
  * @file tests/unit/test_audio.cpp
  * @brief Test src/audio.*.
  */
+#include <set>
+
 #include <src/audio.h>
+#include <src/config.h>
 
 #include "../tests_common.h"
 
@@ -53,7 +56,7 @@ TEST_P(AudioTest, TestEncode) {
       if (shutdown_event->peek()) {
         break;
       }
-      if (auto packet_data = packet->second; packet_data.size() == 0) {
+      if (auto &packet_data = packet->second; packet_data->data.size() == 0) {
         FAIL() << "Empty packet data";
       }
     }
@@ -63,3 +66,166 @@ TEST_P(AudioTest, TestEncode) {
   timer.join();
   capture.join();
 }
+
+TEST(AudioBufferPoolTests, ReuseTest) {
+  buffer_pool_t pool { 16 };
+
+  // Released buffers come back from the pool instead of new ones
+  auto frame = pool.frame();
+  auto frame_p = frame.get();
+  frame.reset();
+  ASSERT_EQ(pool.frame().get(), frame_p);
+
+  auto packet = pool.packet();
+  auto packet_p = packet.get();
+  packet->data.fake_resize(10);
+  packet.reset();
+
+  // A reused packet has room for a whole packet again
+  packet = pool.packet();
+  ASSERT_EQ(packet.get(), packet_p);
+  ASSERT_EQ(packet->data.size(), buffer_pool_t::max_packet_size);
+}
+
+TEST(AudioBufferPoolTests, SteadyStateTest) {
+  constexpr int samples_per_frame = 240 * 2;
+
+  buffer_pool_t pool { samples_per_frame };
+  safe::queue_t<std::shared_ptr<std::vector<float>>> samples { buffer_pool_t::frame_capacity - 2 };
+  safe::queue_t<packet_t> packets { 32 };
+
+  std::set<void *> frames_seen;
+  std::set<void *> packets_seen;
+
+  // Pass frames from capture to encode to broadcast, with a few of them queued at each step
+  auto run = [&](int rounds) {
+    for (int x = 0; x < rounds; ++x) {
+      auto frame = pool.frame();
+      ASSERT_EQ(frame->size(), samples_per_frame);
+      frames_seen.emplace(frame.get());
+      samples.raise(std::move(frame));
+      if (x % 4 != 3) {
+        continue;
+      }
+
+      while (auto sample = samples.pop(0ms)) {
+        auto packet = pool.packet();
+        ASSERT_EQ(packet->data.size(), buffer_pool_t::max_packet_size);
+        packet->data.fake_resize(x % 200 + 1);
+        packets_seen.emplace(packet.get());
+        packets.raise(nullptr, std::move(packet));
+      }
+
+      while (packets.unsafe().size() > 8) {
+        packets.pop(0ms);
+      }
+    }
+  };
+
+  run(100);
+  auto frames_allocated = pool.frame_stats().allocated;
+  auto packets_allocated = pool.packet_stats().allocated;
+
+  // Once warmed up, the same few buffers go around without the pools allocating more
+  run(10000);
+  ASSERT_EQ(pool.frame_stats().allocated, frames_allocated);
+  ASSERT_EQ(pool.packet_stats().allocated, packets_allocated);
+  ASSERT_EQ(frames_seen.size(), frames_allocated);
+  ASSERT_EQ(packets_seen.size(), packets_allocated);
+  ASSERT_EQ(pool.frame_stats().exhausted, 0);
+  ASSERT_EQ(pool.packet_stats().exhausted, 0);
+  ASSERT_LE(pool.packet_stats().allocated, 16);
+}
+
+TEST(AudioBufferPoolTests, ExhaustedTest) {
+  buffer_pool_t pool { 16 };
+
+  std::vector<std::shared_ptr<std::vector<float>>> frames;
+  for (std::size_t x = 0; x < buffer_pool_t::frame_capacity; ++x) {
+    frames.emplace_back(pool.frame());
+  }
+
+  // Audio isn't dropped when every frame is in flight
+  auto frame = pool.frame();
+  ASSERT_NE(frame, nullptr);
+  ASSERT_EQ(frame->size(), 16);
+  ASSERT_EQ(pool.frame_stats().exhausted, 1);
+
+  // Frames come back to the pool once released
+  frames.clear();
+  ASSERT_EQ(pool.frame_stats().in_use, 0);
+  ASSERT_EQ(pool.frame_stats().allocated, buffer_pool_t::frame_capacity);
+}
+
+TEST(AudioLatencyTests, LateTest) {
+  auto captured = std::chrono::steady_clock::now();
+
+  ASSERT_FALSE(is_late(captured, captured + 50ms, 50ms));
+  ASSERT_TRUE(is_late(captured, captured + 51ms, 50ms));
+
+  // A budget of 0 never drops audio
+  ASSERT_FALSE(is_late(captured, captured + 10s, 0ms));
+}
+
+TEST(AudioLatencyTests, PipelineTest) {
+  auto budget = std::exchange(config::audio.latency_budget, 500);
+  auto restore_budget = util::fail_guard([budget]() {
+    config::audio.latency_budget = budget;
+  });
+
+  config_t config { 5, 2, 0x3, { 0 }, config_flags() };
+  auto pool = std::make_shared<buffer_pool_t>(240 * 2);
+  auto samples = std::make_shared<sample_queue_t::element_type>(buffer_pool_t::frame_capacity - 2);
+  auto subscribers = std::make_shared<subscribers_t>();
+  auto session_mail = std::make_shared<safe::mail_raw_t>();
+  int session;
+  subscribers->sessions.emplace_back(subscribers_t::subscriber_t { &session, session_mail->event<bool>(mail::shutdown) });
+
+  // Drop packets left by other tests
+  auto packets = mail::man->queue<packet_t>(mail::audio_packets);
+  while (packets->pop(0ms)) {}
+
+  std::thread encoder { encodeThread, samples, config, subscribers, pool };
+
+  // Two stalls, of 3 and 2 frames that waited past the budget
+  auto stale = std::chrono::steady_clock::now() - 10s;
+  for (bool late : { true, true, true, false, false, true, true, false }) {
+    auto frame = pool->frame();
+    std::fill(std::begin(*frame), std::end(*frame), 0.0f);
+    samples->raise(frame_t { std::move(frame), late ? stale : std::chrono::steady_clock::now() });
+  }
+
+  std::vector<std::shared_ptr<packet_raw_t>> encoded;
+  while (encoded.size() < 3) {
+    auto packet = packets->pop(5s);
+    ASSERT_TRUE(packet);
+    ASSERT_EQ(packet->first, &session);
+    encoded.emplace_back(std::move(packet->second));
+  }
+  samples->stop();
+  encoder.join();
+
+  // The encoder only encodes frames within the budget, and passes the count of dropped ones along
+  ASSERT_EQ(encoded[0]->dropped_before, 3);
+  ASSERT_EQ(encoded[1]->dropped_before, 0);
+  ASSERT_EQ(encoded[2]->dropped_before, 2);
+  ASSERT_FALSE(packets->peek());
+
+  // Send the packets as the broadcast thread does, with the second one delayed past the budget
+  latency_tracker_t latency;
+  std::uint16_t sequence_number = 0;
+  std::vector<std::uint16_t> sent;
+  for (std::size_t x = 0; x < encoded.size(); ++x) {
+    auto now = encoded[x]->captured + (x == 1 ? 600ms : 10ms);
+    if (!latency.admit(*encoded[x], now, 500ms)) {
+      continue;
+    }
+
+    sent.emplace_back(sequence_number++);
+  }
+
+  // Every dropped frame and packet is counted, and the packets sent have consecutive sequence numbers
+  ASSERT_EQ(latency.late_packets.load(), 6);
+  ASSERT_EQ(sent, (std::vector<std::uint16_t> { 0, 1 }));
+  ASSERT_DOUBLE_EQ(latency.avg_ms, 10.0 / 32 + (10.0 - 10.0 / 32) / 32);
+}
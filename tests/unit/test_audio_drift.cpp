@@ -0,0 +1,112 @@
+/**
+ * @file tests/unit/test_audio_drift.cpp
+ * @brief Test src/audio_drift.*
+ */
+#include <cmath>
+#include <numbers>
+#include <random>
+
+#include <src/audio_drift.h>
+
+#include "../tests_common.h"
+
+using namespace audio;
+
+namespace {
+  constexpr double sample_rate = 48000;
+  constexpr std::size_t frame_size = 240;
+}  // namespace
+
+TEST(AudioResamplerTests, SineTest) {
+  constexpr int channels = 2;
+  constexpr double ratio = 1.0005;
+  constexpr double frequency = 1000;
+
+  resampler_t resampler { channels, frame_size };
+
+  std::vector<float> in(frame_size * channels);
+  std::vector<float> out(frame_size * channels);
+  std::size_t in_frames = 0;
+  std::size_t out_frames = 0;
+  std::size_t produced = 0;
+  double max_error = 0;
+
+  for (int packet = 0; packet < 400; ++packet) {
+    for (std::size_t x = 0; x < frame_size; ++x, ++in_frames) {
+      auto value = (float) std::sin(2 * std::numbers::pi * frequency * in_frames / sample_rate);
+      in[x * channels] = value;
+      in[x * channels + 1] = -value;
+    }
+
+    produced += resampler.process(in.data(), frame_size, ratio);
+    while (resampler.pop(out.data(), frame_size)) {
+      for (std::size_t x = 0; x < frame_size; ++x, ++out_frames) {
+        // Skip the zeros the filter starts with
+        if (out_frames < resampler_t::taps) {
+          continue;
+        }
+
+        // Output sample n lands on input sample n / ratio
+        auto expected = std::sin(2 * std::numbers::pi * frequency * (out_frames / ratio) / sample_rate);
+        max_error = std::max(max_error, std::abs(out[x * channels] - expected));
+        max_error = std::max(max_error, std::abs(out[x * channels + 1] + expected));
+      }
+    }
+  }
+
+  // More output than input by the ratio, less what the filter holds back
+  ASSERT_NEAR((double) produced, in_frames * ratio, resampler_t::taps);
+  ASSERT_LT(max_error, 1e-4);
+}
+
+/**
+ * @brief Simulate a sound card running 200 ppm fast for an hour, with capture jitter.
+ */
+TEST(AudioDriftTests, ConvergenceTest) {
+  constexpr double device_drift = 200e-6;
+
+  drift_estimator_t estimator { sample_rate };
+  std::mt19937 rng { 1 };
+  std::uniform_real_distribution<double> jitter { 0, 0.003 };
+
+  auto start = std::chrono::steady_clock::time_point {};
+  auto interval = frame_size / (sample_rate * (1 + device_drift));
+  double resampled = 0;
+  std::size_t emitted = 0;
+  double max_late_offset = 0;
+
+  constexpr int packets = 3600 * 200;
+  for (int packet = 0; packet < packets; ++packet) {
+    // Samples leave the resampler at the current ratio
+    resampled += frame_size * estimator.ratio();
+    auto produced = (std::size_t) resampled - emitted;
+    emitted += produced;
+
+    auto now = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(packet * interval + jitter(rng)));
+    estimator.update(now, produced);
+
+    // Once locked, the output stays within a millisecond of the steady clock
+    if (packet > packets / 2) {
+      max_late_offset = std::max(max_late_offset, std::abs(estimator.offset()));
+    }
+  }
+
+  ASSERT_NEAR(estimator.ratio(), 1 / (1 + device_drift), 5e-6);
+  ASSERT_LT(max_late_offset, 0.001);
+}
+
+TEST(AudioDriftTests, GapTest) {
+  drift_estimator_t estimator { sample_rate };
+  auto now = std::chrono::steady_clock::time_point {};
+
+  for (int packet = 0; packet < 1000; ++packet, now += 5ms) {
+    estimator.update(now, frame_size);
+  }
+  ASSERT_NEAR(estimator.ratio(), 1.0, 1e-6);
+
+  // A stall in capture isn't mistaken for drift
+  now += 500ms;
+  estimator.update(now, frame_size);
+  ASSERT_NEAR(estimator.ratio(), 1.0, 1e-6);
+  ASSERT_EQ(estimator.offset(), 0);
+}
@@ -0,0 +1,282 @@
+/**
+ * @file tests/unit/test_bgra_convert.cpp
+ * @brief Test src/bgra_convert.*
+ */
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+#include <src/bgra_convert.h>
+}
+
+#include <src/video_colorspace.h>
+
+#include "../tests_common.h"
+
+namespace {
+  constexpr int tile_size = 32;
+
+  /**
+   * @brief A BGR0 image made of flat tiles of random colours.
+   * @details Inside the tiles, chroma doesn't depend on the filter used to subsample it.
+   */
+  struct bgra_image_t {
+    bgra_image_t(int width, int height):
+        width { width }, height { height }, data(width * height * 4) {
+      std::srand(1);
+
+      std::vector<uint32_t> tiles((width / tile_size + 1) * (height / tile_size + 1));
+      for (auto &tile : tiles) {
+        tile = std::rand() & 0xFFFFFF;
+      }
+
+      for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+          auto tile = tiles[(y / tile_size) * (width / tile_size + 1) + x / tile_size];
+          std::memcpy(&data[(y * width + x) * 4], &tile, 4);
+        }
+      }
+    }
+
+    int width;
+    int height;
+    std::vector<uint8_t> data;
+  };
+
+  struct yuv_frame_t {
+    yuv_frame_t(AVPixelFormat format, int width, int height):
+        format { format }, width { width }, height { height } {
+      auto desc = av_pix_fmt_desc_get(format);
+      auto sample_size = desc->comp[0].step;
+      auto planes = av_pix_fmt_count_planes(format);
+
+      for (int plane = 0; plane < planes; ++plane) {
+        auto plane_height = plane == 0 ? height : height / 2;
+        linesize[plane] = plane == 0 ? width * sample_size : width / 2 * desc->comp[plane].step;
+        buffers[plane].resize(linesize[plane] * plane_height);
+        data[plane] = buffers[plane].data();
+      }
+    }
+
+    /**
+     * @brief Read a sample as a value of the output bit depth.
+     */
+    int
+    sample(int plane, int component, int x, int y) const {
+      auto desc = av_pix_fmt_desc_get(format);
+      auto &comp = desc->comp[component];
+      auto p = data[plane] + y * linesize[plane] + x * comp.step + comp.offset;
+      if (comp.depth > 8) {
+        return *(const uint16_t *) p >> comp.shift;
+      }
+      return *p;
+    }
+
+    AVPixelFormat format;
+    int width;
+    int height;
+    uint8_t *data[3] {};
+    int linesize[3] {};
+    std::vector<uint8_t> buffers[3];
+  };
+
+  /**
+   * @brief Create a swscale context configured like the software encode device.
+   */
+  SwsContext *
+  make_sws(const bgra_image_t &image, const yuv_frame_t &frame, const video::sunshine_colorspace_t &colorspace) {
+    auto sws = sws_getContext(image.width, image.height, AV_PIX_FMT_BGR0, frame.width, frame.height, frame.format, SWS_LANCZOS | SWS_ACCURATE_RND, nullptr, nullptr, nullptr);
+    if (!sws) {
+      return nullptr;
+    }
+
+    auto avcodec_colorspace = video::avcodec_colorspace_from_sunshine_colorspace(colorspace);
+    sws_setColorspaceDetails(sws,
+      sws_getCoefficients(SWS_CS_DEFAULT), 0,
+      sws_getCoefficients(avcodec_colorspace.software_format), avcodec_colorspace.range - 1,
+      0, 1 << 16, 1 << 16);
+
+    return sws;
+  }
+
+  void
+  sws_convert(SwsContext *sws, const bgra_image_t &image, yuv_frame_t &frame) {
+    const uint8_t *src[] = { image.data.data() };
+    const int src_stride[] = { image.width * 4 };
+    sws_scale(sws, src, src_stride, 0, image.height, frame.data, frame.linesize);
+  }
+
+  bgra_convert_matrix_t
+  make_matrix(const video::sunshine_colorspace_t &colorspace) {
+    auto color_vectors = video::color_vectors_from_colorspace(colorspace, false);
+
+    bgra_convert_matrix_t matrix;
+    bgra_convert_matrix_init(&matrix, color_vectors->color_vec_y, color_vectors->color_vec_u, color_vectors->color_vec_v, colorspace.bit_depth);
+    return matrix;
+  }
+
+  struct format_t {
+    AVPixelFormat format;
+    bgra_convert_t *convert;
+  };
+}  // namespace
+
+struct BgraConvertTest: testing::TestWithParam<std::tuple<video::colorspace_e, bool, format_t>> {
+  void
+  SetUp() override {
+    bgra_convert_init();
+  }
+};
+
+TEST_P(BgraConvertTest, MatchesSwscaleTest) {
+  auto [colorspace_type, full_range, format] = GetParam();
+
+  auto bit_depth = av_pix_fmt_desc_get(format.format)->comp[0].depth;
+  if (colorspace_type == video::colorspace_e::bt2020 && bit_depth == 8) {
+    GTEST_SKIP() << "BT.2020 is only used with 10-bit formats";
+  }
+  video::sunshine_colorspace_t colorspace { colorspace_type, full_range, (unsigned) bit_depth };
+
+  bgra_image_t image { 256, 128 };
+
+  yuv_frame_t golden { format.format, image.width, image.height };
+  auto sws = make_sws(image, golden, colorspace);
+  ASSERT_NE(sws, nullptr);
+  sws_convert(sws, image, golden);
+  sws_freeContext(sws);
+
+  yuv_frame_t frame { format.format, image.width, image.height };
+  auto matrix = make_matrix(colorspace);
+  ASSERT_NE(*format.convert, nullptr);
+  (*format.convert)(image.data.data(), image.width * 4, image.width, image.height, frame.data, frame.linesize, &matrix);
+
+  // Rounding differs slightly, the tolerance is about one 8-bit code value
+  auto tolerance = bit_depth > 8 ? 5 : 1;
+
+  for (int y = 0; y < image.height; ++y) {
+    for (int x = 0; x < image.width; ++x) {
+      ASSERT_NEAR(frame.sample(0, 0, x, y), golden.sample(0, 0, x, y), tolerance) << "Y at " << x << 'x' << y;
+    }
+  }
+
+  // Compare chroma away from tile edges, where swscale's filter taps mix neighbouring tiles
+  constexpr int chroma_tile = tile_size / 2;
+  constexpr int margin = 4;
+  auto desc = av_pix_fmt_desc_get(format.format);
+  for (int y = 0; y < image.height / 2; ++y) {
+    for (int x = 0; x < image.width / 2; ++x) {
+      if (x % chroma_tile < margin || x % chroma_tile >= chroma_tile - margin ||
+          y % chroma_tile < margin || y % chroma_tile >= chroma_tile - margin) {
+        continue;
+      }
+
+      for (int component = 1; component < 3; ++component) {
+        auto plane = desc->comp[component].plane;
+        ASSERT_NEAR(frame.sample(plane, component, x, y), golden.sample(plane, component, x, y), tolerance)
+          << (component == 1 ? 'U' : 'V') << " at " << x << 'x' << y;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+  BgraConvertColorspaces,
+  BgraConvertTest,
+  testing::Combine(
+    testing::Values(video::colorspace_e::rec601, video::colorspace_e::rec709, video::colorspace_e::bt2020),
+    testing::Bool(),
+    testing::Values(
+      format_t { AV_PIX_FMT_NV12, &bgra_to_nv12_fn },
+      format_t { AV_PIX_FMT_P010, &bgra_to_p010_fn },
+      format_t { AV_PIX_FMT_YUV420P, &bgra_to_yuv420p_fn },
+      format_t { AV_PIX_FMT_YUV420P10, &bgra_to_yuv420p10_fn })),
+  [](const auto &info) {
+    auto colorspace = std::get<0>(info.param);
+    auto full_range = std::get<1>(info.param);
+    auto format = std::get<2>(info.param);
+    std::string name = colorspace == video::colorspace_e::rec601 ? "Rec601" :
+                       colorspace == video::colorspace_e::rec709 ? "Rec709" :
+                                                                   "BT2020";
+    name += full_range ? "Full" : "Limited";
+    name += av_get_pix_fmt_name(format.format);
+    return name;
+  });
+
+TEST(BgraConvertTests, PartialFrameTest) {
+  bgra_convert_init();
+
+  // Converting a frame in slices gives the same result as converting it whole
+  bgra_image_t image { 64, 64 };
+  auto matrix = make_matrix({ video::colorspace_e::rec709, false, 8 });
+
+  yuv_frame_t whole { AV_PIX_FMT_NV12, image.width, image.height };
+  bgra_to_nv12_fn(image.data.data(), image.width * 4, image.width, image.height, whole.data, whole.linesize, &matrix);
+
+  yuv_frame_t sliced { AV_PIX_FMT_NV12, image.width, image.height };
+  for (int y = 0; y < image.height; y += 16) {
+    uint8_t *dst[3] = { sliced.data[0] + y * sliced.linesize[0], sliced.data[1] + y / 2 * sliced.linesize[1], nullptr };
+    bgra_to_nv12_fn(image.data.data() + y * image.width * 4, image.width * 4, image.width, 16, dst, sliced.linesize, &matrix);
+  }
+
+  ASSERT_EQ(whole.buffers[0], sliced.buffers[0]);
+  ASSERT_EQ(whole.buffers[1], sliced.buffers[1]);
+}
+
+struct BgraConvertIsaTest: testing::TestWithParam<const char *> {
+  void
+  TearDown() override {
+    bgra_convert_init();
+  }
+};
+
+TEST_P(BgraConvertIsaTest, MatchesDefaultTest) {
+  // Noise exercises every lane, and a width that isn't a multiple of 16 pixels the row tails
+  bgra_image_t image { 250, 32 };
+  std::srand(2);
+  for (auto &byte : image.data) {
+    byte = (uint8_t) std::rand();
+  }
+
+  const video::sunshine_colorspace_t colorspaces[] {
+    { video::colorspace_e::rec601, false, 8 },
+    { video::colorspace_e::rec709, true, 8 },
+    { video::colorspace_e::bt2020, false, 10 },
+  };
+  const format_t formats[] {
+    { AV_PIX_FMT_NV12, &bgra_to_nv12_fn },
+    { AV_PIX_FMT_P010, &bgra_to_p010_fn },
+    { AV_PIX_FMT_YUV420P, &bgra_to_yuv420p_fn },
+    { AV_PIX_FMT_YUV420P10, &bgra_to_yuv420p10_fn },
+  };
+
+  for (auto &colorspace : colorspaces) {
+    auto matrix = make_matrix(colorspace);
+
+    for (auto &format : formats) {
+      if ((av_pix_fmt_desc_get(format.format)->comp[0].depth > 8) != (colorspace.bit_depth > 8)) {
+        continue;
+      }
+
+      ASSERT_EQ(bgra_convert_init_isa("default"), 0);
+      yuv_frame_t expected { format.format, image.width, image.height };
+      (*format.convert)(image.data.data(), image.width * 4, image.width, image.height, expected.data, expected.linesize, &matrix);
+
+      if (bgra_convert_init_isa(GetParam())) {
+        GTEST_SKIP() << GetParam() << " isn't supported on this CPU";
+      }
+      yuv_frame_t frame { format.format, image.width, image.height };
+      (*format.convert)(image.data.data(), image.width * 4, image.width, image.height, frame.data, frame.linesize, &matrix);
+
+      for (int plane = 0; plane < 3; ++plane) {
+        ASSERT_EQ(frame.buffers[plane], expected.buffers[plane]) << av_get_pix_fmt_name(format.format) << " plane " << plane;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+  BgraConvertIsas,
+  BgraConvertIsaTest,
+  testing::Values("avx512", "avx2", "neon"),
+  [](const auto &info) {
+    return std::string { info.param };
+  });
@@ -0,0 +1,97 @@
+/**
+ * @file tests/unit/test_crypto.cpp
+ * @brief Test src/crypto.*
+ */
+#include <numeric>
+
+#include <src/crypto.h>
+
+#include "../tests_common.h"
+
+namespace {
+  constexpr size_t packet_size = 1392;
+  constexpr size_t iv_size = 12;
+
+  /**
+   * @brief Packets laid out like encrypted video shards: a GCM tag and IV, then the ciphertext.
+   */
+  struct packets_t {
+    explicit packets_t(size_t count):
+        tags(count * crypto::cipher::tag_size),
+        ivs(count * iv_size),
+        data(count * packet_size) {
+      for (size_t x = 0; x < data.size(); ++x) {
+        data[x] = (uint8_t) (x * 7);
+      }
+
+      // Deterministic IVs, like the per-packet counters of the video stream
+      for (size_t x = 0; x < count; ++x) {
+        std::copy_n((uint8_t *) &x, sizeof(x), &ivs[x * iv_size]);
+        ivs[x * iv_size + 11] = 'V';
+      }
+    }
+
+    std::vector<crypto::cipher::gcm_buffer_t>
+    buffers() {
+      std::vector<crypto::cipher::gcm_buffer_t> buffers;
+      for (size_t x = 0; x < data.size() / packet_size; ++x) {
+        buffers.emplace_back(crypto::cipher::gcm_buffer_t {
+          std::string_view { (char *) &data[x * packet_size], packet_size },
+          &tags[x * crypto::cipher::tag_size],
+          &data[x * packet_size],
+          &ivs[x * iv_size],
+        });
+      }
+      return buffers;
+    }
+
+    std::vector<uint8_t> tags;
+    std::vector<uint8_t> ivs;
+    std::vector<uint8_t> data;
+  };
+
+  crypto::aes_t
+  test_key() {
+    crypto::aes_t key(16);
+    std::iota(std::begin(key), std::end(key), 1);
+    return key;
+  }
+}  // namespace
+
+TEST(GcmBatchTests, MatchesSingleBufferEncryptTest) {
+  constexpr size_t count = 8;
+  packets_t single { count };
+  packets_t batched { count };
+
+  crypto::cipher::gcm_t single_cipher { test_key(), false };
+  crypto::aes_t iv(iv_size);
+  for (auto &buffer : single.buffers()) {
+    std::copy_n(buffer.iv, iv_size, std::begin(iv));
+    ASSERT_EQ(single_cipher.encrypt(buffer.plaintext, buffer.tag, buffer.ciphertext, &iv), packet_size);
+  }
+
+  crypto::cipher::gcm_t batch_cipher { test_key(), false };
+  ASSERT_EQ(batch_cipher.encrypt(batched.buffers()), count);
+
+  ASSERT_EQ(batched.data, single.data);
+  ASSERT_EQ(batched.tags, single.tags);
+
+  // Every packet decrypts with its own IV and tag
+  for (size_t x = 0; x < count; ++x) {
+    std::copy_n(&batched.ivs[x * iv_size], iv_size, std::begin(iv));
+
+    std::string tagged_cipher;
+    tagged_cipher.append((char *) &batched.tags[x * crypto::cipher::tag_size], crypto::cipher::tag_size);
+    tagged_cipher.append((char *) &batched.data[x * packet_size], packet_size);
+
+    std::vector<uint8_t> plaintext;
+    ASSERT_EQ(batch_cipher.decrypt(tagged_cipher, plaintext, &iv), 0);
+    ASSERT_EQ(plaintext.size(), packet_size);
+    ASSERT_EQ(plaintext[1], (uint8_t) ((x * packet_size + 1) * 7));
+  }
+}
+
+TEST(GcmBatchTests, EmptyBatchTest) {
+  crypto::cipher::gcm_t cipher { test_key(), false };
+  ASSERT_EQ(cipher.encrypt(std::span<const crypto::cipher::gcm_buffer_t> {}), 0);
+}
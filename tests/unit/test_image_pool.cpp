@@ -0,0 +1,188 @@
+/**
+ * @file tests/unit/test_image_pool.cpp
+ * @brief Test src/image_pool.h
+ */
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <src/image_pool.h>
+
+#include "../tests_common.h"
+
+namespace {
+  /**
+   * @brief A buffer that detects being handed out twice at once.
+   */
+  struct buffer_t {
+    std::atomic<bool> in_use { false };
+  };
+
+  using pool_t = image_pool::pool_t<buffer_t>;
+
+  /**
+   * @brief An allocator that counts its calls.
+   */
+  struct counting_alloc_t {
+    std::shared_ptr<buffer_t>
+    operator()() {
+      ++count;
+      return std::make_shared<buffer_t>();
+    }
+
+    int count = 0;
+  };
+}  // namespace
+
+TEST(ImagePoolTests, ReuseTest) {
+  auto pool = std::make_shared<pool_t>(2);
+  counting_alloc_t alloc;
+
+  auto first = pool->acquire(std::ref(alloc));
+  auto second = pool->acquire(std::ref(alloc));
+  ASSERT_TRUE(first && second);
+  ASSERT_NE(first.get(), second.get());
+  ASSERT_EQ(pool->acquire(std::ref(alloc)), nullptr);
+  ASSERT_EQ(pool->stats().exhausted, 1);
+
+  // Handed out buffers only count references from outside the pool
+  ASSERT_EQ(first.use_count(), 1);
+
+  // The most recently released buffer comes back first, without a new allocation
+  auto second_p = second.get();
+  first.reset();
+  second.reset();
+  ASSERT_EQ(pool->stats().in_use, 0);
+  ASSERT_EQ(pool->acquire(std::ref(alloc)).get(), second_p);
+  ASSERT_EQ(alloc.count, 2);
+}
+
+TEST(ImagePoolTests, TrimTest) {
+  auto pool = std::make_shared<pool_t>(4);
+  counting_alloc_t alloc;
+  auto now = std::chrono::steady_clock::now();
+
+  std::vector<std::shared_ptr<buffer_t>> buffers;
+  for (int x = 0; x < 4; ++x) {
+    buffers.emplace_back(pool->acquire(std::ref(alloc)));
+  }
+  ASSERT_EQ(pool->trim(now, 3s), 0);
+
+  // Only one buffer is used from now on
+  buffers.resize(1);
+  ASSERT_EQ(pool->trim(now + 1s, 3s), 0);
+  ASSERT_EQ(pool->trim(now + 4s, 3s), 3);
+
+  auto stats = pool->stats();
+  ASSERT_EQ(stats.allocated, 1);
+  ASSERT_EQ(stats.in_use, 1);
+  ASSERT_EQ(stats.trimmed, 3);
+}
+
+TEST(ImagePoolTests, OutlivesOwnerTest) {
+  auto pool = std::make_shared<pool_t>(1);
+  std::weak_ptr<pool_t> pool_wp = pool;
+
+  auto buffer = pool->acquire([]() { return std::make_shared<buffer_t>(); });
+  pool.reset();
+
+  // Handed out buffers keep the pool alive
+  ASSERT_FALSE(pool_wp.expired());
+  buffer.reset();
+  ASSERT_TRUE(pool_wp.expired());
+}
+
+/**
+ * @brief Hand buffers from one producer to many consumers that release them on their own threads.
+ */
+TEST(ImagePoolTests, ConcurrentReleaseStressTest) {
+  constexpr std::size_t capacity = 12;
+  constexpr int consumers = 8;
+  constexpr int frames = 100000;
+
+  auto pool = std::make_shared<pool_t>(capacity);
+  counting_alloc_t alloc;
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_cv;
+  std::deque<std::shared_ptr<buffer_t>> queue;
+  bool done = false;
+  std::atomic<int> duplicates = 0;
+
+  std::vector<std::thread> threads;
+  for (int x = 0; x < consumers; ++x) {
+    threads.emplace_back([&, x]() {
+      for (int count = 0;; ++count) {
+        std::shared_ptr<buffer_t> buffer;
+        {
+          std::unique_lock lk { queue_mutex };
+          queue_cv.wait(lk, [&]() { return done || !queue.empty(); });
+          if (queue.empty()) {
+            return;
+          }
+          buffer = std::move(queue.front());
+          queue.pop_front();
+        }
+
+        // Share the buffer with a copy released on another thread now and then
+        if ((count + x) % 7 == 0) {
+          std::thread { [copy = buffer]() {} }.detach();
+        }
+
+        if (count % 3 == 0) {
+          std::this_thread::yield();
+        }
+        buffer->in_use = false;
+      }
+    });
+  }
+
+  int acquired = 0;
+  while (acquired < frames) {
+    auto buffer = pool->acquire(std::ref(alloc));
+    if (!buffer) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    if (buffer->in_use.exchange(true)) {
+      ++duplicates;
+    }
+    ++acquired;
+
+    if (acquired % 64 == 0) {
+      pool->trim(std::chrono::steady_clock::now(), 1ms);
+    }
+
+    std::lock_guard lg { queue_mutex };
+    queue.emplace_back(std::move(buffer));
+    queue_cv.notify_one();
+  }
+
+  {
+    std::lock_guard lg { queue_mutex };
+    done = true;
+    queue_cv.notify_all();
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Wait for the detached copies
+  while (pool->stats().in_use) {
+    std::this_thread::sleep_for(1ms);
+  }
+
+  auto stats = pool->stats();
+  ASSERT_EQ(duplicates, 0);
+  ASSERT_LE(stats.allocated, capacity);
+  ASSERT_EQ(alloc.count, stats.allocated + stats.trimmed);
+
+  // Every buffer is free again
+  std::vector<std::shared_ptr<buffer_t>> buffers;
+  while (auto buffer = pool->acquire(std::ref(alloc))) {
+    buffers.emplace_back(std::move(buffer));
+  }
+  ASSERT_EQ(buffers.size(), capacity);
+}
@@ -3,18 +3,26 @@
  * @brief Test src/stream.*
  */
 
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <string>
 #include <vector>
 
+#include <src/adaptive_fec.h>
+#include <src/fec.h>
+#include <src/pacing.h>
+
 namespace stream {
   std::vector<uint8_t>
   concat_and_insert(uint64_t insert_size, uint64_t slice_size, const std::string_view &data1, const std::string_view &data2);
-}
+}  // namespace stream
 
 #include "../tests_common.h"
 
+using namespace std::literals;
+
 TEST(ConcatAndInsertTests, ConcatNoInsertionTest) {
   char b1[] = { 'a', 'b' };
   char b2[] = { 'c', 'd', 'e' };
@@ -38,3 +46,260 @@ TEST(ConcatAndInsertTests, ConcatSmallStrideTest) {
   auto expected = std::vector<uint8_t> { 0, 'a', 0, 'b', 0, 'c', 0, 'd', 0, 'e' };
   ASSERT_EQ(res, expected);
 }
+
+TEST(FecGeometryTests, PaddedDataShardTest) {
+  auto geometry = stream::fec::compute_geometry(1000, 100, 20, 0);
+  ASSERT_EQ(geometry.data_shards, 10);
+  ASSERT_EQ(geometry.parity_shards, 2);
+  ASSERT_EQ(geometry.percentage, 20);
+
+  geometry = stream::fec::compute_geometry(1001, 100, 20, 0);
+  ASSERT_EQ(geometry.data_shards, 11);
+  ASSERT_EQ(geometry.parity_shards, 3);
+  ASSERT_EQ(geometry.nr_shards(), 14);
+}
+
+TEST(FecGeometryTests, MinParityShardsTest) {
+  auto geometry = stream::fec::compute_geometry(400, 100, 20, 2);
+  ASSERT_EQ(geometry.data_shards, 4);
+  ASSERT_EQ(geometry.parity_shards, 2);
+  ASSERT_EQ(geometry.percentage, 50);
+
+  // The parity minimum does not apply when FEC is disabled for the frame
+  geometry = stream::fec::compute_geometry(400, 100, 0, 2);
+  ASSERT_EQ(geometry.parity_shards, 0);
+  ASSERT_EQ(geometry.percentage, 0);
+}
+
+TEST(GatherShardsTests, MiddleShardsPointIntoPayloadTest) {
+  constexpr size_t blocksize = 100;
+
+  std::vector<char> frame_header(8, 'h');
+  std::vector<char> payload(1000);
+  for (size_t x = 0; x < payload.size(); ++x) {
+    payload[x] = (char) (x * 13 + 1);
+  }
+
+  std::string_view frame_header_view { frame_header.data(), frame_header.size() };
+  std::string_view payload_view { payload.data(), payload.size() };
+  auto expected = stream::concat_and_insert(0, blocksize, frame_header_view, payload_view);
+  expected.resize(11 * blocksize, 0);
+
+  std::vector<char> scratch(2 * blocksize, 'x');
+  uint8_t *shards_p[11];
+  ASSERT_EQ(stream::fec::gather_shards(frame_header_view, payload_view, 0, 11, blocksize, scratch.data(), shards_p), 2);
+
+  for (int x = 0; x < 11; ++x) {
+    ASSERT_EQ(std::memcmp(shards_p[x], &expected[x * blocksize], blocksize), 0) << "shard " << x;
+
+    // Only the shard with the frame header and the padded last shard are copied
+    auto in_payload = (char *) shards_p[x] >= payload.data() && (char *) shards_p[x] < payload.data() + payload.size();
+    ASSERT_EQ(in_payload, x != 0 && x != 10) << "shard " << x;
+  }
+}
+
+TEST(GatherShardsTests, LaterBlockTest) {
+  constexpr size_t blocksize = 100;
+
+  std::vector<char> frame_header(8, 'h');
+  std::vector<char> payload(992, 'p');
+
+  // The frame fills 10 shards exactly, so the second block of 5 shards needs no copies
+  std::vector<char> scratch(2 * blocksize);
+  uint8_t *shards_p[5];
+  ASSERT_EQ(stream::fec::gather_shards({ frame_header.data(), frame_header.size() }, { payload.data(), payload.size() }, 5, 5, blocksize, scratch.data(), shards_p), 0);
+  ASSERT_EQ((char *) shards_p[0], &payload[5 * blocksize - frame_header.size()]);
+}
+
+TEST(ReedSolomonCacheTests, SplitHeaderParityTest) {
+  reed_solomon_init();
+
+  constexpr int data_shards = 6;
+  constexpr int parity_shards = 3;
+  constexpr int nr_shards = data_shards + parity_shards;
+  constexpr int headersize = 32;
+  constexpr int payloadsize = 100;
+  constexpr int blocksize = headersize + payloadsize;
+
+  // Packets with the header in front of the payload, as built by concat_and_insert()
+  std::vector<uint8_t> packets(nr_shards * blocksize, 0);
+  for (size_t x = 0; x < data_shards * blocksize; ++x) {
+    packets[x] = (uint8_t) (x * 17 + 3);
+  }
+
+  // The same packets with headers and payloads kept apart
+  std::vector<uint8_t> headers(nr_shards * headersize, 0);
+  std::vector<uint8_t> payloads(nr_shards * payloadsize, 0);
+  for (int x = 0; x < data_shards; ++x) {
+    std::memcpy(&headers[x * headersize], &packets[x * blocksize], headersize);
+    std::memcpy(&payloads[x * payloadsize], &packets[x * blocksize + headersize], payloadsize);
+  }
+
+  uint8_t *packets_p[nr_shards];
+  uint8_t *headers_p[nr_shards];
+  uint8_t *payloads_p[nr_shards];
+  for (int x = 0; x < nr_shards; ++x) {
+    packets_p[x] = &packets[x * blocksize];
+    headers_p[x] = &headers[x * headersize];
+    payloads_p[x] = &payloads[x * payloadsize];
+  }
+
+  auto rs = stream::fec::get_rs(data_shards, parity_shards);
+  ASSERT_EQ(reed_solomon_encode(rs, packets_p, nr_shards, blocksize), 0);
+  ASSERT_EQ(reed_solomon_encode(rs, headers_p, nr_shards, headersize), 0);
+  ASSERT_EQ(reed_solomon_encode(rs, payloads_p, nr_shards, payloadsize), 0);
+
+  for (int x = data_shards; x < nr_shards; ++x) {
+    ASSERT_EQ(std::memcmp(packets_p[x], headers_p[x], headersize), 0);
+    ASSERT_EQ(std::memcmp(packets_p[x] + headersize, payloads_p[x], payloadsize), 0);
+  }
+}
+
+TEST(ReedSolomonCacheTests, SameGeometrySharesCodecTest) {
+  reed_solomon_init();
+
+  auto rs = stream::fec::get_rs(10, 2);
+  ASSERT_NE(rs, nullptr);
+  ASSERT_EQ(stream::fec::get_rs(10, 2), rs);
+  ASSERT_NE(stream::fec::get_rs(10, 3), rs);
+}
+
+TEST(ReedSolomonCacheTests, CachedParityMatchesFreshCodecTest) {
+  reed_solomon_init();
+
+  constexpr int data_shards = 8;
+  constexpr int parity_shards = 2;
+  constexpr int blocksize = 64;
+
+  std::vector<uint8_t> buffer((data_shards + 2 * parity_shards) * blocksize);
+  for (size_t x = 0; x < data_shards * blocksize; ++x) {
+    buffer[x] = (uint8_t) (x * 31 + 7);
+  }
+
+  uint8_t *fresh_shards[data_shards + parity_shards];
+  uint8_t *cached_shards[data_shards + parity_shards];
+  for (int x = 0; x < data_shards; ++x) {
+    fresh_shards[x] = cached_shards[x] = &buffer[x * blocksize];
+  }
+  for (int x = 0; x < parity_shards; ++x) {
+    fresh_shards[data_shards + x] = &buffer[(data_shards + x) * blocksize];
+    cached_shards[data_shards + x] = &buffer[(data_shards + parity_shards + x) * blocksize];
+  }
+
+  auto fresh = reed_solomon_new(data_shards, parity_shards);
+  ASSERT_EQ(reed_solomon_encode(fresh, fresh_shards, data_shards + parity_shards, blocksize), 0);
+  reed_solomon_release(fresh);
+
+  ASSERT_EQ(reed_solomon_encode(stream::fec::get_rs(data_shards, parity_shards), cached_shards, data_shards + parity_shards, blocksize), 0);
+
+  for (int x = 0; x < parity_shards; ++x) {
+    ASSERT_EQ(std::memcmp(fresh_shards[data_shards + x], cached_shards[data_shards + x], blocksize), 0);
+  }
+}
+
+TEST(ReedSolomonCacheTests, WarmCoversAllBlockGeometriesTest) {
+  reed_solomon_init();
+
+  // 212 data shards is the largest FEC block at 20%
+  ASSERT_GE(stream::fec::warm_rs_cache(20, 0), 212);
+}
+
+TEST(PacingTests, AutoRateTest) {
+  // High bitrate sessions on gigabit links keep the old rate of 80% of 1 Gbps
+  ASSERT_EQ(stream::pacing::auto_rate(1000, 150000), 800);
+
+  // Faster links let large frames drain sooner
+  ASSERT_EQ(stream::pacing::auto_rate(10000, 150000), 3000);
+
+  // Low bitrate sessions get smaller bursts, down to a floor
+  ASSERT_EQ(stream::pacing::auto_rate(1000, 20000), 400);
+  ASSERT_EQ(stream::pacing::auto_rate(10000, 1000), 100);
+
+  // An unknown link speed is treated as gigabit
+  ASSERT_EQ(stream::pacing::auto_rate(0, 150000), 800);
+}
+
+TEST(PacingTests, LossScaleTest) {
+  auto scale = 100;
+  scale = stream::pacing::adapt_scale(scale, 3);
+  ASSERT_EQ(scale, 75);
+
+  // Sustained loss can't stop the stream
+  for (int x = 0; x < 20; ++x) {
+    scale = stream::pacing::adapt_scale(scale, 1);
+  }
+  ASSERT_EQ(scale, 25);
+
+  // Recovery is gradual and capped at the full rate
+  scale = stream::pacing::adapt_scale(scale, 0);
+  ASSERT_EQ(scale, 30);
+  for (int x = 0; x < 20; ++x) {
+    scale = stream::pacing::adapt_scale(scale, 0);
+  }
+  ASSERT_EQ(scale, 100);
+}
+
+TEST(PacingTests, PacketsIn1msTest) {
+  // Matches the old fixed computation for 80% of 1 Gbps
+  constexpr size_t blocksize = 1416;
+  ASSERT_EQ(stream::pacing::packets_in_1ms(800, blocksize), (size_t) 1000000000 * 80 / 100 / 1000 / blocksize / 8);
+
+  ASSERT_EQ(stream::pacing::packets_in_1ms(1, blocksize), 1);
+}
+
+TEST(PacingTests, DepartureTimeTest) {
+  auto frame_start = std::chrono::steady_clock::time_point { 5s };
+
+  ASSERT_EQ(stream::pacing::departure_time(frame_start, 0, 70), frame_start);
+  ASSERT_EQ(stream::pacing::departure_time(frame_start, 70, 70), frame_start + 1ms);
+  ASSERT_EQ(stream::pacing::departure_time(frame_start, 35, 70), frame_start + 500us);
+
+  // Departure times never go backwards within a frame
+  for (size_t x = 1; x < 1000; ++x) {
+    ASSERT_LE(stream::pacing::departure_time(frame_start, x - 1, 70), stream::pacing::departure_time(frame_start, x, 70));
+  }
+}
+
+TEST(AdaptiveFecTests, LossRaisesParityTest) {
+  int clean_reports = 3;
+
+  ASSERT_EQ(stream::adaptive_fec::adapt_percentage(5, 1, clean_reports, 20), 10);
+  ASSERT_EQ(clean_reports, 0);
+
+  // Never above the configured percentage
+  ASSERT_EQ(stream::adaptive_fec::adapt_percentage(18, 40, clean_reports, 20), 20);
+}
+
+TEST(AdaptiveFecTests, CleanReportsLowerParityTest) {
+  int clean_reports = 0;
+  int percentage = 20;
+
+  // One point per 10 reports without loss
+  for (int x = 0; x < 9; ++x) {
+    percentage = stream::adaptive_fec::adapt_percentage(percentage, 0, clean_reports, 20);
+  }
+  ASSERT_EQ(percentage, 20);
+  percentage = stream::adaptive_fec::adapt_percentage(percentage, 0, clean_reports, 20);
+  ASSERT_EQ(percentage, 19);
+
+  // Down to 5% at most
+  for (int x = 0; x < 1000; ++x) {
+    percentage = stream::adaptive_fec::adapt_percentage(percentage, 0, clean_reports, 20);
+  }
+  ASSERT_EQ(percentage, 5);
+
+  // Configured percentages below the minimum are left alone
+  percentage = 2;
+  for (int x = 0; x < 100; ++x) {
+    percentage = stream::adaptive_fec::adapt_percentage(percentage, 0, clean_reports, 2);
+  }
+  ASSERT_EQ(percentage, 2);
+}
+
+TEST(AdaptiveFecTests, KeyFramesGetMoreParityTest) {
+  ASSERT_EQ(stream::adaptive_fec::frame_percentage(10, false), 10);
+  ASSERT_EQ(stream::adaptive_fec::frame_percentage(10, true), 20);
+
+  // Limited by the 8 bit FEC percentage of the packet header
+  ASSERT_EQ(stream::adaptive_fec::frame_percentage(200, true), 255);
+}
@@ -46,3 +46,129 @@ INSTANTIATE_TEST_SUITE_P(
 TEST_P(EncoderTest, ValidateEncoder) {
   // todo:: test something besides fixture setup
 }
+
+TEST(DynamicParamTests, FramerateTest) {
+  video::config_t config {};
+  config.framerate = 60;
+
+  video::dynamic_param_t param {};
+  param.type = video::dynamic_param_type_e::FPS;
+  param.value.float_value = 120.0f;
+  param.valid = true;
+
+  ASSERT_TRUE(video::apply_dynamic_param(config, param));
+  ASSERT_EQ(config.framerate, 120);
+  ASSERT_EQ(config.frameRateNum, 0);
+  ASSERT_EQ(config.get_effective_framerate(), 120.0);
+
+  // Fractional rates keep their exact value
+  param.value.float_value = 59.94f;
+  ASSERT_TRUE(video::apply_dynamic_param(config, param));
+  ASSERT_EQ(config.framerate, 60);
+  ASSERT_EQ(config.frameRateNum, 59940);
+  ASSERT_EQ(config.frameRateDen, 1000);
+}
+
+TEST(DynamicParamTests, NotInConfigTest) {
+  video::config_t config {};
+  auto original = config;
+
+  video::dynamic_param_t param {};
+  param.type = video::dynamic_param_type_e::QP;
+  param.value.int_value = 20;
+  param.valid = true;
+
+  ASSERT_FALSE(video::apply_dynamic_param(config, param));
+  ASSERT_EQ(config, original);
+}
+
+struct EncoderCacheTests: testing::Test {
+  void
+  SetUp() override {
+    saved = { video::software.h264.capabilities, video::software.hevc.capabilities, video::software.av1.capabilities };
+  }
+
+  void
+  TearDown() override {
+    std::tie(video::software.h264.capabilities, video::software.hevc.capabilities, video::software.av1.capabilities) = saved;
+  }
+
+  std::tuple<decltype(video::software.h264.capabilities), decltype(video::software.hevc.capabilities), decltype(video::software.av1.capabilities)> saved;
+  std::vector<video::encoder_t *> encoder_list { &video::software };
+};
+
+TEST_F(EncoderCacheTests, RoundTripTest) {
+  video::software.h264.capabilities = 0b10101;
+  video::software.hevc.capabilities = 0b00011;
+  video::software.av1.capabilities = 0;
+  auto data = video::serialize_probe_results("key", video::software);
+
+  video::software.h264.capabilities.reset();
+  video::software.hevc.capabilities.reset();
+  video::software.av1.capabilities.set();
+
+  ASSERT_EQ(video::restore_probe_results(data, "key", encoder_list), &video::software);
+  ASSERT_EQ(video::software.h264.capabilities.to_ulong(), 0b10101);
+  ASSERT_EQ(video::software.hevc.capabilities.to_ulong(), 0b00011);
+  ASSERT_EQ(video::software.av1.capabilities.to_ulong(), 0);
+}
+
+TEST_F(EncoderCacheTests, MismatchTest) {
+  video::software.h264.capabilities = 0b10101;
+  auto data = video::serialize_probe_results("key", video::software);
+  video::software.h264.capabilities.reset();
+
+  // Results for other hardware, unknown encoders and corrupted files are ignored
+  ASSERT_EQ(video::restore_probe_results(data, "other key", encoder_list), nullptr);
+  ASSERT_EQ(video::restore_probe_results(data, "key", {}), nullptr);
+  ASSERT_EQ(video::restore_probe_results(data.substr(0, data.size() / 2), "key", encoder_list), nullptr);
+  ASSERT_EQ(video::restore_probe_results({}, "key", encoder_list), nullptr);
+  ASSERT_EQ(video::software.h264.capabilities.to_ulong(), 0);
+}
+
+TEST(FramePacerTests, SteadyArrivalsTest) {
+  video::frame_pacer_t pacer { 100.0 };
+  auto start = std::chrono::steady_clock::now();
+
+  // Frames arriving a little early or late are encoded right away
+  for (int x = 0; x < 100; ++x) {
+    auto arrival = start + x * 10ms + (x % 2 ? 1ms : -1ms);
+    ASSERT_GT(pacer.wait_for(arrival), 0s);
+    pacer.frame_arrived(arrival);
+    ASSERT_EQ(pacer.hold_for(arrival), 0s);
+    pacer.frame_released(arrival, false);
+  }
+
+  ASSERT_EQ(pacer.released, 100);
+  ASSERT_EQ(pacer.dropped, 0);
+  ASSERT_EQ(pacer.duplicated, 0);
+}
+
+TEST(FramePacerTests, BurstTest) {
+  video::frame_pacer_t pacer { 100.0 };
+  auto start = std::chrono::steady_clock::now();
+  pacer.frame_arrived(start);
+  pacer.frame_released(start, false);
+
+  // The second frame of a burst waits for the window of the next tick
+  pacer.frame_arrived(start + 1ms);
+  ASSERT_EQ(pacer.hold_for(start + 1ms), 4ms);
+  ASSERT_EQ(pacer.hold_for(start + 5ms), 0s);
+}
+
+TEST(FramePacerTests, MissingFrameTest) {
+  video::frame_pacer_t pacer { 100.0 };
+  auto start = std::chrono::steady_clock::now();
+  pacer.frame_arrived(start);
+  pacer.frame_released(start, false);
+
+  // Without a frame, a duplicate is encoded shortly after the next tick
+  ASSERT_EQ(pacer.wait_for(start), 15ms);
+  pacer.frame_released(start + 15ms, true);
+  ASSERT_EQ(pacer.duplicated, 1);
+  ASSERT_EQ(pacer.wait_for(start + 15ms), 10ms);
+
+  // After a stall, the pacer waits for captured frames again
+  pacer.frame_released(start + 1s, false);
+  ASSERT_EQ(pacer.wait_for(start + 1s), 20ms);
+}